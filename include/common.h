@@ -8,13 +8,15 @@
 #define DEFAULT_CONSUMERS 2
 #define DEFAULT_MESSAGES_PER_PRODUCER 10000
 #define DEFAULT_MSG_SIZE 32
+#define MAX_PRIORITIES 32
 
 // Message format: fixed header + payload
 typedef struct {
     uint32_t producer_id;
     uint32_t seq;        // sequence number for that producer
     uint32_t payload_len;
-    uint32_t crc32;      // optional, can be 0 for now
+    uint32_t crc32;      // CRC-32C of the frame (--checksum, crc32c.h), else 0
+    uint64_t send_ns;    // CLOCK_MONOTONIC when sent (--latency), else 0
     // payload follows (payload_len bytes)
 } msg_hdr_t;
 
@@ -23,6 +25,19 @@ typedef struct {
     int consumers;
     uint32_t messages_per_producer;
     uint32_t msg_size;
+    uint32_t batch;      // messages per enqueue/dequeue call (0 or 1 = unbatched)
+    int latency;         // stamp send_ns and record per-message latency
+    int checksum;        // checksum_t (crc32c.h): fill and verify msg_hdr_t.crc32
+    double rate;         // --rate: messages/sec per producer, 0 = closed loop (pacer.h)
+    int arrival;         // arrival_t (pacer.h): constant or Poisson gaps under --rate
+    int on_full;         // onfull_t (onfull.h): block, drop or retry when the queue is full
+    uint32_t retry_us;   // --on-full retry-timeout=US
+    int priorities;      // --priorities K (prio.h), 0 = off
+    uint64_t prio_cut[MAX_PRIORITIES]; // cumulative --prio-mix shares, scaled to 2^32
+    int work;            // work_dist_t (work.h): simulated per-message processing time
+    uint32_t work_ns;    // fixed / mean / fast-mode service time
+    uint32_t work_slow_ns; // bimodal slow mode
+    double work_slow_p;  // bimodal: probability of the slow mode
     int verbose;
 } config_t;
 
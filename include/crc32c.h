@@ -0,0 +1,38 @@
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include "common.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// CRC-32C (Castagnoli), the checksum in msg_hdr_t.crc32 under --checksum.
+// Two kernels, picked once at startup by crc32c_setup():
+//   sse4.2  the crc32 instruction over three interleaved streams, so its
+//           3-cycle latency is hidden; the partial CRCs are then combined by
+//           shifting them over the bytes that follow (zero-operator tables)
+//   slice8  portable table lookup, 8 bytes per step
+typedef enum {
+    CHECKSUM_NONE = 0,
+    CHECKSUM_CRC32C = 1,     // sse4.2 when the CPU has it, else slice8
+    CHECKSUM_CRC32C_SW = 2   // always slice8 (for comparison)
+} checksum_t;
+
+// "none", "crc32c" or "crc32c-sw"; -1 if unknown
+int checksum_parse(const char* s);
+
+// Build the tables and select the kernel for mode. Call before starting any
+// producer or consumer. Returns the kernel name ("sse4.2", "slice8", "none").
+const char* crc32c_setup(checksum_t mode);
+
+// Running CRC: crc32c(0, ...) starts one, and a result can be passed back in
+// to continue over more bytes.
+uint32_t crc32c(uint32_t crc, const void* buf, size_t len);
+
+// Frame checksum: producer_id, seq and payload_len, then the payload. crc32
+// and send_ns are left out, so the checksum can be taken before stamping.
+static inline uint32_t crc32c_frame(const msg_hdr_t* hdr, const void* payload) {
+    uint32_t crc = crc32c(0, hdr, offsetof(msg_hdr_t, crc32));
+    return crc32c(crc, payload, hdr->payload_len);
+}
+
+#endif
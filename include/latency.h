@@ -0,0 +1,76 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+// Log-linear latency histogram (HdrHistogram-style): values below LAT_SUB ns
+// get one bucket each, every power of two above that is split into LAT_SUB
+// linear buckets, so any recorded value is off by at most 1/LAT_SUB (6.25%).
+// Fixed size and pointer-free, so it can live in MAP_SHARED memory and be
+// filled by a forked consumer.
+#define LAT_SUB_BITS 4
+#define LAT_SUB (1u << LAT_SUB_BITS)
+#define LAT_GROUPS (64 - LAT_SUB_BITS + 1)
+#define LAT_BUCKETS (LAT_GROUPS * LAT_SUB)
+
+typedef struct {
+    uint64_t count;
+    uint64_t sum_ns;
+    uint64_t min_ns;
+    uint64_t max_ns;
+    uint64_t buckets[LAT_BUCKETS];
+} lat_hist_t;
+
+// CLOCK_MONOTONIC in ns; the value stamped into msg_hdr_t.send_ns
+static inline uint64_t lat_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static inline uint32_t lat_index(uint64_t v) {
+    if (v < LAT_SUB) return (uint32_t)v;
+    uint32_t msb = 63u - (uint32_t)__builtin_clzll(v);
+    uint32_t group = msb - LAT_SUB_BITS + 1;
+    uint32_t sub = (uint32_t)(v >> (msb - LAT_SUB_BITS)) & (LAT_SUB - 1);
+    return group * LAT_SUB + sub;
+}
+
+// Record one sample: the time from send_ns to now_ns
+static inline void lat_record(lat_hist_t* h, uint64_t send_ns, uint64_t now_ns) {
+    uint64_t v = (now_ns > send_ns) ? now_ns - send_ns : 0;
+    h->buckets[lat_index(v)]++;
+    if (h->count == 0 || v < h->min_ns) h->min_ns = v;
+    if (v > h->max_ns) h->max_ns = v;
+    h->count++;
+    h->sum_ns += v;
+}
+
+// n zeroed histograms in MAP_SHARED memory, one per consumer, so forked
+// children and threads fill them alike. NULL on failure.
+lat_hist_t* lat_alloc_shared(int n);
+void lat_free_shared(lat_hist_t* hs, int n);
+
+void lat_reset(lat_hist_t* h);
+void lat_merge(lat_hist_t* dst, const lat_hist_t* src);
+
+// Value at quantile q (0..1): the upper edge of the bucket holding it, capped at max
+uint64_t lat_percentile(const lat_hist_t* h, double q);
+
+// "latency: samples=N min=.. p50=.. p90=.. p99=.. p99.9=.. max=.. mean=.." (microseconds)
+void lat_print(FILE* out, const lat_hist_t* h);
+
+// The same line under another label, e.g. "commit_latency: samples=..."
+void lat_print_as(FILE* out, const char* label, const lat_hist_t* h);
+
+// Merge hs[0..n) and print the result with lat_print
+void lat_report(FILE* out, const lat_hist_t* hs, int n);
+
+// Per-priority lines for --priorities: hs holds consumers x lanes histograms,
+// consumer c's lane k at hs[c * lanes + k]. Prints "latency[prio=k]: ..."
+// from the most urgent lane down.
+void lat_report_lanes(FILE* out, const lat_hist_t* hs, int consumers, int lanes);
+
+#endif
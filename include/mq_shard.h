@@ -0,0 +1,57 @@
+#ifndef MQ_SHARD_H
+#define MQ_SHARD_H
+
+#include "common.h"
+#include "statsblock.h"
+#include <mqueue.h>
+
+// The ipc_mq queues (mq_shard.c): K named POSIX queues, producers picking one
+// per message, consumers reading one queue or, when sharded, all of them
+// through epoll. ipc_mq and ipc_bench's mq transport both drive it:
+//
+//   parent:    mq_shard_open() ... fork or spawn threads
+//   producer:  mq_shard_producer_run()
+//   consumer:  mq_shard_consumer_run()
+//   parent:    wait producers ... mq_shard_finish() ... wait consumers ... mq_shard_close()
+
+#define MQ_MAX_QUEUES 256
+#define MQ_MSG_MAX_PATH "/proc/sys/fs/mqueue/msg_max"
+#define MQ_MSGSIZE_MAX_PATH "/proc/sys/fs/mqueue/msgsize_max"
+
+typedef enum {
+    PICK_ID = 0,   // producer p always sends to queue p % K
+    PICK_RR        // producer p sends message i to queue (p + i) % K
+} pick_t;
+
+typedef struct {
+    int nq;
+    pick_t pick;
+    int maxmsg;          // per queue, after clamping to msg_max
+    long msgsize;        // frame bytes
+    long msg_max;        // the unprivileged limits read from /proc
+    long msgsize_max;
+    char names[MQ_MAX_QUEUES][128];
+    mqd_t qs[MQ_MAX_QUEUES];
+} mq_shard_t;
+
+// Read msg_max and msgsize_max into m (fallbacks 10 and 8192)
+void mq_shard_limits(mq_shard_t* m);
+
+// Create nq queues of maxmsg frames of msg_bytes each. A maxmsg above msg_max
+// is lowered to it (with a note) when only privileged callers may exceed it.
+// 0 on success, -1 on error (reported with perror).
+int mq_shard_open(mq_shard_t* m, int nq, int maxmsg, pick_t pick, size_t msg_bytes);
+
+// The producer and consumer roles; 0 on success, else a nonzero exit code.
+// st->lat has one histogram per priority.
+int mq_shard_producer_run(const mq_shard_t* m, uint32_t producer_id, const config_t* cfg, stats_block_t* sb);
+int mq_shard_consumer_run(mq_shard_t* m, const config_t* cfg, stats_t* st);
+
+// Once every producer is done: one sentinel per consumer on every queue, at
+// priority 0 so it queues behind every message still waiting. -1 on error.
+int mq_shard_finish(const mq_shard_t* m, const config_t* cfg);
+
+// Close and unlink every queue
+void mq_shard_close(mq_shard_t* m);
+
+#endif
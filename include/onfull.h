@@ -0,0 +1,44 @@
+#ifndef ONFULL_H
+#define ONFULL_H
+
+#include "common.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+// What a producer does when the queue is full (--on-full):
+//
+//   block             wait for room, as before
+//   drop              give up on the message at once
+//   retry-timeout=US  wait up to US microseconds for room, then drop
+//
+// Every policy first tries to send without waiting, so each send that finds
+// the queue full is counted, and any wait that follows is timed. Those
+// counters and the drops live in the stats block (statsblock.h, sb_prod_t).
+typedef enum {
+    ONFULL_BLOCK = 0,
+    ONFULL_DROP = 1,
+    ONFULL_RETRY = 2
+} onfull_t;
+
+// Deadline for "give up after the first try": earlier than any lat_now_ns()
+#define ONFULL_NOW 1ull
+
+// Sets cfg->on_full (and cfg->retry_us); -1 if s is not a valid policy
+int onfull_parse(const char* s, config_t* cfg);
+
+// "block", "drop" or "retry-timeout=US", formatted into buf
+const char* onfull_name(const config_t* cfg, char* buf, size_t len);
+
+// Deadline on the lat_now_ns() clock for a send that found the queue full at
+// now_ns: 0 (block, no deadline), ONFULL_NOW (drop) or now_ns + retry_us
+uint64_t onfull_deadline(const config_t* cfg, uint64_t now_ns);
+
+// The same instant as an absolute CLOCK_REALTIME time, for sem_timedwait and
+// mq_timedsend
+void onfull_realtime(uint64_t deadline_ns, struct timespec* ts);
+
+// Time left until deadline_ns (never negative), for poll/futex timeouts
+void onfull_remaining(uint64_t deadline_ns, uint64_t now_ns, struct timespec* ts);
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef PACER_H
+#define PACER_H
+
+#include "common.h"
+#include <stdint.h>
+
+// Open-loop send schedule for --rate. Each producer owns one pacer: message
+// i is due at its intended time t_i (constant spacing, or Poisson arrivals
+// with exponential gaps), and is sent then or, if the producer has fallen
+// behind, as soon as it can. send_ns carries t_i rather than the time the
+// send actually happened, so delay from a full queue or a late producer still
+// counts toward latency (no coordinated omission).
+typedef enum {
+    ARRIVAL_CONSTANT = 0,
+    ARRIVAL_POISSON = 1
+} arrival_t;
+
+typedef struct {
+    int active;          // cfg->rate > 0
+    int poisson;
+    double gap_ns;       // mean inter-arrival time
+    double next_ns;      // intended time of the next message
+    uint64_t rng;        // xorshift64 state (Poisson)
+} pacer_t;
+
+// Messages/sec for --rate (> 0, fractions allowed); -1 if invalid
+double rate_parse(const char* s);
+
+// Apply --rate (total across producers) or --rate-per-producer to cfg; at
+// most one may be > 0. An open-loop run also turns on --latency. Returns -1
+// (after printing why) if both were given.
+int pacer_configure(config_t* cfg, double total, double per_producer);
+
+// "constant" or "poisson"; -1 if unknown
+int arrival_parse(const char* s);
+const char* arrival_name(arrival_t a);
+
+// Start the schedule now, at cfg->rate messages/sec for this producer
+void pacer_init(pacer_t* p, const config_t* cfg, uint32_t producer_id);
+
+// Wait until the next message is due, then take it and every following
+// message that is also already due, up to max. Their intended send times go
+// to stamps[]; returns how many were taken (at least 1).
+uint32_t pacer_take(pacer_t* p, uint32_t max, uint64_t* stamps);
+
+#endif
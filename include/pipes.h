@@ -0,0 +1,43 @@
+#ifndef PIPES_H
+#define PIPES_H
+
+#include "common.h"
+#include "statsblock.h"
+#include <limits.h>
+#include <stdint.h>
+
+// The ipc_pipes producer and consumer loops (producer.c, consumer.c), shared
+// with ipc_bench's pipes transport. Each takes the pipe ends it owns; the
+// caller creates the pipes and closes the ends a role must not hold (a
+// consumer that holds a write end never sees EOF).
+
+#ifndef PIPE_BUF
+#define PIPE_BUF 4096
+#endif
+
+// Bytes a fan-in producer packs into one write (a pipe has one writer there,
+// so PIPE_BUF atomicity no longer matters)
+#define FANIN_WRITE_BYTES 65536
+
+typedef enum {
+    TOPOLOGY_SHARED = 0,  // one pipe shared by every producer and consumer
+    TOPOLOGY_FANIN        // one pipe per producer; consumer c reads pipes p with p % C == c
+} topology_t;
+
+// A shared-pipe batch must fit in one atomic write (PIPE_BUF); a fan-in batch
+// is only capped to keep the producer's buffer modest
+static inline uint32_t pipes_max_batch(topology_t topology, size_t msg_bytes) {
+    size_t write_limit = (topology == TOPOLOGY_SHARED) ? (size_t)PIPE_BUF : (size_t)FANIN_WRITE_BYTES;
+    uint32_t max_batch = (uint32_t)(write_limit / msg_bytes);
+    return max_batch ? max_batch : 1;
+}
+
+int producer_run(int out_fd, uint32_t producer_id, const config_t* cfg, stats_block_t* sb);
+int producer_run_zerocopy(int out_fd, uint32_t producer_id, const config_t* cfg);
+int producer_run_uring(int out_fd, uint32_t producer_id, const config_t* cfg, uint32_t depth);
+
+int consumer_run(int in_fd, const config_t* cfg, stats_t* stats_out);
+int consumer_run_uring(int in_fd, const config_t* cfg, uint32_t depth, stats_t* stats_out);
+int consumer_run_fanin(const int* in_fds, int nfds, int sink_fd, const config_t* cfg, stats_t* stats_out);
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef PRIO_H
+#define PRIO_H
+
+#include "common.h"
+#include <stdint.h>
+
+// --priorities K: every message gets a priority 0..K-1, K-1 the most urgent.
+// It is a hash of (producer, seq) weighted by --prio-mix, so a run is
+// repeatable and needs no header field: mq carries it as the native message
+// priority, shm as the lane the message is queued in.
+
+// Fill cfg->prio_cut from mix, comma-separated integer weights listed from
+// priority 0 up ("95,5"); NULL means equal shares. With no --priorities the
+// number of weights sets K. Returns -1 (after printing why) if invalid.
+int prio_configure(config_t* cfg, const char* mix);
+
+// splitmix64 of (producer, seq); its top 32 bits pick the priority
+static inline uint32_t prio_of(const config_t* cfg, uint32_t producer_id, uint32_t seq) {
+    if (cfg->priorities <= 1) return 0;
+    uint64_t x = (((uint64_t)producer_id << 32) | seq) + 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    uint64_t r = (x ^ (x >> 31)) >> 32;
+    uint32_t k = 0;
+    while (k + 1 < (uint32_t)cfg->priorities && r >= cfg->prio_cut[k]) k++;
+    return k;
+}
+
+#endif
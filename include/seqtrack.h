@@ -0,0 +1,44 @@
+#ifndef SEQTRACK_H
+#define SEQTRACK_H
+
+#include <stdint.h>
+
+// Duplicate tracking per producer in bounded memory. Each consumer sees a
+// producer's seqs almost in order (FIFO transports; reordering only from
+// in-flight batches, io_uring completions or sharded queues), so a sliding
+// window of the most recent seqs is enough:
+//
+//   bit (seq % window) is set  <=>  seq was seen, for seq in [high - window, high)
+//
+// where high is one past the newest seq seen. A run of at most window
+// messages per producer never slides, so the window is then an exact bitset.
+// A seq older than the window is reported SEQ_LATE (it cannot be checked)
+// and the window doubles, up to SEQTRACK_MAX_WINDOW, to cover that distance.
+#define SEQTRACK_WINDOW (1u << 16)      // initial bits per producer (8 KB)
+#define SEQTRACK_MAX_WINDOW (1u << 24)  // growth cap (2 MB per producer)
+
+typedef enum {
+    SEQ_NEW = 0,
+    SEQ_DUP = 1,
+    SEQ_LATE = 2    // older than the window: not checked for duplicates
+} seq_result_t;
+
+typedef struct {
+    uint64_t* bits;
+    uint32_t window;     // power of two, >= 64
+    uint32_t high;       // newest seq seen + 1 (0 = none yet)
+} seqwin_t;
+
+typedef struct {
+    uint32_t producers;
+    seqwin_t* win;       // one per producer
+} seqtrack_t;
+
+// NULL if out of memory; seqtrack_free(NULL) is a no-op
+seqtrack_t* seqtrack_new(uint32_t producers, uint32_t messages_per_producer);
+void seqtrack_free(seqtrack_t* t);
+
+// Record seq from producer (both already range-checked by the caller)
+seq_result_t seqtrack_mark(seqtrack_t* t, uint32_t producer, uint32_t seq);
+
+#endif
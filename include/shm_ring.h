@@ -0,0 +1,108 @@
+#ifndef SHM_RING_H
+#define SHM_RING_H
+
+#include "common.h"
+#include "statsblock.h"
+#include <stddef.h>
+#include <stdio.h>
+
+// The ipc_shm_sem queue engines (shm_ring.c): one mapping holding the ring,
+// its wait queues and, per topology, the per-producer rings or the
+// work-stealing deques. ipc_shm_sem and ipc_bench's shm transport both drive
+// it the same way:
+//
+//   parent:    shm_ring_check(), shm_ring_create() ... fork or spawn threads
+//   producer:  shm_producer_run()
+//   consumer:  shm_consumer_run()
+//   parent:    wait producers ... shm_ring_finish() ... wait consumers ... shm_ring_destroy()
+
+#define SHM_DEFAULT_SLOTS 64
+#define SHM_DEFAULT_STARVE_LIMIT 32
+
+typedef enum {
+    CONSUMER_PULL = 0,   // one message (or --batch) at a time straight from the ring
+    CONSUMER_STEAL = 1   // batches into a per-consumer deque; idle consumers steal
+} consumer_mode_t;
+
+typedef enum {
+    ENGINE_SEM = 0,      // empty/full/mutex semaphores around every push/pop
+    ENGINE_LOCKFREE = 1, // per-slot sequence numbers + atomic head/tail claims
+    ENGINE_BYTES = 2     // variable-length records packed into a byte ring
+} engine_t;
+
+typedef enum {
+    TOPOLOGY_SHARED = 0, // every producer and consumer uses the one ring in shm_region_t
+    TOPOLOGY_SPSC = 1    // one private SPSC ring per producer, consumers fan in
+} topology_t;
+
+typedef enum {
+    WAIT_SEM = 0,   // spin briefly, then sleep on a semaphore
+    WAIT_SPIN = 1,  // spin with `pause` forever
+    WAIT_YIELD = 2, // spin briefly, then sched_yield() and retry
+    WAIT_FUTEX = 3, // spin briefly, then FUTEX_WAIT on the queue's wake-token word
+    WAIT_EVENTFD = 4 // spin briefly, then block reading the queue's eventfd
+} wait_policy_t;
+
+typedef struct {
+    int slots;
+    int engine;          // engine_t, -1 = not a known engine
+    int eventfd;         // --engine eventfd: ENGINE_LOCKFREE with WAIT_EVENTFD
+    int topology;        // topology_t, -1 = not a known topology
+    int ring_bytes;      // byte ring size; 0 = derive from slots and msg_size
+    int wait_policy;     // wait_policy_t, -1 = not a known policy
+    int wait_given;      // --wait was explicit
+    int lanes;           // priority lanes, from cfg->priorities (shm_ring_check)
+    int starve_limit;    // passes before a waiting lower lane is served, 0 = strict
+    int consumer_mode;   // consumer_mode_t
+    int hugepages;       // try MAP_HUGETLB first
+    int numa_node;       // bind the mapping to this node, -1 = no binding
+    int threads;         // process-private mapping and semaphores (--threads)
+} shm_opts_t;
+
+typedef struct shm_region shm_region_t;
+
+typedef struct {
+    shm_region_t* shm;
+    shm_opts_t opts;
+    size_t map_bytes;
+    char name[128];        // shm_open() object, "" for an anonymous mapping
+    const char* page_mode; // "4k", "huge" or "4k(fallback)"
+} shm_ring_t;
+
+// The ipc_shm_sem defaults: sem engine, shared ring of SHM_DEFAULT_SLOTS
+void shm_opts_init(shm_opts_t* o);
+
+// "sem", "lockfree", "eventfd" or "bytes" into o->engine (and o->eventfd); -1 if unknown
+int shm_parse_engine(const char* s, shm_opts_t* o);
+int shm_parse_topology(const char* s);
+int shm_parse_wait(const char* s);
+
+const char* shm_engine_name(const shm_opts_t* o);
+const char* shm_topology_name(int topology);
+const char* shm_wait_name(int wait_policy);
+
+// Check o against cfg and settle what follows from it (lanes, the byte
+// ring's size, eventfd's wait policy). NULL if the combination runs, else
+// the reason, formatted into buf.
+const char* shm_ring_check(shm_opts_t* o, const config_t* cfg, char* buf, size_t len);
+
+// Map and initialise the ring for a checked o. 0 on success, else the
+// ipc_shm_sem exit code for the step that failed (reported with perror).
+int shm_ring_create(shm_ring_t* r, const shm_opts_t* o, const config_t* cfg);
+
+// The producer and consumer roles; 0 on success, else a nonzero exit code.
+// st->lat has one histogram per lane.
+int shm_producer_run(shm_ring_t* r, uint32_t producer_id, const config_t* cfg, stats_block_t* sb);
+int shm_consumer_run(shm_ring_t* r, int consumer_id, const config_t* cfg, stats_t* st);
+
+// Once every producer is done: one sentinel per consumer on the shared ring
+// (spsc producers close their own rings). -1 on error.
+int shm_ring_finish(shm_ring_t* r);
+
+// The "wait(...)" slow-path line; nothing for the sem engine's shared ring,
+// which always blocks in sem_wait
+void shm_ring_report_waits(const shm_ring_t* r, FILE* out);
+
+void shm_ring_destroy(shm_ring_t* r);
+
+#endif
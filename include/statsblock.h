@@ -0,0 +1,128 @@
+#ifndef STATSBLOCK_H
+#define STATSBLOCK_H
+
+#include "latency.h"
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define SB_CACHE_LINE 64
+#define SB_EXIT_MISMATCH 10  // process exit code when verification fails
+
+// Shared statistics for one run, in MAP_SHARED memory created before fork so
+// every consumer (process or thread) and the parent see the same block.
+//
+//  - slots[c]: consumer c's counters, one cache line each. `received` is
+//    updated live; the rest is published when the consumer finishes.
+//  - prod[p]: producer p's backpressure counters (onfull.h), written only by
+//    that producer. A dropped message is also marked in the bitmap, so it is
+//    accounted for, not lost, and a dropped message that still arrives
+//    shows up as a duplicate.
+//  - bitmap (--verify): one bit per (producer, seq), set with an atomic
+//    fetch-or by whichever consumer takes the message, so a message delivered
+//    to two different consumers is caught, and unset bits at the end are losses.
+typedef struct {
+    uint64_t received;
+    uint64_t duplicates;
+    uint64_t out_of_range;
+    uint64_t malformed;
+    uint64_t late;
+    uint64_t done;
+} __attribute__((aligned(SB_CACHE_LINE))) sb_slot_t;
+
+typedef struct {
+    uint64_t dropped;
+    uint64_t full;             // sends that found the queue full
+    uint64_t blocked_ns;       // time spent waiting for room
+} __attribute__((aligned(SB_CACHE_LINE))) sb_prod_t;
+
+typedef struct stats_block {
+    uint32_t producers;
+    uint32_t consumers;
+    uint32_t messages_per_producer;
+    uint32_t pad;
+    sb_prod_t* prod;           // [producers], after slots[]
+    uint64_t* bitmap;          // NULL unless --verify
+    size_t bitmap_bytes;
+    size_t map_bytes;
+    uint64_t global_dups __attribute__((aligned(SB_CACHE_LINE)));
+    sb_slot_t slots[];
+} stats_block_t;
+
+// One consumer's own counters while it runs; sb_publish_stats() copies them
+// into its slot when it is done
+typedef struct {
+    uint64_t total_received;
+    uint64_t duplicates;
+    uint64_t out_of_range;
+    uint64_t malformed;
+    uint64_t late;       // arrived too far behind its producer's newest seq to check (seqtrack.h)
+    uint64_t stolen;     // ipc_shm_sem --consumer-mode steal: taken from other consumers' deques
+    uint64_t work_rng;   // ipc_shm_sem --work-ns draws (work.h)
+    lat_hist_t* lat;     // --latency: this consumer's histogram (one per priority lane), else NULL
+    stats_block_t* sb;   // run-wide shared stats, else NULL
+    sb_slot_t* slot;     // this consumer's slot in sb
+} stats_t;
+
+// NULL on failure (reported with perror)
+stats_block_t* sb_create(int producers, int consumers, uint32_t messages_per_producer, int verify);
+void sb_destroy(stats_block_t* sb);
+
+// Live received count for consumer slot
+static inline void sb_note_received(sb_slot_t* slot, uint64_t received) {
+    __atomic_store_n(&slot->received, received, __ATOMIC_RELAXED);
+}
+
+// --verify: mark (producer, seq); range-checked by the caller
+static inline void sb_mark(stats_block_t* sb, uint32_t producer, uint32_t seq) {
+    if (!sb->bitmap) return;
+    uint64_t bit = (uint64_t)producer * sb->messages_per_producer + seq;
+    uint64_t mask = 1ull << (bit & 63);
+    if (__atomic_fetch_or(&sb->bitmap[bit >> 6], mask, __ATOMIC_RELAXED) & mask) {
+        __atomic_fetch_add(&sb->global_dups, 1, __ATOMIC_RELAXED);
+    }
+}
+
+// --on-full: producer gave up on (producer, seq)
+static inline void sb_drop(stats_block_t* sb, uint32_t producer, uint32_t seq) {
+    sb->prod[producer].dropped++;
+    sb_mark(sb, producer, seq);
+}
+
+// A send found the queue full at full_ns and stopped waiting at now_ns
+static inline void sb_note_full(sb_prod_t* prod, uint64_t full_ns, uint64_t now_ns) {
+    prod->full++;
+    prod->blocked_ns += now_ns - full_ns;
+}
+
+// Publish a consumer's final counters into its slot
+void sb_publish(sb_slot_t* slot, uint64_t received, uint64_t duplicates, uint64_t out_of_range,
+                uint64_t malformed, uint64_t late);
+
+// sb_publish() of a consumer's stats_t
+void sb_publish_stats(const stats_t* st);
+
+// One "consumer[c]:" line with the consumer's counters (stolen only if any)
+void sb_print_consumer(FILE* out, int c, const stats_t* st);
+
+// Messages given up on under --on-full, across all producers
+uint64_t sb_dropped(const stats_block_t* sb);
+
+// Sum of the live received counters
+uint64_t sb_received(const stats_block_t* sb);
+
+// Merge every slot, check the totals (and the bitmap with --verify), and
+// print a "verify:" line plus the first few gaps. Returns 0 if the run
+// delivered every message that was not dropped exactly once, 1 otherwise.
+int sb_report(const stats_block_t* sb, FILE* out);
+
+// One "producer[p]:" line per producer: sent, dropped, full and blocked time
+void sb_report_producers(const stats_block_t* sb, FILE* out);
+
+// --sample-ms: a parent thread printing "sample:" lines with the received
+// count and rate every interval_ms. Start it after the last fork.
+typedef struct sb_sampler sb_sampler_t;
+sb_sampler_t* sb_sampler_start(const stats_block_t* sb, int interval_ms, FILE* out);
+void sb_sampler_stop(sb_sampler_t* s);
+
+#endif
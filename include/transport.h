@@ -0,0 +1,74 @@
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include "common.h"
+#include "statsblock.h"
+
+// Pluggable transport for ipc_bench. Each one wraps the engine module of its
+// standalone binary (pipes.h, shm_ring.h, mq_shard.h, uds_pair.h), so a bench
+// row measures the same code the binary runs. The driver forks producers and
+// consumers around one transport_t:
+//
+//   parent:    open() ... fork ... wait producers ... finish() ... wait consumers ... close()
+//   producer:  producer(), then _exit
+//   consumer:  consumer(), then _exit
+//
+// Every frame is msg_hdr_t + cfg->msg_size payload bytes.
+
+#define TRANSPORT_UNSUPPORTED 1 // open(): this configuration cannot run on the transport
+
+typedef struct transport transport_t;
+
+typedef struct {
+    const char* name;
+    const char* const* engines;    // NULL-terminated, the default first
+    const char* const* topologies; // NULL-terminated, the default first
+    // Parent, before fork. Sets t->engine, t->topology and t->batch to what
+    // will run. 0 on success, TRANSPORT_UNSUPPORTED with t->note set to the
+    // reason, or -1 on error (already reported).
+    int (*open)(transport_t* t);
+    // Child, after fork: drop whatever the role does not use and run it to
+    // the end. 0 on success, else a nonzero exit code.
+    int (*producer)(transport_t* t, int producer_id);
+    // The consumer's counters go to st (st->lat and st->sb set by the caller)
+    int (*consumer)(transport_t* t, int consumer_id, stats_t* st);
+    // Parent, once every producer has exited: make each consumer stop after
+    // the queued frames (close write ends, post sentinels). -1 on error.
+    int (*finish)(transport_t* t);
+    // Parent: release the transport
+    void (*close)(transport_t* t);
+} transport_ops_t;
+
+struct transport {
+    const transport_ops_t* ops;
+    const config_t* cfg;
+    stats_block_t* sb;
+    const char* engine;    // requested, NULL = the transport's default; then what runs
+    const char* topology;
+    uint32_t batch;        // what runs: cfg->batch, or less where the transport caps it
+    int queues;            // mq shards (the others run one queue)
+    int depth;             // queue depth hint: shm ring slots, mq maxmsg, pipes uring depth; 0 = default
+    const char* note;      // reason for TRANSPORT_UNSUPPORTED
+    char why[160];         // room for a formatted note
+    void* impl;            // transport-private state
+};
+
+extern const transport_ops_t transport_pipes;
+extern const transport_ops_t transport_shm;
+extern const transport_ops_t transport_mq;
+extern const transport_ops_t transport_uds;
+
+// Lookup by name ("pipes", "shm", "mq", "uds"); NULL if unknown.
+const transport_ops_t* transport_find(const char* name);
+
+// Comma-separated list of every registered transport name.
+const char* transport_names(void);
+
+// name is in one of ops' lists (engines or topologies)
+int transport_has(const char* const* list, const char* name);
+
+// open() helper: check the requested engine and topology against ops' lists,
+// filling in the defaults. 0, or TRANSPORT_UNSUPPORTED with t->note set.
+int transport_select(transport_t* t);
+
+#endif
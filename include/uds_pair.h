@@ -0,0 +1,27 @@
+#ifndef UDS_PAIR_H
+#define UDS_PAIR_H
+
+#include "common.h"
+#include "statsblock.h"
+
+// The ipc_uds transport (uds_pair.c): one AF_UNIX SOCK_SEQPACKET socketpair,
+// producers sharing sv[0] and consumers sharing sv[1]. ipc_uds and
+// ipc_bench's uds transport both drive it:
+//
+//   parent:    uds_pair_open() ... fork or spawn threads
+//   producer:  uds_producer_run(sv[0]) (forked: close sv[1] first)
+//   consumer:  uds_consumer_run(sv[1]) (forked: close sv[0] first, or EOF never arrives)
+//   parent:    close both ends; consumers read EOF once the last producer is gone
+
+#define UDS_MAX_BATCH 1024
+
+// Create the pair, sizing the buffers to sndbuf when > 0. The send buffer
+// in effect, which a frame has to fit in, or -1 on error (reported with perror).
+int uds_pair_open(int sv[2], int sndbuf);
+
+// The producer and consumer roles, moving up to cfg->batch frames per
+// sendmmsg/recvmmsg; 0 on success, else a nonzero exit code.
+int uds_producer_run(int fd, uint32_t producer_id, const config_t* cfg, stats_block_t* sb);
+int uds_consumer_run(int fd, const config_t* cfg, stats_t* st);
+
+#endif
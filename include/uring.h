@@ -0,0 +1,53 @@
+#ifndef URING_H
+#define URING_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <linux/io_uring.h>
+
+// Minimal io_uring wrapper on the raw syscalls (no liburing): one ring per
+// process, SQEs handed out in order, completions reaped from the CQ ring.
+typedef struct {
+    int fd;
+
+    // submission queue (shared with the kernel)
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+    struct io_uring_sqe* sqes;
+    unsigned sq_entries;
+    unsigned to_submit;      // SQEs queued since the last uring_submit
+
+    // completion queue
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    struct io_uring_cqe* cqes;
+
+    void* sq_ring;
+    size_t sq_ring_len;
+    void* cq_ring;           // == sq_ring with IORING_FEAT_SINGLE_MMAP
+    size_t cq_ring_len;
+    size_t sqes_len;
+
+    uint64_t enters;         // io_uring_enter calls, for reporting
+} uring_t;
+
+// Returns 0, or -1 with errno set (ENOSYS/EPERM when io_uring is unavailable)
+int uring_init(uring_t* r, unsigned entries);
+void uring_exit(uring_t* r);
+
+// Next free SQE, zeroed, or NULL when the SQ ring is full
+struct io_uring_sqe* uring_get_sqe(uring_t* r);
+void uring_prep_rw(struct io_uring_sqe* sqe, int op, int fd, void* buf, unsigned len, uint64_t user_data);
+
+// Submit everything queued and wait for at least wait_nr completions in one
+// io_uring_enter. Returns the number submitted, or -1.
+int uring_submit_and_wait(uring_t* r, unsigned wait_nr);
+
+// Next completion, or NULL if none is ready; uring_cqe_seen() releases it
+struct io_uring_cqe* uring_peek_cqe(uring_t* r);
+void uring_cqe_seen(uring_t* r);
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef UTIL_H
+#define UTIL_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include <time.h>
+
+// Non-negative decimal option value up to 1e9; -1 if s is empty, malformed
+// or out of range
+int parse_int(const char* s);
+
+// Seconds from a to b (CLOCK_MONOTONIC timestamps)
+double elapsed_sec(struct timespec a, struct timespec b);
+
+// Robust write: write exactly n bytes unless error
+ssize_t write_all(int fd, const void* buf, size_t n);
+
+// Robust read: read exactly n bytes unless EOF/error (0 = EOF)
+ssize_t read_all(int fd, void* buf, size_t n);
+
+// Single read that retries on EINTR; returns whatever the pipe had (0 = EOF)
+ssize_t read_some(int fd, void* buf, size_t n);
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef WORK_H
+#define WORK_H
+
+#include "common.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Simulated per-message processing time (--work-ns). Once a message is off
+// the ring (the caller has released its slot and any lock) the consumer
+// busy-waits for a time drawn from:
+//
+//   fixed:NS (or just NS)         always NS
+//   exp:MEAN_NS                   exponential with that mean
+//   bimodal:FAST_NS,SLOW_NS,P     SLOW_NS with probability P, else FAST_NS
+//
+// With work on, --latency is taken when the work is done, so it covers
+// queueing plus service time.
+typedef enum {
+    WORK_NONE = 0,
+    WORK_FIXED = 1,
+    WORK_EXP = 2,
+    WORK_BIMODAL = 3
+} work_dist_t;
+
+// Sets cfg->work and its parameters; -1 if s is not a valid spec
+int work_parse(const char* s, config_t* cfg);
+
+// "fixed:500", "exp:500" or "bimodal:200,5000,0.05", formatted into buf
+const char* work_name(const config_t* cfg, char* buf, size_t len);
+
+// Draw one service time; *rng is the caller's xorshift64 state (nonzero)
+uint64_t work_draw(const config_t* cfg, uint64_t* rng);
+
+// Busy-wait ns nanoseconds on CLOCK_MONOTONIC
+void work_spin(uint64_t ns);
+
+#endif
@@ -24,5 +24,7 @@ PER_PROD=$((TOTAL / P))
 run_one "pipes"   ./build/ipc_pipes   --producers $P --consumers $C --messages $PER_PROD --msg-size $S
 run_one "shm_sem" ./build/ipc_shm_sem --producers $P --consumers $C --messages $PER_PROD --msg-size $S --slots 64
 run_one "mq"      ./build/ipc_mq      --producers $P --consumers $C --messages $PER_PROD --msg-size $S --maxmsg 10
+run_one "uds"     ./build/ipc_uds     --producers $P --consumers $C --messages $PER_PROD --msg-size $S
+run_one "uds/32"  ./build/ipc_uds     --producers $P --consumers $C --messages $PER_PROD --msg-size $S --batch 32
 
 echo "Saved comparison output to $OUT"
\ No newline at end of file
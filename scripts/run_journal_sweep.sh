@@ -0,0 +1,67 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# ipc_journal group commit against one sync per record (--sync-each, row
+# "each"), in two passes:
+# - closed loop: producers write as fast as the log drains, so msgs/sec is
+#   what each commit policy sustains;
+# - fixed offered load: the log never backs up, so commit latency is the
+#   cost of waiting for a group, not queueing. Throughput is the offered
+#   rate there and is not reported.
+# --group N starts a sync once N records are pending (--group 1: as soon as
+# anything is); each sync takes everything written so far. WINDOW_US is
+# long so the size trigger decides.
+
+make -s
+
+OUT="docs/bench_journal.txt"
+: > "$OUT"
+
+PRODUCERS=${PRODUCERS:-4}
+CONSUMERS=${CONSUMERS:-2}
+SYNC=${SYNC:-msync}
+WINDOW_US=${WINDOW_US:-100000}
+LOOP_MESSAGES=${LOOP_MESSAGES:-10000}
+LOOP_LOG_RECORDS=${LOOP_LOG_RECORDS:-1024}
+MESSAGES=${MESSAGES:-2500}
+RATE=${RATE:-10000}
+SIZES="each 1 4 16 64 256 1024"
+
+group_args() {
+  if [ "$1" = each ]; then echo "--sync-each"; else echo "--group $1"; fi
+}
+
+# Columns from one run: msgs/sec syncs/sec mean_group commit_p50_us commit_p99_us
+summarize() {
+  awk '
+    /^timing:/ { rate = $6 }
+    /^commit:/ { for (i = 2; i <= NF; i++) { split($i, kv, "="); c[kv[1]] = kv[2] } }
+    /^commit_latency:/ { for (i = 2; i <= NF; i++) { split($i, kv, "="); l[kv[1]] = kv[2] } }
+    END {
+      sub(/us$/, "", l["p50"]); sub(/us$/, "", l["p99"])
+      print rate, c["syncs_per_sec"], c["mean_group"], l["p50"], l["p99"]
+    }'
+}
+
+echo "# closed loop: producers=$PRODUCERS consumers=$CONSUMERS messages=$LOOP_MESSAGES log_records=$LOOP_LOG_RECORDS sync=$SYNC window_us=$WINDOW_US" | tee -a "$OUT"
+printf "%-7s %12s %10s %11s %14s\n" "group" "msgs/sec" "syncs/sec" "mean_group" "commit_p99_us" | tee -a "$OUT"
+for group in $SIZES; do
+  # shellcheck disable=SC2046
+  ./build/ipc_journal --producers "$PRODUCERS" --consumers "$CONSUMERS" --messages "$LOOP_MESSAGES" \
+      --log-records "$LOOP_LOG_RECORDS" --sync "$SYNC" --window-us "$WINDOW_US" $(group_args "$group") --verify |
+    summarize | { read -r rate syncs mean p50 p99
+      printf "%-7s %12s %10s %11s %14s\n" "$group" "$rate" "$syncs" "$mean" "$p99"; } | tee -a "$OUT"
+done
+
+echo | tee -a "$OUT"
+echo "# fixed rate: producers=$PRODUCERS consumers=$CONSUMERS messages=$MESSAGES sync=$SYNC rate=$RATE window_us=$WINDOW_US" | tee -a "$OUT"
+printf "%-7s %10s %11s %14s %14s\n" "group" "syncs/sec" "mean_group" "commit_p50_us" "commit_p99_us" | tee -a "$OUT"
+for group in $SIZES; do
+  # shellcheck disable=SC2046
+  ./build/ipc_journal --producers "$PRODUCERS" --consumers "$CONSUMERS" --messages "$MESSAGES" \
+      --sync "$SYNC" --rate "$RATE" --window-us "$WINDOW_US" $(group_args "$group") --verify |
+    summarize | { read -r rate syncs mean p50 p99
+      printf "%-7s %10s %11s %14s %14s\n" "$group" "$syncs" "$mean" "$p50" "$p99"; } | tee -a "$OUT"
+done
+
+echo "Saved sweep output to $OUT"
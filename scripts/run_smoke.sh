@@ -10,3 +10,20 @@ echo
 echo "== Smoke test: 4 producers, 1 consumer (contention) =="
 ./build/ipc_pipes --producers 4 --consumers 1 --messages 5000 --msg-size 64
 
+
+echo
+echo "== Smoke test: batched writes, 8 frames each (4P/2C) =="
+./build/ipc_pipes --producers 4 --consumers 2 --messages 5000 --msg-size 64 --batch 8 --verify
+
+echo
+echo "== Smoke test: fan-in, one pipe per producer (4P/2C) =="
+./build/ipc_pipes --producers 4 --consumers 2 --messages 5000 --msg-size 64 --topology fanin --verify
+
+echo
+echo "== Smoke test: zero-copy fan-in to /dev/null (4P/2C) =="
+./build/ipc_pipes --producers 4 --consumers 2 --messages 2000 --msg-size 16384 --topology fanin \
+  --zerocopy --sink /dev/null --verify
+
+echo
+echo "== Smoke test: io_uring engine (4P/2C) =="
+./build/ipc_pipes --producers 4 --consumers 2 --messages 5000 --msg-size 64 --engine uring --batch 4 --verify
@@ -0,0 +1,20 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+make clean && make
+
+echo "== Bench Smoke: every transport, 1-2 producers, 16..256-byte frames =="
+./build/ipc_bench --transport all --producers 1,2 --msg-size 16..256 --messages 2000
+
+echo
+echo "== Bench Smoke: pipes engines and topologies =="
+./build/ipc_bench --transport pipes --engine sync,uring --topology shared,fanin --batch 1,8 --producers 2 --messages 2000
+
+echo
+echo "== Bench Smoke: shm engines and topologies =="
+./build/ipc_bench --transport shm --engine sem,lockfree,eventfd,bytes --topology shared,spsc --batch 1,8 \
+  --producers 2 --messages 2000
+
+echo
+echo "== Bench Smoke: sharded mq =="
+./build/ipc_bench --transport mq --queues 1,2 --producers 2 --messages 2000
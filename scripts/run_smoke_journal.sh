@@ -0,0 +1,21 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+make clean && make
+
+LOG="/var/tmp/cs4800_smoke_journal_$$.log"
+trap 'rm -f "$LOG"' EXIT
+
+echo "== Journal Smoke: group commit (4P/2C) =="
+./build/ipc_journal --producers 4 --consumers 2 --messages 5000 --msg-size 64 --log-records 256 --verify
+
+echo
+echo "== Journal Smoke: one sync per record (2P/2C) =="
+./build/ipc_journal --producers 2 --consumers 2 --messages 1000 --msg-size 64 --log-records 256 --sync-each --verify
+
+echo
+echo "== Journal Smoke: crash after 5000 durable records, then recover (4P/2C) =="
+./build/ipc_journal --producers 4 --consumers 2 --messages 5000 --msg-size 64 --log-records 256 \
+  --path "$LOG" --crash-after 5000
+./build/ipc_journal --producers 4 --consumers 2 --messages 5000 --msg-size 64 --log-records 256 \
+  --path "$LOG" --recover
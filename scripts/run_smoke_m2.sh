@@ -8,4 +8,11 @@ echo "== M2 Smoke: shared memory + semaphores (2P/2C) =="
 
 echo
 echo "== M2 Smoke: contention case (4P/1C) =="
-./build/ipc_shm_sem --producers 4 --consumers 1 --messages 5000 --msg-size 64 --slots 32
\ No newline at end of file
+./build/ipc_shm_sem --producers 4 --consumers 1 --messages 5000 --msg-size 64 --slots 32
+echo
+echo "== M2 Smoke: lock-free engine (4P/2C) =="
+./build/ipc_shm_sem --producers 4 --consumers 2 --messages 5000 --msg-size 64 --slots 32 --engine lockfree
+
+echo
+echo "== M2 Smoke: per-producer SPSC rings (8P/2C) =="
+./build/ipc_shm_sem --producers 8 --consumers 2 --messages 5000 --msg-size 64 --slots 32 --topology spsc
@@ -0,0 +1,31 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# Copy vs vmsplice/splice throughput across message sizes (fan-in pipes),
+# to find where --zerocopy starts to pay off.
+
+make -s
+
+OUT="docs/bench_zerocopy.txt"
+: > "$OUT"
+
+PRODUCERS=${PRODUCERS:-2}
+CONSUMERS=${CONSUMERS:-2}
+
+printf "%-10s %-9s %14s %10s\n" "msg_size" "mode" "msgs/sec" "MB/sec" | tee -a "$OUT"
+
+for size in 1024 4096 8192 16384 32768 65536 131072 262144; do
+  # keep each run at roughly 256 MB per producer
+  messages=$(( 268435456 / size ))
+  [ "$messages" -gt 200000 ] && messages=200000
+  for mode in copy zerocopy; do
+    flag=""
+    [ "$mode" = zerocopy ] && flag="--zerocopy"
+    rate=$(./build/ipc_pipes --producers "$PRODUCERS" --consumers "$CONSUMERS" --messages "$messages" \
+             --msg-size "$size" --topology fanin $flag | awk '/^timing:/{print $6}')
+    mbs=$(awk -v r="$rate" -v s="$size" 'BEGIN{printf "%.0f", r * s / 1048576}')
+    printf "%-10s %-9s %14s %10s\n" "$size" "$mode" "$rate" "$mbs" | tee -a "$OUT"
+  done
+done
+
+echo "Saved sweep output to $OUT"
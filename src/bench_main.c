@@ -0,0 +1,499 @@
+#include "common.h"
+#include "transport.h"
+#include "latency.h"
+#include "statsblock.h"
+#include "crc32c.h"
+#include "pacer.h"
+#include "util.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/wait.h>
+
+#define MAX_LIST 256
+#define MAX_TRANSPORTS 8
+#define MAX_CHECKSUMS 3
+#define MAX_NAMES 16
+
+typedef enum {
+    FORMAT_CSV = 0,
+    FORMAT_JSON = 1      // JSON Lines: one object per configuration
+} format_t;
+
+typedef struct {
+    const char* transport;
+    const char* engine;   // what ran (transport_t.engine), else what was asked for
+    const char* topology;
+    uint32_t batch;       // what ran, after the transport's cap
+    int queues;
+    const config_t* cfg;
+    const char* checksum; // none, crc32c/sse4.2 or crc32c/slice8
+    double offered;       // --rate/--load: total msgs/sec offered, 0 = closed loop
+    int rep;
+    const char* status;  // ok | mismatch | error | unsupported
+    char note[160];
+    double sec;
+    sb_slot_t sum;        // every consumer's published counters
+    lat_hist_t lat;       // filled only with --latency
+} row_t;
+
+static void usage(const char* prog) {
+    fprintf(stderr,
+        "Usage: %s [--transport LIST] [--engine LIST] [--topology LIST] [--batch LIST] [--queues LIST]\n"
+        "          [--producers LIST] [--consumers LIST] [--messages LIST] [--msg-size LIST] [--checksum LIST]\n"
+        "          [--rate LIST | --load LIST] [--arrival constant|poisson]\n"
+        "          [--depth N] [--repeat R] [--latency] [--format csv|json] [--out FILE] [--verbose]\n"
+        "LIST is comma-separated values or ranges: A..B doubles from A to B, A..B:S steps by S.\n"
+        "Checksums: none, crc32c, crc32c-sw\n"
+        "--rate is total msgs/sec; --load is percent of the closed-loop rate, measured first per configuration.\n"
+        "--depth is the shm ring's slots, mq's maxmsg and the pipes uring depth.\n"
+        "Transports (or all), engines and topologies (the first is the default; 'default' picks it):\n",
+        prog
+    );
+    const char* names = transport_names();
+    for (const char* p = names; *p; ) {
+        size_t n = strcspn(p, ",");
+        char name[32];
+        snprintf(name, sizeof(name), "%.*s", (int)n, p);
+        const transport_ops_t* ops = transport_find(name);
+        fprintf(stderr, "  %-6s engine", name);
+        for (int k = 0; ops->engines[k]; k++) fprintf(stderr, "%s%s", k ? "|" : " ", ops->engines[k]);
+        fprintf(stderr, ", topology");
+        for (int k = 0; ops->topologies[k]; k++) fprintf(stderr, "%s%s", k ? "|" : " ", ops->topologies[k]);
+        fprintf(stderr, "\n");
+        p += n + (p[n] == ',');
+    }
+    fprintf(stderr,
+        "A combination a transport cannot run is a row with status unsupported and the reason.\n"
+        "Example:\n"
+        "  %s --transport pipes,shm,mq --producers 1,2,4,8 --msg-size 16..4096 --format csv --out sweep.csv\n"
+        "  %s --transport shm --engine sem,lockfree --topology shared,spsc --batch 1,8\n"
+        "  %s --transport all --load 10..100:10 --arrival poisson --out load.csv\n",
+        prog, prog, prog
+    );
+}
+
+// Parse "1,2,4", "16..4096" (doubling) or "100..1000:100" into out[].
+// Returns the number of values, or -1 on a malformed or oversized list.
+static int parse_list(const char* spec, int* out, int max) {
+    char buf[1024];
+    if (strlen(spec) >= sizeof(buf)) return -1;
+    strcpy(buf, spec);
+
+    int n = 0;
+    char* save = NULL;
+    for (char* item = strtok_r(buf, ",", &save); item; item = strtok_r(NULL, ",", &save)) {
+        char* dots = strstr(item, "..");
+        if (!dots) {
+            int v = parse_int(item);
+            if (v <= 0 || n >= max) return -1;
+            out[n++] = v;
+            continue;
+        }
+
+        *dots = '\0';
+        char* hi_s = dots + 2;
+        char* step_s = strchr(hi_s, ':');
+        if (step_s) *step_s++ = '\0';
+        int lo = parse_int(item);
+        int hi = parse_int(hi_s);
+        int step = step_s ? parse_int(step_s) : 0; // 0 = doubling
+        if (lo <= 0 || hi < lo || (step_s && step <= 0)) return -1;
+
+        for (long v = lo; v <= hi; v = step ? v + step : v * 2) {
+            if (n >= max) return -1;
+            out[n++] = (int)v;
+        }
+    }
+    return n;
+}
+
+static int parse_checksums(const char* spec, int* out, int max) {
+    char buf[256];
+    if (strlen(spec) >= sizeof(buf)) return -1;
+    strcpy(buf, spec);
+
+    int n = 0;
+    char* save = NULL;
+    for (char* item = strtok_r(buf, ",", &save); item; item = strtok_r(NULL, ",", &save)) {
+        int mode = checksum_parse(item);
+        if (mode < 0) {
+            fprintf(stderr, "Error: unknown checksum '%s' (expected none, crc32c or crc32c-sw).\n", item);
+            return -1;
+        }
+        if (n >= max) return -1;
+        out[n++] = mode;
+    }
+    return n;
+}
+
+static int parse_transports(const char* spec, const transport_ops_t** out, int max) {
+    if (!strcmp(spec, "all")) spec = transport_names();
+
+    char buf[256];
+    if (strlen(spec) >= sizeof(buf)) return -1;
+    strcpy(buf, spec);
+
+    int n = 0;
+    char* save = NULL;
+    for (char* item = strtok_r(buf, ",", &save); item; item = strtok_r(NULL, ",", &save)) {
+        const transport_ops_t* ops = transport_find(item);
+        if (!ops) {
+            fprintf(stderr, "Error: unknown transport '%s' (expected %s).\n", item, transport_names());
+            return -1;
+        }
+        if (n >= max) return -1;
+        out[n++] = ops;
+    }
+    return n;
+}
+
+// Split a comma-separated list of engine or topology names (in place).
+// Each must be "default" or known to one of the chosen transports.
+static int parse_names(char* spec, const char** out, int max, const char* what,
+                       const transport_ops_t** transports, int ntransports) {
+    int n = 0;
+    char* save = NULL;
+    for (char* item = strtok_r(spec, ",", &save); item; item = strtok_r(NULL, ",", &save)) {
+        int known = !strcmp(item, "default");
+        for (int i = 0; i < ntransports && !known; i++) {
+            const transport_ops_t* ops = transports[i];
+            known = transport_has(!strcmp(what, "engine") ? ops->engines : ops->topologies, item);
+        }
+        if (!known) {
+            fprintf(stderr, "Error: no chosen transport has %s '%s' (see --help).\n", what, item);
+            return -1;
+        }
+        if (n >= max) return -1;
+        out[n++] = strcmp(item, "default") ? item : NULL;
+    }
+    return n;
+}
+
+static int reap(pid_t pid) {
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) return 1;
+    }
+    return (WIFEXITED(status) && WEXITSTATUS(status) == 0) ? 0 : 1;
+}
+
+// One configuration: fork C consumers and P producers around a fresh transport.
+static void run_one(const transport_ops_t* ops, const config_t* cfg, int depth, row_t* row) {
+    transport_t t = { .ops = ops, .cfg = cfg, .engine = row->engine, .topology = row->topology,
+                      .queues = row->queues, .depth = depth };
+    memset(&row->sum, 0, sizeof(row->sum));
+    lat_reset(&row->lat);
+    row->sec = 0.0;
+    row->note[0] = '\0';
+
+    int orc = ops->open(&t);
+    row->engine = t.engine;
+    row->topology = t.topology;
+    row->batch = t.batch;
+    if (orc != 0) {
+        row->status = (orc == TRANSPORT_UNSUPPORTED) ? "unsupported" : "error";
+        if (t.note) snprintf(row->note, sizeof(row->note), "%s", t.note);
+        if (t.impl) ops->close(&t);
+        return;
+    }
+
+    lat_hist_t* lats = cfg->latency ? lat_alloc_shared(cfg->consumers) : NULL;
+    stats_block_t* sb = sb_create(cfg->producers, cfg->consumers, cfg->messages_per_producer, 0);
+    pid_t* pids = (pid_t*)calloc((size_t)(cfg->consumers + cfg->producers), sizeof(pid_t));
+    if ((cfg->latency && !lats) || !sb || !pids) {
+        row->status = "error";
+        if (lats) lat_free_shared(lats, cfg->consumers);
+        if (sb) sb_destroy(sb);
+        free(pids);
+        ops->close(&t);
+        return;
+    }
+    t.sb = sb;
+
+    int failed = 0;
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    // pids[0..C) consumers, pids[C..C+P) producers
+    for (int c = 0; c < cfg->consumers; c++) {
+        pid_t pid = fork();
+        if (pid < 0) { perror("fork consumer"); failed = 1; break; }
+        if (pid == 0) {
+            stats_t st = { .lat = lats ? &lats[c] : NULL, .sb = sb, .slot = &sb->slots[c] };
+            int rc = ops->consumer(&t, c, &st);
+            sb_publish_stats(&st);
+            _exit(rc);
+        }
+        pids[c] = pid;
+    }
+
+    for (int p = 0; p < cfg->producers && !failed; p++) {
+        pid_t pid = fork();
+        if (pid < 0) { perror("fork producer"); failed = 1; break; }
+        if (pid == 0) _exit(ops->producer(&t, p));
+        pids[cfg->consumers + p] = pid;
+    }
+
+    // Producers first, then let the consumers drain and stop
+    for (int p = 0; p < cfg->producers; p++) {
+        if (pids[cfg->consumers + p] > 0 && reap(pids[cfg->consumers + p]) != 0) failed = 1;
+    }
+    if (ops->finish(&t) != 0) failed = 1;
+    for (int c = 0; c < cfg->consumers; c++) {
+        if (pids[c] > 0 && reap(pids[c]) != 0) failed = 1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    row->sec = elapsed_sec(t0, t1);
+
+    for (int c = 0; c < cfg->consumers; c++) {
+        const sb_slot_t* slot = &sb->slots[c];
+        row->sum.received += slot->received;
+        row->sum.duplicates += slot->duplicates;
+        row->sum.out_of_range += slot->out_of_range;
+        row->sum.malformed += slot->malformed;
+        row->sum.late += slot->late;
+        if (lats) lat_merge(&row->lat, &lats[c]);
+    }
+
+    uint64_t expected = (uint64_t)cfg->producers * cfg->messages_per_producer;
+    if (failed) row->status = "error";
+    else if (row->sum.received != expected || row->sum.duplicates || row->sum.out_of_range ||
+             row->sum.malformed) row->status = "mismatch";
+    else row->status = "ok";
+
+    if (lats) lat_free_shared(lats, cfg->consumers);
+    sb_destroy(sb);
+    free(pids);
+    ops->close(&t);
+}
+
+static void print_header(FILE* out, format_t fmt) {
+    if (fmt != FORMAT_CSV) return;
+    fprintf(out, "transport,engine,topology,batch,queues,producers,consumers,messages_per_producer,msg_size,checksum,offered_rate,arrival,rep,"
+                 "sec,msgs_per_sec,mb_per_sec,received,duplicates,out_of_range,malformed,late,"
+                 "lat_p50_ns,lat_p99_ns,lat_p999_ns,lat_max_ns,status,note\n");
+}
+
+static void print_row(FILE* out, format_t fmt, const row_t* r) {
+    const config_t* cfg = r->cfg;
+    double total = (double)cfg->producers * (double)cfg->messages_per_producer;
+    double msgs_per_sec = (r->sec > 0.0 && !strcmp(r->status, "ok")) ? total / r->sec : 0.0;
+    double mb_per_sec = msgs_per_sec * (double)(sizeof(msg_hdr_t) + cfg->msg_size) / 1e6;
+    const lat_hist_t* lat = &r->lat; // all zero without --latency
+    unsigned long long p50 = lat_percentile(lat, 0.50), p99 = lat_percentile(lat, 0.99);
+    unsigned long long p999 = lat_percentile(lat, 0.999), pmax = lat->max_ns;
+    const char* engine = r->engine ? r->engine : "default";
+    const char* topology = r->topology ? r->topology : "default";
+    const char* arrival = r->offered > 0.0 ? arrival_name((arrival_t)cfg->arrival) : "closed";
+
+    if (fmt == FORMAT_CSV) {
+        fprintf(out, "%s,%s,%s,%u,%d,%d,%d,%u,%u,%s,%.0f,%s,%d,%.6f,%.0f,%.2f,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%s,%s\n",
+                r->transport, engine, topology, r->batch, r->queues, cfg->producers, cfg->consumers, cfg->messages_per_producer, cfg->msg_size,
+                r->checksum, r->offered, arrival, r->rep, r->sec, msgs_per_sec, mb_per_sec,
+                (unsigned long long)r->sum.received,
+                (unsigned long long)r->sum.duplicates,
+                (unsigned long long)r->sum.out_of_range,
+                (unsigned long long)r->sum.malformed,
+                (unsigned long long)r->sum.late,
+                p50, p99, p999, pmax,
+                r->status, r->note);
+    } else {
+        fprintf(out, "{\"transport\":\"%s\",\"engine\":\"%s\",\"topology\":\"%s\",\"batch\":%u,\"queues\":%d,\"producers\":%d,\"consumers\":%d,\"messages_per_producer\":%u,"
+                     "\"msg_size\":%u,\"checksum\":\"%s\",\"offered_rate\":%.0f,\"arrival\":\"%s\",\"rep\":%d,\"sec\":%.6f,\"msgs_per_sec\":%.0f,\"mb_per_sec\":%.2f,"
+                     "\"received\":%llu,\"duplicates\":%llu,\"out_of_range\":%llu,\"malformed\":%llu,\"late\":%llu,"
+                     "\"lat_p50_ns\":%llu,\"lat_p99_ns\":%llu,\"lat_p999_ns\":%llu,\"lat_max_ns\":%llu,"
+                     "\"status\":\"%s\",\"note\":\"%s\"}\n",
+                r->transport, engine, topology, r->batch, r->queues, cfg->producers, cfg->consumers, cfg->messages_per_producer, cfg->msg_size,
+                r->checksum, r->offered, arrival, r->rep, r->sec, msgs_per_sec, mb_per_sec,
+                (unsigned long long)r->sum.received,
+                (unsigned long long)r->sum.duplicates,
+                (unsigned long long)r->sum.out_of_range,
+                (unsigned long long)r->sum.malformed,
+                (unsigned long long)r->sum.late,
+                p50, p99, p999, pmax,
+                r->status, r->note);
+    }
+    fflush(out); // rows of a long sweep are usable as they arrive
+}
+
+int main(int argc, char** argv) {
+    const transport_ops_t* transports[MAX_TRANSPORTS];
+    int ntransports = parse_transports(transport_names(), transports, MAX_TRANSPORTS);
+
+    int producers[MAX_LIST] = { DEFAULT_PRODUCERS };
+    int consumers[MAX_LIST] = { DEFAULT_CONSUMERS };
+    int messages[MAX_LIST] = { DEFAULT_MESSAGES_PER_PRODUCER };
+    int sizes[MAX_LIST] = { DEFAULT_MSG_SIZE };
+    int checksums[MAX_CHECKSUMS] = { CHECKSUM_NONE };
+    int rates[MAX_LIST] = { 0 };   // total msgs/sec, or percent with --load; 0 = closed loop
+    const char* engines[MAX_NAMES] = { NULL };    // NULL = each transport's default
+    const char* topologies[MAX_NAMES] = { NULL };
+    char* engine_spec = NULL;
+    char* topology_spec = NULL;
+    int batches[MAX_LIST] = { 1 };
+    int queues[MAX_LIST] = { 1 };
+    int np = 1, nc = 1, nm = 1, ns = 1, nk = 1, nr = 1, ne = 1, no = 1, nb = 1, nq = 1;
+    int load = 0;
+    int arrival = ARRIVAL_CONSTANT;
+    int depth = 0;
+    int repeat = 1;
+    format_t fmt = FORMAT_CSV;
+    const char* out_path = NULL;
+    int verbose = 0;
+    int latency = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--transport") && i + 1 < argc) {
+            ntransports = parse_transports(argv[++i], transports, MAX_TRANSPORTS);
+            if (ntransports <= 0) return 2;
+        }
+        else if (!strcmp(argv[i], "--engine") && i + 1 < argc) engine_spec = argv[++i];
+        else if (!strcmp(argv[i], "--topology") && i + 1 < argc) topology_spec = argv[++i];
+        else if (!strcmp(argv[i], "--batch") && i + 1 < argc) nb = parse_list(argv[++i], batches, MAX_LIST);
+        else if (!strcmp(argv[i], "--queues") && i + 1 < argc) nq = parse_list(argv[++i], queues, MAX_LIST);
+        else if (!strcmp(argv[i], "--producers") && i + 1 < argc) np = parse_list(argv[++i], producers, MAX_LIST);
+        else if (!strcmp(argv[i], "--consumers") && i + 1 < argc) nc = parse_list(argv[++i], consumers, MAX_LIST);
+        else if (!strcmp(argv[i], "--messages") && i + 1 < argc) nm = parse_list(argv[++i], messages, MAX_LIST);
+        else if (!strcmp(argv[i], "--msg-size") && i + 1 < argc) ns = parse_list(argv[++i], sizes, MAX_LIST);
+        else if (!strcmp(argv[i], "--checksum") && i + 1 < argc) {
+            nk = parse_checksums(argv[++i], checksums, MAX_CHECKSUMS);
+            if (nk <= 0) return 2;
+        }
+        else if ((!strcmp(argv[i], "--rate") || !strcmp(argv[i], "--load")) && i + 1 < argc) {
+            load = !strcmp(argv[i], "--load");
+            nr = parse_list(argv[++i], rates, MAX_LIST);
+        }
+        else if (!strcmp(argv[i], "--arrival") && i + 1 < argc) {
+            arrival = arrival_parse(argv[++i]);
+            if (arrival < 0) { fprintf(stderr, "Error: --arrival must be 'constant' or 'poisson'.\n"); return 2; }
+        }
+        else if (!strcmp(argv[i], "--depth") && i + 1 < argc) depth = parse_int(argv[++i]);
+        else if (!strcmp(argv[i], "--repeat") && i + 1 < argc) repeat = parse_int(argv[++i]);
+        else if (!strcmp(argv[i], "--format") && i + 1 < argc) {
+            const char* v = argv[++i];
+            if (!strcmp(v, "csv")) fmt = FORMAT_CSV;
+            else if (!strcmp(v, "json")) fmt = FORMAT_JSON;
+            else { fprintf(stderr, "Error: --format must be 'csv' or 'json'.\n"); return 2; }
+        }
+        else if (!strcmp(argv[i], "--out") && i + 1 < argc) out_path = argv[++i];
+        else if (!strcmp(argv[i], "--latency")) latency = 1;
+        else if (!strcmp(argv[i], "--verbose")) verbose = 1;
+        else if (!strcmp(argv[i], "--help") || !strcmp(argv[i], "-h")) { usage(argv[0]); return 0; }
+        else { usage(argv[0]); return 1; }
+    }
+
+    // Names are checked against the transports, which may come later on the line
+    if (engine_spec) {
+        ne = parse_names(engine_spec, engines, MAX_NAMES, "engine", transports, ntransports);
+        if (ne <= 0) return 2;
+    }
+    if (topology_spec) {
+        no = parse_names(topology_spec, topologies, MAX_NAMES, "topology", transports, ntransports);
+        if (no <= 0) return 2;
+    }
+    if (np <= 0 || nc <= 0 || nm <= 0 || ns <= 0 || nr <= 0 || nb <= 0 || nq <= 0) {
+        fprintf(stderr, "Error: invalid list (values must be > 0, at most %d per option).\n", MAX_LIST);
+        return 2;
+    }
+    if (depth < 0 || repeat <= 0) {
+        fprintf(stderr, "Error: --depth must be >= 0 and --repeat > 0.\n");
+        return 2;
+    }
+
+    FILE* out = stdout;
+    if (out_path) {
+        out = fopen(out_path, "w");
+        if (!out) {
+            perror("fopen --out");
+            return 3;
+        }
+    }
+
+    long total_runs = (long)ntransports * ne * no * nb * nq * np * nc * nm * ns * nk * (nr + load) * repeat;
+    long run = 0;
+    int any_bad = 0;
+    print_header(out, fmt);
+
+    // --load: the first pass (ri == -1) of each configuration runs closed-loop,
+    // and its mean rate over the repeats is what the percentages scale
+    double cap_sum = 0.0;
+    int cap_n = 0;
+    row_t cal = { 0 };
+
+    for (int ti = 0; ti < ntransports; ti++)
+    for (int ei = 0; ei < ne; ei++)
+    for (int oi = 0; oi < no; oi++)
+    for (int bi = 0; bi < nb; bi++)
+    for (int qi = 0; qi < nq; qi++)
+    for (int pi = 0; pi < np; pi++)
+    for (int ci = 0; ci < nc; ci++)
+    for (int mi = 0; mi < nm; mi++)
+    for (int si = 0; si < ns; si++)
+    for (int ki = 0; ki < nk; ki++)
+    for (int ri = load ? -1 : 0; ri < nr; ri++)
+    for (int rep = 0; rep < repeat; rep++) {
+        double capacity = cap_n ? cap_sum / cap_n : 0.0;
+        double offered = 0.0;
+        if (ri >= 0 && rates[ri] > 0) offered = load ? capacity * rates[ri] / 100.0 : (double)rates[ri];
+
+        config_t cfg = {
+            .producers = producers[pi],
+            .consumers = consumers[ci],
+            .messages_per_producer = (uint32_t)messages[mi],
+            .msg_size = (uint32_t)sizes[si],
+            .batch = (uint32_t)batches[bi],
+            .latency = latency || offered > 0.0,
+            .checksum = checksums[ki],
+            .rate = offered / producers[pi],
+            .arrival = arrival,
+            .verbose = verbose
+        };
+        const char* kernel = crc32c_setup((checksum_t)cfg.checksum);
+        char checksum[32];
+        snprintf(checksum, sizeof(checksum), cfg.checksum ? "crc32c/%s" : "%s", kernel);
+        row_t row = { .transport = transports[ti]->name, .engine = engines[ei], .topology = topologies[oi],
+                      .batch = cfg.batch, .queues = queues[qi], .cfg = &cfg, .checksum = checksum,
+                      .offered = offered, .rep = rep };
+
+        run++;
+        if (verbose) {
+            fprintf(stderr, "[%ld/%ld] %s engine=%s topology=%s batch=%u queues=%d producers=%d consumers=%d "
+                            "messages=%u msg_size=%u checksum=%s rate=%.0f rep=%d\n",
+                    run, total_runs, row.transport, row.engine ? row.engine : "default",
+                    row.topology ? row.topology : "default", cfg.batch, row.queues, cfg.producers, cfg.consumers,
+                    cfg.messages_per_producer, cfg.msg_size, row.checksum, offered, rep);
+        }
+
+        if (load && ri >= 0 && capacity <= 0.0) {
+            // nothing to scale: repeat why the closed-loop pass failed
+            row.status = cal.status;
+            snprintf(row.note, sizeof(row.note), "%s", cal.note[0] ? cal.note : "no closed-loop rate to scale");
+            row.engine = cal.engine;
+            row.topology = cal.topology;
+            row.batch = cal.batch;
+        } else {
+            run_one(transports[ti], &cfg, depth, &row);
+        }
+        print_row(out, fmt, &row);
+        if (!strcmp(row.status, "error") || !strcmp(row.status, "mismatch")) any_bad = 1;
+
+        if (ri == -1) {
+            if (rep == 0) { cap_sum = 0.0; cap_n = 0; }
+            if (!strcmp(row.status, "ok") && row.sec > 0.0) {
+                cap_sum += (double)cfg.producers * cfg.messages_per_producer / row.sec;
+                cap_n++;
+            }
+            cal = row;
+        }
+    }
+
+    if (out != stdout) fclose(out);
+    return any_bad ? 6 : 0;
+}
@@ -1,58 +1,299 @@
+#define _GNU_SOURCE // splice
 #include "common.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include "uring.h"
+#include "latency.h"
+#include "seqtrack.h"
+#include "statsblock.h"
+#include "crc32c.h"
+#include "pipes.h"
+#include "util.h"
 
-ssize_t read_all(int fd, void* buf, size_t n);
+// Bytes requested per read in batched mode (one default Linux pipe buffer)
+#define CONSUMER_CHUNK_BYTES 65536
 
+// now_ns is when the frame was dequeued (--latency), read once per read() by the caller
+static void consumer_check(const unsigned char* frame, const config_t* cfg,
+                           seqtrack_t* seen, stats_t* st, uint64_t now_ns) {
+    msg_hdr_t hdr;
+    memcpy(&hdr, frame, sizeof(hdr));
+
+    // A checksum mismatch is a corrupt frame: counted as malformed, not received
+    if (hdr.payload_len != cfg->msg_size ||
+        (cfg->checksum && hdr.crc32 != crc32c_frame(&hdr, frame + sizeof(msg_hdr_t)))) {
+        st->malformed++;
+        return;
+    }
+
+    st->total_received++;
+    if (st->lat) lat_record(st->lat, hdr.send_ns, now_ns);
+    if (st->slot) sb_note_received(st->slot, st->total_received);
+
+    if (hdr.producer_id >= (uint32_t)cfg->producers || hdr.seq >= cfg->messages_per_producer) {
+        st->out_of_range++;
+        return;
+    }
+    if (st->sb) sb_mark(st->sb, hdr.producer_id, hdr.seq);
+
+    seq_result_t seq_res = seqtrack_mark(seen, hdr.producer_id, hdr.seq);
+    if (seq_res == SEQ_DUP) st->duplicates++;
+    else if (seq_res == SEQ_LATE) st->late++;
+}
+
+// One read end plus the bytes of an incomplete frame carried between reads.
 typedef struct {
-    uint64_t total_received;
-    uint64_t duplicates;
-    uint64_t out_of_range;
-    uint64_t malformed;
-} stats_t;
+    int fd;
+    unsigned char* buf;  // chunk + msg_bytes
+    size_t have;
+    size_t payload_left; // zero-copy: payload bytes still to splice to the sink
+} frame_stream_t;
+
+// One read into the stream, then validate every whole frame it completes.
+// Returns the read() result: >0 data, 0 EOF, <0 error.
+static ssize_t stream_pump(frame_stream_t* fs, size_t chunk, const config_t* cfg,
+                           seqtrack_t* seen, stats_t* st) {
+    size_t msg_bytes = sizeof(msg_hdr_t) + cfg->msg_size;
+    ssize_t r = read_some(fs->fd, fs->buf + fs->have, chunk);
+    if (r <= 0) {
+        if (r == 0 && fs->have > 0) st->malformed++; // truncated frame at EOF
+        return r;
+    }
+
+    uint64_t now_ns = st->lat ? lat_now_ns() : 0;
+    size_t len = fs->have + (size_t)r;
+    size_t off = 0;
+    for (; off + msg_bytes <= len; off += msg_bytes) consumer_check(fs->buf + off, cfg, seen, st, now_ns);
+
+    fs->have = len - off;
+    if (fs->have > 0) memmove(fs->buf, fs->buf + off, fs->have);
+    return r;
+}
+
+// Zero-copy step: read just the header, then splice the payload from the pipe
+// to sink_fd without it passing through user memory. One read() or splice()
+// per call, so a single stream never starves the others in the epoll loop.
+static ssize_t stream_pump_splice(frame_stream_t* fs, int sink_fd, const config_t* cfg,
+                                  seqtrack_t* seen, stats_t* st) {
+    if (fs->payload_left > 0) {
+        ssize_t r = splice(fs->fd, NULL, sink_fd, NULL, fs->payload_left, SPLICE_F_MOVE);
+        if (r < 0 && errno == EINTR) return 1;
+        if (r == 0) st->malformed++; // EOF mid-payload
+        if (r > 0) fs->payload_left -= (size_t)r;
+        return r;
+    }
+
+    ssize_t r = read_some(fs->fd, fs->buf + fs->have, sizeof(msg_hdr_t) - fs->have);
+    if (r <= 0) {
+        if (r == 0 && fs->have > 0) st->malformed++;
+        return r;
+    }
+    fs->have += (size_t)r;
+    if (fs->have < sizeof(msg_hdr_t)) return r;
+
+    fs->have = 0;
+    consumer_check(fs->buf, cfg, seen, st, st->lat ? lat_now_ns() : 0);
+    msg_hdr_t hdr;
+    memcpy(&hdr, fs->buf, sizeof(hdr));
+    // a bad length can't be trusted to skip the payload, so assume the configured size
+    fs->payload_left = (hdr.payload_len == cfg->msg_size) ? hdr.payload_len : cfg->msg_size;
+    return r;
+}
+
+// Read size: as many whole frames as fit in CONSUMER_CHUNK_BYTES, at least one
+static size_t stream_chunk(const config_t* cfg) {
+    size_t msg_bytes = sizeof(msg_hdr_t) + cfg->msg_size;
+    size_t chunk = (CONSUMER_CHUNK_BYTES / msg_bytes) * msg_bytes;
+    return chunk ? chunk : msg_bytes;
+}
+
+// Batched path: read up to a pipe's worth at once and parse frames out of the
+// buffer. Reads are whole multiples of msg_bytes; since every write is too
+// (and atomic), the pipe always holds whole frames and concurrent consumers
+// never split one. A partial tail is still carried over, for safety.
+static int consumer_run_buffered(int in_fd, const config_t* cfg, seqtrack_t* seen, stats_t* st) {
+    size_t chunk = stream_chunk(cfg);
+    frame_stream_t fs = { in_fd, (unsigned char*)malloc(chunk + sizeof(msg_hdr_t) + cfg->msg_size), 0, 0 };
+    if (!fs.buf) return 2;
+
+    while (1) {
+        ssize_t r = stream_pump(&fs, chunk, cfg, seen, st);
+        if (r == 0) break; // EOF
+        if (r < 0) { perror("consumer read chunk"); break; }
+    }
+
+    free(fs.buf);
+    return 0;
+}
 
 int consumer_run(int in_fd, const config_t* cfg, stats_t* stats_out) {
-    stats_t st = {0};
+    stats_t st = { .lat = stats_out->lat, .sb = stats_out->sb, .slot = stats_out->slot };
 
-    size_t P = (size_t)cfg->producers;
-    size_t M = (size_t)cfg->messages_per_producer;
-    size_t seen_sz = P * M;
-    unsigned char* seen = (unsigned char*)calloc(seen_sz, 1);
+    seqtrack_t* seen = seqtrack_new((uint32_t)cfg->producers, cfg->messages_per_producer);
     if (!seen) return 1;
 
+    if (cfg->batch > 1) {
+        int rc = consumer_run_buffered(in_fd, cfg, seen, &st);
+        seqtrack_free(seen);
+        *stats_out = st;
+        return rc;
+    }
+
     size_t msg_bytes = sizeof(msg_hdr_t) + cfg->msg_size;
     unsigned char* msgbuf = (unsigned char*)malloc(msg_bytes);
-    if (!msgbuf) { free(seen); return 2; }
+    if (!msgbuf) { seqtrack_free(seen); return 2; }
 
     while (1) {
         ssize_t r = read_all(in_fd, msgbuf, msg_bytes);
         if (r == 0) break; // EOF
         if (r < 0) { perror("consumer read message"); break; }
 
-        msg_hdr_t hdr;
-        memcpy(&hdr, msgbuf, sizeof(hdr));
+        consumer_check(msgbuf, cfg, seen, &st, st.lat ? lat_now_ns() : 0);
+    }
+
+    free(msgbuf);
+    seqtrack_free(seen);
+    *stats_out = st;
+    return 0;
+}
 
-        if (hdr.payload_len != cfg->msg_size) {
-            st.malformed++;
-            continue;
-        }
 
-        st.total_received++;
+// Fan-in topology: this consumer is the only reader of each fd in in_fds (one
+// pipe per producer) and waits on all of them with epoll. With a single writer
+// and a single reader per pipe, frames may be any size and span many reads.
+// sink_fd >= 0 selects zero-copy: payloads are spliced there instead of read.
+int consumer_run_fanin(const int* in_fds, int nfds, int sink_fd, const config_t* cfg, stats_t* stats_out) {
+    stats_t st = { .lat = stats_out->lat, .sb = stats_out->sb, .slot = stats_out->slot };
+    *stats_out = st;
+    if (nfds == 0) return 0;
+
+    seqtrack_t* seen = seqtrack_new((uint32_t)cfg->producers, cfg->messages_per_producer);
+    frame_stream_t* streams = (frame_stream_t*)calloc((size_t)nfds, sizeof(*streams));
+    size_t chunk = stream_chunk(cfg);
+    int ep = epoll_create1(EPOLL_CLOEXEC);
+    int rc = 0;
+    if (!seen || !streams || ep < 0) { rc = 1; goto out; }
 
-        if (hdr.producer_id >= (uint32_t)cfg->producers || hdr.seq >= cfg->messages_per_producer) {
-            st.out_of_range++;
-            continue;
+    for (int i = 0; i < nfds; i++) {
+        streams[i].fd = in_fds[i];
+        streams[i].buf = (unsigned char*)malloc(chunk + sizeof(msg_hdr_t) + cfg->msg_size);
+        if (!streams[i].buf) { rc = 2; goto out; }
+
+        struct epoll_event ev = { .events = EPOLLIN, .data.u32 = (uint32_t)i };
+        if (epoll_ctl(ep, EPOLL_CTL_ADD, in_fds[i], &ev) < 0) {
+            perror("epoll_ctl");
+            rc = 3;
+            goto out;
         }
+    }
 
-        size_t idx = (size_t)hdr.producer_id * M + (size_t)hdr.seq;
-        if (seen[idx]) st.duplicates++;
-        else seen[idx] = 1;
+    int open_fds = nfds;
+    struct epoll_event events[64];
+    while (open_fds > 0) {
+        int n = epoll_wait(ep, events, 64, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait");
+            rc = 4;
+            break;
+        }
+        for (int k = 0; k < n; k++) {
+            frame_stream_t* fs = &streams[events[k].data.u32];
+            ssize_t r = (sink_fd >= 0) ? stream_pump_splice(fs, sink_fd, cfg, seen, &st)
+                                       : stream_pump(fs, chunk, cfg, seen, &st);
+            if (r > 0) continue;
+            if (r < 0) perror("consumer read pipe");
+            epoll_ctl(ep, EPOLL_CTL_DEL, fs->fd, NULL); // EOF: this producer is done
+            open_fds--;
+        }
     }
 
-    free(msgbuf);
-    free(seen);
+out:
+    if (ep >= 0) close(ep);
+    if (streams) {
+        for (int i = 0; i < nfds; i++) free(streams[i].buf);
+        free(streams);
+    }
+    seqtrack_free(seen);
     *stats_out = st;
-    return 0;
+    return rc;
 }
 
+// io_uring path: keep `depth` reads in flight on the shared pipe, each into its
+// own buffer from the pool, and re-arm a buffer as soon as it is parsed. Read
+// sizes are whole frames, so each completion holds whole frames regardless of
+// the order the reads finish in.
+int consumer_run_uring(int in_fd, const config_t* cfg, uint32_t depth, stats_t* stats_out) {
+    stats_t st = { .lat = stats_out->lat, .sb = stats_out->sb, .slot = stats_out->slot };
+    size_t msg_bytes = sizeof(msg_hdr_t) + cfg->msg_size;
+    size_t chunk = stream_chunk(cfg);
+
+    uring_t ring;
+    if (uring_init(&ring, depth) < 0) {
+        perror("consumer io_uring_setup");
+        *stats_out = st;
+        return 1;
+    }
+    seqtrack_t* seen = seqtrack_new((uint32_t)cfg->producers, cfg->messages_per_producer);
+    unsigned char* pool = (unsigned char*)malloc(chunk * depth);
+    int rc = 0;
+    if (!seen || !pool) { rc = 2; goto out; }
+
+    uint32_t inflight = 0;
+    for (uint32_t b = 0; b < depth; b++) {
+        struct io_uring_sqe* sqe = uring_get_sqe(&ring);
+        if (!sqe) break;
+        uring_prep_rw(sqe, IORING_OP_READ, in_fd, pool + b * chunk, (unsigned)chunk, b);
+        inflight++;
+    }
+
+    int eof = 0;
+    while (inflight > 0) {
+        if (uring_submit_and_wait(&ring, 1) < 0) {
+            perror("consumer io_uring_enter");
+            rc = 3;
+            break;
+        }
+        struct io_uring_cqe* cqe;
+        while ((cqe = uring_peek_cqe(&ring)) != NULL) {
+            uint32_t b = (uint32_t)cqe->user_data;
+            int res = cqe->res;
+            uring_cqe_seen(&ring);
+            inflight--;
+
+            if (res < 0) {
+                errno = -res;
+                perror("consumer uring read");
+                eof = 1;
+                rc = 3;
+                continue;
+            }
+            if (res == 0) { eof = 1; continue; } // all writers gone; let the rest drain
+
+            unsigned char* buf = pool + b * chunk;
+            uint64_t now_ns = st.lat ? lat_now_ns() : 0;
+            size_t off = 0;
+            for (; off + msg_bytes <= (size_t)res; off += msg_bytes) consumer_check(buf + off, cfg, seen, &st, now_ns);
+            if (off != (size_t)res) st.malformed++;
+
+            if (!eof) {
+                struct io_uring_sqe* sqe = uring_get_sqe(&ring);
+                if (!sqe) continue;
+                uring_prep_rw(sqe, IORING_OP_READ, in_fd, buf, (unsigned)chunk, b);
+                inflight++;
+            }
+        }
+    }
+
+out:
+    uring_exit(&ring);
+    free(pool);
+    seqtrack_free(seen);
+    *stats_out = st;
+    return rc;
+}
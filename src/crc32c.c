@@ -0,0 +1,189 @@
+#include "crc32c.h"
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#define CRC32C_HAVE_SSE42 1
+#endif
+
+#define CRC32C_POLY 0x82f63b78u  // reflected Castagnoli polynomial
+
+// sse4.2 kernel block sizes: three streams of LONG bytes each, then of
+// SHORT bytes (powers of two, for crc32c_zeros_op)
+#define CRC32C_LONG 8192
+#define CRC32C_SHORT 256
+
+static uint32_t slice_table[8][256];
+static uint32_t zeros_long[4][256];   // shift a CRC over CRC32C_LONG zero bytes
+static uint32_t zeros_short[4][256];  // ... over CRC32C_SHORT zero bytes
+
+static uint32_t (*kernel)(uint32_t crc, const unsigned char* p, size_t len);
+
+int checksum_parse(const char* s) {
+    if (!strcmp(s, "none")) return CHECKSUM_NONE;
+    if (!strcmp(s, "crc32c")) return CHECKSUM_CRC32C;
+    if (!strcmp(s, "crc32c-sw")) return CHECKSUM_CRC32C_SW;
+    return -1;
+}
+
+// ---- slicing-by-8 ----
+
+static void slice_init(void) {
+    for (uint32_t n = 0; n < 256; n++) {
+        uint32_t crc = n;
+        for (int k = 0; k < 8; k++) crc = (crc & 1) ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+        slice_table[0][n] = crc;
+    }
+    for (uint32_t n = 0; n < 256; n++) {
+        uint32_t crc = slice_table[0][n];
+        for (int k = 1; k < 8; k++) {
+            crc = slice_table[0][crc & 0xff] ^ (crc >> 8);
+            slice_table[k][n] = crc;
+        }
+    }
+}
+
+static uint32_t crc32c_slice8(uint32_t crc, const unsigned char* p, size_t len) {
+    crc = ~crc;
+    while (len && ((uintptr_t)p & 7)) {
+        crc = slice_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+        len--;
+    }
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    while (len >= 8) {
+        uint64_t w;
+        memcpy(&w, p, 8);
+        w ^= crc;
+        crc = slice_table[7][w & 0xff] ^
+              slice_table[6][(w >> 8) & 0xff] ^
+              slice_table[5][(w >> 16) & 0xff] ^
+              slice_table[4][(w >> 24) & 0xff] ^
+              slice_table[3][(w >> 32) & 0xff] ^
+              slice_table[2][(w >> 40) & 0xff] ^
+              slice_table[1][(w >> 48) & 0xff] ^
+              slice_table[0][w >> 56];
+        p += 8;
+        len -= 8;
+    }
+#endif
+    while (len--) crc = slice_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+// ---- CRC shift operators (GF(2) 32x32 matrices) ----
+
+static uint32_t gf2_times(const uint32_t* mat, uint32_t vec) {
+    uint32_t sum = 0;
+    for (; vec; vec >>= 1, mat++) {
+        if (vec & 1) sum ^= *mat;
+    }
+    return sum;
+}
+
+static void gf2_square(uint32_t* square, const uint32_t* mat) {
+    for (int n = 0; n < 32; n++) square[n] = gf2_times(mat, mat[n]);
+}
+
+// Operator that appends len zero bytes to a CRC; len must be a power of two
+static void crc32c_zeros_op(uint32_t* even, size_t len) {
+    uint32_t odd[32];
+    odd[0] = CRC32C_POLY; // one zero bit
+    for (int n = 1; n < 32; n++) odd[n] = 1u << (n - 1);
+
+    gf2_square(even, odd); // two zero bits
+    gf2_square(odd, even); // four zero bits
+
+    // Each square doubles the count, starting from one zero byte
+    for (;;) {
+        gf2_square(even, odd);
+        len >>= 1;
+        if (!len) return;
+        gf2_square(odd, even);
+        len >>= 1;
+        if (!len) break;
+    }
+    memcpy(even, odd, sizeof(odd));
+}
+
+// Byte-wise tables for the operator, so a shift is four lookups
+static void crc32c_zeros(uint32_t zeros[4][256], size_t len) {
+    uint32_t op[32];
+    crc32c_zeros_op(op, len);
+    for (uint32_t n = 0; n < 256; n++) {
+        for (int k = 0; k < 4; k++) zeros[k][n] = gf2_times(op, n << (8 * k));
+    }
+}
+
+static inline uint32_t crc32c_shift(uint32_t zeros[4][256], uint32_t crc) {
+    return zeros[0][crc & 0xff] ^ zeros[1][(crc >> 8) & 0xff] ^
+           zeros[2][(crc >> 16) & 0xff] ^ zeros[3][crc >> 24];
+}
+
+// ---- sse4.2 ----
+
+#ifdef CRC32C_HAVE_SSE42
+static inline uint64_t load64(const unsigned char* p) {
+    uint64_t w;
+    memcpy(&w, p, 8);
+    return w;
+}
+
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(uint32_t crc, const unsigned char* p, size_t len) {
+    uint64_t crc0 = ~crc;
+
+    while (len && ((uintptr_t)p & 7)) {
+        crc0 = _mm_crc32_u8((uint32_t)crc0, *p++);
+        len--;
+    }
+
+    // Three independent streams: a, b, c over consecutive blocks, then
+    // crc(a||b||c) = shift(shift(a) ^ b) ^ c
+    static const size_t blocks[2] = { CRC32C_LONG, CRC32C_SHORT };
+    for (int b = 0; b < 2; b++) {
+        size_t blk = blocks[b];
+        uint32_t (*zeros)[256] = b == 0 ? zeros_long : zeros_short;
+        while (len >= 3 * blk) {
+            uint64_t crc1 = 0, crc2 = 0;
+            const unsigned char* end = p + blk;
+            do {
+                crc0 = _mm_crc32_u64(crc0, load64(p));
+                crc1 = _mm_crc32_u64(crc1, load64(p + blk));
+                crc2 = _mm_crc32_u64(crc2, load64(p + 2 * blk));
+                p += 8;
+            } while (p < end);
+            crc0 = crc32c_shift(zeros, (uint32_t)crc0) ^ (uint32_t)crc1;
+            crc0 = crc32c_shift(zeros, (uint32_t)crc0) ^ (uint32_t)crc2;
+            p += 2 * blk;
+            len -= 3 * blk;
+        }
+    }
+
+    while (len >= 8) {
+        crc0 = _mm_crc32_u64(crc0, load64(p));
+        p += 8;
+        len -= 8;
+    }
+    while (len--) crc0 = _mm_crc32_u8((uint32_t)crc0, *p++);
+    return ~(uint32_t)crc0;
+}
+#endif
+
+const char* crc32c_setup(checksum_t mode) {
+    if (mode == CHECKSUM_NONE) return "none";
+    slice_init();
+    kernel = crc32c_slice8;
+#ifdef CRC32C_HAVE_SSE42
+    if (mode == CHECKSUM_CRC32C && __builtin_cpu_supports("sse4.2")) {
+        crc32c_zeros(zeros_long, CRC32C_LONG);
+        crc32c_zeros(zeros_short, CRC32C_SHORT);
+        kernel = crc32c_sse42;
+        return "sse4.2";
+    }
+#endif
+    return "slice8";
+}
+
+uint32_t crc32c(uint32_t crc, const void* buf, size_t len) {
+    return kernel(crc, (const unsigned char*)buf, len);
+}
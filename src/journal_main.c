@@ -0,0 +1,918 @@
+#define _GNU_SOURCE // posix_fallocate, syscall
+#include "common.h"
+#include "latency.h"
+#include "seqtrack.h"
+#include "statsblock.h"
+#include "crc32c.h"
+#include "pacer.h"
+#include "util.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <limits.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <pthread.h>
+
+#define SENTINEL_PRODUCER_ID 0xFFFFFFFFu
+#define CACHE_LINE 64
+#define PAGE_BYTES 4096u
+#define JOURNAL_MAGIC 0x4c4e524a38345343ull // "CS48JRNL"
+#define JOURNAL_VERSION 2u
+#define MAX_CONSUMERS 256
+#define MAX_JOURNAL_PAYLOAD (1u << 20)
+#define MAX_LOG_RECORDS (1u << 24)
+#define DEFAULT_LOG_RECORDS 4096
+#define DEFAULT_GROUP 64
+#define DEFAULT_WINDOW_US 1000
+#define MAX_WINDOW_US 1000000
+
+// How a commit makes the log durable (--sync)
+typedef enum {
+    SYNC_MSYNC = 0,      // msync(MS_SYNC) of the committed records and the control page
+    SYNC_FDATASYNC = 1,  // fdatasync() of the whole file
+    SYNC_NONE = 2        // no sync: the same handoff without durability, as a baseline
+} sync_mode_t;
+
+// Futex wait point in the mapped file. Wakers bump `seq` only when someone
+// is registered in `waiters`, so the fast path is one load.
+typedef struct {
+    uint32_t seq;
+    uint32_t waiters;
+} jwait_t;
+
+// Control block: the first page(s) of the log file, so the consumer cursors
+// reach disk with every commit. Positions count records from 0 and never
+// wrap; record pos lives in slot pos % capacity.
+typedef struct {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t rec_bytes;
+    uint64_t capacity;   // records in the ring
+    uint32_t consumers;
+    uint32_t msg_size;
+
+    uint64_t tail __attribute__((aligned(CACHE_LINE)));    // next position handed to a producer
+    uint64_t durable __attribute__((aligned(CACHE_LINE))); // every position below is on disk
+    uint32_t closing;    // sentinels are appended: commit the rest and stop
+    uint64_t reclaim __attribute__((aligned(CACHE_LINE))); // slots of positions below may be reused
+
+    jwait_t data_wq __attribute__((aligned(CACHE_LINE)));   // consumers waiting for `durable`
+    jwait_t space_wq __attribute__((aligned(CACHE_LINE)));  // producers waiting for a free slot
+    jwait_t commit_wq __attribute__((aligned(CACHE_LINE))); // committer waiting for a group
+
+    // Consumer c reads positions c, c + C, c + 2C, ...; cursor[c] is the next
+    // one it will read, so everything of its below that has been processed.
+    uint64_t cursor[MAX_CONSUMERS] __attribute__((aligned(CACHE_LINE)));
+} jctl_t;
+
+// Record: [jrec_hdr_t][msg_hdr_t][payload], padded to 8 bytes
+typedef struct {
+    uint64_t mark;       // position + 1 once the record is written (anything else: not yet)
+    uint64_t append_ns;  // when the producer finished writing it, for commit latency
+} jrec_hdr_t;
+
+typedef struct {
+    jctl_t* ctl;
+    unsigned char* data; // first record slot
+    size_t map_bytes;
+    size_t ctl_bytes;    // control block, rounded up to whole pages
+    uint64_t capacity;
+    uint32_t rec_bytes;
+    uint32_t consumers;
+    uint32_t group;      // --group: records that trigger a commit
+    uint64_t window_ns;  // --window-us: oldest pending record waits at most this long
+    int sync_each;       // --sync-each: one sync per record, the baseline for group commit
+    int sync;            // sync_mode_t
+    int fd;
+    uint64_t stop_at;    // --recover: consumers stop here rather than at a sentinel (UINT64_MAX: no limit)
+} journal_t;
+
+// What --recover found in the log it reopened
+typedef struct {
+    uint64_t start;      // oldest persisted cursor
+    uint64_t end;        // first position from start without an intact record
+    uint64_t found_tail;
+    uint64_t found_durable;
+    uint64_t dropped;    // intact records past that first hole, discarded
+    uint64_t expected;   // records the consumers should replay
+} recovery_t;
+
+// Committer-side counters, read by the parent after the committer exits
+typedef struct {
+    uint64_t groups;
+    uint64_t records;
+    uint64_t max_group;
+    uint64_t by_size;    // groups committed because `group` records were pending
+    uint64_t by_window;  // ... because the oldest had waited window_ns
+    uint64_t sync_errors;
+    uint64_t cursor_syncs; // control-page-only syncs that let waiting producers reuse slots
+    lat_hist_t commit;   // append -> durable, per record
+    lat_hist_t sync_time; // one sync call, per group
+} commit_stats_t;
+
+static void usage(const char* prog) {
+    fprintf(stderr,
+        "Usage: %s [--producers N] [--consumers N] [--messages M] [--msg-size BYTES]\n"
+        "          [--log-records N] [--group N | --sync-each] [--window-us US] [--sync msync|fdatasync|none]\n"
+        "          [--path FILE] [--keep] [--crash-after N] [--recover] [--latency]\n"
+        "          [--checksum none|crc32c|crc32c-sw] [--verify] [--sample-ms N]\n"
+        "          [--rate MSGS_PER_SEC | --rate-per-producer MSGS_PER_SEC] [--arrival constant|poisson]\n"
+        "          [--verbose]\n"
+        "Example:\n"
+        "  %s --producers 4 --consumers 2 --messages 20000 --msg-size 64 --group 64 --window-us 1000\n",
+        prog, prog
+    );
+}
+
+static const char* sync_name(sync_mode_t m) {
+    switch (m) {
+    case SYNC_FDATASYNC: return "fdatasync";
+    case SYNC_NONE: return "none";
+    default: return "msync";
+    }
+}
+
+static int parse_sync(const char* s) {
+    if (!strcmp(s, "msync")) return SYNC_MSYNC;
+    if (!strcmp(s, "fdatasync")) return SYNC_FDATASYNC;
+    if (!strcmp(s, "none")) return SYNC_NONE;
+    return -1;
+}
+
+static size_t round_up(size_t v, size_t align) {
+    return (v + align - 1) / align * align;
+}
+
+static jrec_hdr_t* journal_rec(const journal_t* j, uint64_t pos) {
+    return (jrec_hdr_t*)(j->data + (size_t)(pos % j->capacity) * j->rec_bytes);
+}
+
+static msg_hdr_t* rec_msg(jrec_hdr_t* rec) {
+    return (msg_hdr_t*)(rec + 1);
+}
+
+static int rec_written(const journal_t* j, uint64_t pos) {
+    return __atomic_load_n(&journal_rec(j, pos)->mark, __ATOMIC_ACQUIRE) == pos + 1;
+}
+
+// ---- waiting -----------------------------------------------------------
+
+typedef int (*jw_ready_fn)(journal_t* j, void* arg);
+
+static long futex_op(uint32_t* uaddr, int op, uint32_t val, const struct timespec* timeout) {
+    return syscall(SYS_futex, uaddr, op, val, timeout, NULL, 0);
+}
+
+// Sleep until ready() holds, a wake, or deadline_ns (0 = none) passes.
+// Callers loop on their own condition; early returns are harmless.
+static void jw_wait(jwait_t* w, jw_ready_fn ready, journal_t* j, void* arg, uint64_t deadline_ns) {
+    __atomic_add_fetch(&w->waiters, 1, __ATOMIC_SEQ_CST);
+    uint32_t seq = __atomic_load_n(&w->seq, __ATOMIC_SEQ_CST);
+    if (!ready(j, arg)) {
+        struct timespec left;
+        uint64_t now = deadline_ns ? lat_now_ns() : 0;
+        if (deadline_ns) {
+            uint64_t ns = deadline_ns > now ? deadline_ns - now : 0;
+            left.tv_sec = (time_t)(ns / 1000000000ull);
+            left.tv_nsec = (long)(ns % 1000000000ull);
+        }
+        if (!deadline_ns || now < deadline_ns) futex_op(&w->seq, FUTEX_WAIT, seq, deadline_ns ? &left : NULL);
+    }
+    __atomic_sub_fetch(&w->waiters, 1, __ATOMIC_SEQ_CST);
+}
+
+// Call after publishing the state change waiters are looking for
+static void jw_wake(jwait_t* w) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&w->waiters, __ATOMIC_SEQ_CST) == 0) return;
+    __atomic_add_fetch(&w->seq, 1, __ATOMIC_SEQ_CST);
+    futex_op(&w->seq, FUTEX_WAKE, INT_MAX, NULL);
+}
+
+// ---- producers -----------------------------------------------------------
+
+// Every position below the smallest live cursor has been read by its
+// consumer. The committer snapshots this before a sync and publishes it
+// as `reclaim` after, so slots are only reused once the cursors past them
+// are on disk; recovery never starts at an overwritten slot.
+static uint64_t journal_reclaimed(const journal_t* j) {
+    uint64_t min = UINT64_MAX;
+    for (uint32_t c = 0; c < j->consumers; c++) {
+        uint64_t v = __atomic_load_n(&j->ctl->cursor[c], __ATOMIC_ACQUIRE);
+        if (v < min) min = v;
+    }
+    return min;
+}
+
+static uint64_t journal_reusable(const journal_t* j) {
+    return __atomic_load_n(&j->ctl->reclaim, __ATOMIC_ACQUIRE);
+}
+
+static int has_space(journal_t* j, void* arg) {
+    return *(const uint64_t*)arg < journal_reusable(j) + j->capacity;
+}
+
+// Append one frame: claim the next position, wait (timed, as a full queue)
+// until its slot has been read on the previous lap and that read persisted,
+// write it, then publish the mark. *reclaimed caches journal_reusable() per
+// producer.
+static void journal_append(journal_t* j, const msg_hdr_t* hdr, const unsigned char* payload,
+                           uint64_t* reclaimed, sb_prod_t* prod) {
+    jctl_t* ctl = j->ctl;
+    uint64_t pos = __atomic_fetch_add(&ctl->tail, 1, __ATOMIC_RELAXED);
+    if (pos >= *reclaimed + j->capacity) {
+        *reclaimed = journal_reusable(j);
+        if (pos >= *reclaimed + j->capacity) {
+            uint64_t full_ns = lat_now_ns();
+            while (!has_space(j, &pos)) jw_wait(&ctl->space_wq, has_space, j, &pos, 0);
+            if (prod) sb_note_full(prod, full_ns, lat_now_ns());
+            *reclaimed = journal_reusable(j);
+        }
+    }
+
+    jrec_hdr_t* rec = journal_rec(j, pos);
+    memcpy(rec_msg(rec), hdr, sizeof(*hdr));
+    memcpy(rec_msg(rec) + 1, payload, hdr->payload_len);
+    rec->append_ns = lat_now_ns();
+    __atomic_store_n(&rec->mark, pos + 1, __ATOMIC_RELEASE);
+
+    // Nudge the committer once a group's worth is outstanding
+    uint64_t durable = __atomic_load_n(&ctl->durable, __ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&ctl->tail, __ATOMIC_RELAXED) - durable >= j->group) jw_wake(&ctl->commit_wq);
+}
+
+static int producer_run(journal_t* j, uint32_t producer_id, const config_t* cfg, stats_block_t* sb) {
+    unsigned char* payload = (unsigned char*)malloc(cfg->msg_size);
+    if (!payload) return 1;
+    memset(payload, 'A' + (producer_id % 26), cfg->msg_size);
+
+    msg_hdr_t hdr;
+    hdr.producer_id = producer_id;
+    hdr.payload_len = cfg->msg_size;
+    hdr.crc32 = 0;
+    hdr.send_ns = 0;
+
+    pacer_t pacer;
+    pacer_init(&pacer, cfg, producer_id);
+    uint64_t reclaimed = 0;
+
+    for (uint32_t i = 0; i < cfg->messages_per_producer; i++) {
+        hdr.seq = i;
+        if (pacer.active) pacer_take(&pacer, 1, &hdr.send_ns);
+        else if (cfg->latency) hdr.send_ns = lat_now_ns();
+        if (cfg->checksum) hdr.crc32 = crc32c_frame(&hdr, payload);
+        journal_append(j, &hdr, payload, &reclaimed, &sb->prod[producer_id]);
+    }
+    free(payload);
+    return 0;
+}
+
+// ---- committer -----------------------------------------------------------
+
+// Write back the control block holding the cursors
+static int journal_sync_ctl(journal_t* j) {
+    if (j->sync == SYNC_NONE) return 0;
+    if (j->sync == SYNC_FDATASYNC) return fdatasync(j->fd);
+    return msync(j->ctl, j->ctl_bytes, MS_SYNC);
+}
+
+// Write back [from, to) and, with it, the control block. `durable` is only
+// raised after the sync, so the copy on disk trails by one group; recovery
+// trusts the record marks, not that field. The order of the two writes does
+// not matter: no slot in [from, to) can be reused before the cursors past
+// its previous lap are on disk (`reclaim`).
+static int journal_sync(journal_t* j, uint64_t from, uint64_t to) {
+    if (j->sync != SYNC_MSYNC) return journal_sync_ctl(j);
+
+    if (msync(j->ctl, j->ctl_bytes, MS_SYNC) < 0) return -1;
+    if (to - from > j->capacity) from = to - j->capacity;
+    while (from < to) {
+        uint64_t slot = from % j->capacity;
+        uint64_t n = to - from;
+        if (n > j->capacity - slot) n = j->capacity - slot; // stop at the end of the ring
+        uintptr_t start = (uintptr_t)(j->data + slot * j->rec_bytes);
+        uintptr_t end = start + n * j->rec_bytes;
+        start &= ~(uintptr_t)(PAGE_BYTES - 1);
+        if (msync((void*)start, end - start, MS_SYNC) < 0) return -1;
+        from += n;
+    }
+    return 0;
+}
+
+typedef struct {
+    journal_t* j;
+    commit_stats_t* cs;
+    uint64_t frontier;   // every position below is written (committer-local)
+} committer_t;
+
+static void advance_frontier(committer_t* cm) {
+    uint64_t tail = __atomic_load_n(&cm->j->ctl->tail, __ATOMIC_ACQUIRE);
+    while (cm->frontier < tail && rec_written(cm->j, cm->frontier)) cm->frontier++;
+}
+
+// Producers wait for slots that consumers have read since the last sync
+static int reclaim_due(journal_t* j) {
+    return __atomic_load_n(&j->ctl->space_wq.waiters, __ATOMIC_ACQUIRE) &&
+           journal_reclaimed(j) > journal_reusable(j);
+}
+
+static int group_ready(journal_t* j, void* arg) {
+    committer_t* cm = (committer_t*)arg;
+    advance_frontier(cm);
+    return cm->frontier - j->ctl->durable >= j->group || __atomic_load_n(&j->ctl->closing, __ATOMIC_ACQUIRE) ||
+           reclaim_due(j);
+}
+
+static void publish_reclaim(journal_t* j, uint64_t reclaim) {
+    if (reclaim > journal_reusable(j)) __atomic_store_n(&j->ctl->reclaim, reclaim, __ATOMIC_RELEASE);
+    jw_wake(&j->ctl->space_wq);
+}
+
+// Group commit: once `group` written records are pending, or the oldest has
+// waited window_ns, sync everything written so far in one call, publish
+// `durable` and wake the consumers. --group and --window-us only decide when
+// a sync starts; whatever piles up during a sync joins the next group.
+// --sync-each instead syncs the oldest pending record alone, one at a time.
+// Each sync also persists the cursors, and only then lets producers reuse
+// the slots read before it. When producers wait on such slots and nothing
+// is pending, a control-page-only sync does that.
+static void* committer_main(void* arg) {
+    committer_t* cm = (committer_t*)arg;
+    journal_t* j = cm->j;
+    jctl_t* ctl = j->ctl;
+    commit_stats_t* cs = cm->cs;
+
+    for (;;) {
+        advance_frontier(cm);
+        uint64_t durable = ctl->durable;
+        uint64_t pending = cm->frontier - durable;
+        int closing = __atomic_load_n(&ctl->closing, __ATOMIC_ACQUIRE);
+        uint64_t now = lat_now_ns();
+        uint64_t due = pending ? journal_rec(j, durable)->append_ns + j->window_ns : now + j->window_ns;
+
+        if (pending && (pending >= j->group || now >= due || closing)) {
+            uint64_t n = j->sync_each ? 1 : pending;
+            uint64_t reclaim = journal_reclaimed(j);
+            uint64_t t0 = lat_now_ns();
+            if (journal_sync(j, durable, durable + n) < 0) {
+                perror("journal sync");
+                cs->sync_errors++;
+            }
+            uint64_t t1 = lat_now_ns();
+            lat_record(&cs->sync_time, t0, t1);
+            for (uint64_t pos = durable; pos < durable + n; pos++) {
+                lat_record(&cs->commit, journal_rec(j, pos)->append_ns, t1);
+            }
+            cs->groups++;
+            cs->records += n;
+            if (n > cs->max_group) cs->max_group = n;
+            if (n >= j->group) cs->by_size++;
+            else if (!closing) cs->by_window++;
+
+            __atomic_store_n(&ctl->durable, durable + n, __ATOMIC_RELEASE);
+            jw_wake(&ctl->data_wq);
+            publish_reclaim(j, reclaim);
+            continue;
+        }
+        if (reclaim_due(j)) {
+            uint64_t reclaim = journal_reclaimed(j);
+            if (journal_sync_ctl(j) < 0) {
+                perror("journal sync");
+                cs->sync_errors++;
+            }
+            cs->cursor_syncs++;
+            publish_reclaim(j, reclaim);
+            continue;
+        }
+        if (closing && durable == __atomic_load_n(&ctl->tail, __ATOMIC_ACQUIRE)) break;
+        jw_wait(&ctl->commit_wq, group_ready, j, cm, due);
+    }
+    return NULL;
+}
+
+// ---- consumers -----------------------------------------------------------
+
+static int is_durable(journal_t* j, void* arg) {
+    return __atomic_load_n(&j->ctl->durable, __ATOMIC_ACQUIRE) > *(const uint64_t*)arg;
+}
+
+// Reads its own positions c, c + C, ... in order as they become durable,
+// starting at its cursor (c on a fresh log), checking each record in place.
+// Advancing cursor[c] releases the slot to producers once the committer has
+// persisted it, with the next group or, for waiting producers, on its own.
+static int consumer_run(journal_t* j, int consumer_id, const config_t* cfg, stats_t* out) {
+    stats_t st = { .lat = out->lat, .sb = out->sb, .slot = out->slot };
+    seqtrack_t* seen = seqtrack_new((uint32_t)cfg->producers, cfg->messages_per_producer);
+    if (!seen) return 1;
+
+    jctl_t* ctl = j->ctl;
+    uint64_t pos = ctl->cursor[consumer_id];
+    for (;;) {
+        if (pos >= j->stop_at) break;
+        while (!is_durable(j, &pos)) jw_wait(&ctl->data_wq, is_durable, j, &pos, 0);
+
+        jrec_hdr_t* rec = journal_rec(j, pos);
+        const msg_hdr_t* hdr = rec_msg(rec);
+        const unsigned char* payload = (const unsigned char*)(hdr + 1);
+        int stop = 0;
+
+        if (rec->mark != pos + 1) {
+            st.malformed++;
+        } else if (hdr->producer_id == SENTINEL_PRODUCER_ID) {
+            stop = 1;
+        } else if (hdr->payload_len != cfg->msg_size ||
+                   (cfg->checksum && hdr->crc32 != crc32c_frame(hdr, payload))) {
+            // A checksum mismatch is a corrupt record: counted as malformed, not received
+            st.malformed++;
+        } else {
+            st.total_received++;
+            if (st.lat) lat_record(st.lat, hdr->send_ns, lat_now_ns());
+            if (st.slot) sb_note_received(st.slot, st.total_received);
+
+            if (hdr->producer_id >= (uint32_t)cfg->producers || hdr->seq >= cfg->messages_per_producer) {
+                st.out_of_range++;
+            } else {
+                if (st.sb) sb_mark(st.sb, hdr->producer_id, hdr->seq);
+                seq_result_t seq_res = seqtrack_mark(seen, hdr->producer_id, hdr->seq);
+                if (seq_res == SEQ_DUP) st.duplicates++;
+                else if (seq_res == SEQ_LATE) st.late++;
+            }
+        }
+
+        pos += j->consumers;
+        __atomic_store_n(&ctl->cursor[consumer_id], pos, __ATOMIC_RELEASE);
+        if (__atomic_load_n(&ctl->space_wq.waiters, __ATOMIC_ACQUIRE)) jw_wake(&ctl->commit_wq);
+        if (stop) break;
+    }
+
+    seqtrack_free(seen);
+    *out = st;
+    return 0;
+}
+
+// ---- setup ---------------------------------------------------------------
+
+// Create the log file at its full size, map it, zero-fill it and sync it
+// once, so a commit only ever writes back data pages and never allocates.
+static int journal_open(journal_t* j, const char* path, int exclusive, const config_t* cfg) {
+    j->ctl_bytes = round_up(sizeof(jctl_t), PAGE_BYTES);
+    j->map_bytes = j->ctl_bytes + round_up((size_t)j->capacity * j->rec_bytes, PAGE_BYTES);
+
+    j->fd = open(path, O_RDWR | O_CREAT | (exclusive ? O_EXCL : O_TRUNC), 0600);
+    if (j->fd < 0) {
+        perror("open journal");
+        return -1;
+    }
+    int err = posix_fallocate(j->fd, 0, (off_t)j->map_bytes);
+    if (err != 0) {
+        errno = err;
+        perror("posix_fallocate");
+        return -1;
+    }
+    void* base = mmap(NULL, j->map_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, j->fd, 0);
+    if (base == MAP_FAILED) {
+        perror("mmap journal");
+        return -1;
+    }
+    memset(base, 0, j->map_bytes);
+
+    j->ctl = (jctl_t*)base;
+    j->data = (unsigned char*)base + j->ctl_bytes;
+    j->ctl->magic = JOURNAL_MAGIC;
+    j->ctl->version = JOURNAL_VERSION;
+    j->ctl->rec_bytes = j->rec_bytes;
+    j->ctl->capacity = j->capacity;
+    j->ctl->consumers = j->consumers;
+    j->ctl->msg_size = cfg->msg_size;
+    for (uint32_t c = 0; c < j->consumers; c++) j->ctl->cursor[c] = c;
+
+    if (fsync(j->fd) < 0) {
+        perror("fsync journal");
+        return -1;
+    }
+    return 0;
+}
+
+// --recover: reopen a log an earlier run left behind. The control block has
+// to match this run's geometry. From the oldest persisted cursor on, every
+// record carrying its own position in `mark` is intact; the first one that
+// does not ends the log, and whatever was written past that hole is
+// dropped. The intact part is synced and made durable, and the consumers
+// resume from their cursors and stop at its end.
+static int journal_recover(journal_t* j, const char* path, const config_t* cfg, recovery_t* rv) {
+    j->ctl_bytes = round_up(sizeof(jctl_t), PAGE_BYTES);
+    j->map_bytes = j->ctl_bytes + round_up((size_t)j->capacity * j->rec_bytes, PAGE_BYTES);
+
+    j->fd = open(path, O_RDWR);
+    if (j->fd < 0) {
+        perror("open journal");
+        return -1;
+    }
+    jctl_t found;
+    struct stat sbuf;
+    if (fstat(j->fd, &sbuf) < 0) {
+        perror("fstat journal");
+        return -1;
+    }
+    if (pread(j->fd, &found, sizeof(found), 0) != (ssize_t)sizeof(found) ||
+        found.magic != JOURNAL_MAGIC || found.version != JOURNAL_VERSION) {
+        fprintf(stderr, "Error: %s is not a journal.\n", path);
+        return -1;
+    }
+    if (found.rec_bytes != j->rec_bytes || found.capacity != j->capacity ||
+        found.consumers != j->consumers || found.msg_size != cfg->msg_size ||
+        (size_t)sbuf.st_size != j->map_bytes) {
+        fprintf(stderr, "Error: %s was written with --log-records %llu --consumers %u --msg-size %u.\n",
+                path, (unsigned long long)found.capacity, found.consumers, found.msg_size);
+        return -1;
+    }
+    void* base = mmap(NULL, j->map_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, j->fd, 0);
+    if (base == MAP_FAILED) {
+        perror("mmap journal");
+        return -1;
+    }
+    j->ctl = (jctl_t*)base;
+    j->data = (unsigned char*)base + j->ctl_bytes;
+
+    jctl_t* ctl = j->ctl;
+    for (uint32_t c = 0; c < j->consumers; c++) {
+        if (ctl->cursor[c] % j->consumers != c) {
+            fprintf(stderr, "Error: %s: cursor[%u]=%llu is not one of its positions.\n",
+                    path, c, (unsigned long long)ctl->cursor[c]);
+            return -1;
+        }
+    }
+    memset(rv, 0, sizeof(*rv));
+    rv->found_tail = ctl->tail;
+    rv->found_durable = ctl->durable;
+    rv->start = journal_reclaimed(j);
+    rv->end = rv->start;
+    while (rv->end < rv->start + j->capacity && rec_written(j, rv->end)) rv->end++;
+    for (uint64_t pos = rv->end + 1; pos < rv->found_tail && pos < rv->start + j->capacity; pos++) {
+        if (rec_written(j, pos)) rv->dropped++;
+    }
+    // What each consumer has left: its positions up to the end, or up to a
+    // sentinel if the earlier run got as far as appending them
+    for (uint32_t c = 0; c < j->consumers; c++) {
+        for (uint64_t pos = ctl->cursor[c]; pos < rv->end; pos += j->consumers) {
+            if (rec_msg(journal_rec(j, pos))->producer_id == SENTINEL_PRODUCER_ID) break;
+            rv->expected++;
+        }
+    }
+
+    if (journal_sync(j, rv->start, rv->end) < 0) {
+        perror("journal sync");
+        return -1;
+    }
+    // Waiter counts and sequence numbers belonged to the processes that died
+    memset(&ctl->data_wq, 0, sizeof(ctl->data_wq));
+    memset(&ctl->space_wq, 0, sizeof(ctl->space_wq));
+    memset(&ctl->commit_wq, 0, sizeof(ctl->commit_wq));
+    ctl->tail = rv->end;
+    ctl->durable = rv->end;
+    ctl->reclaim = rv->start;
+    ctl->closing = 0;
+    j->stop_at = rv->end;
+    return 0;
+}
+
+// --crash-after: once n records are durable, SIGKILL every child and leave
+// without any cleanup, as a crashed run would. The log stays for --recover.
+static void crash_when_durable(journal_t* j, uint64_t n, const pid_t* pids, int npids, const char* path) {
+    while (__atomic_load_n(&j->ctl->durable, __ATOMIC_ACQUIRE) < n) usleep(100);
+    for (int i = 0; i < npids; i++) kill(pids[i], SIGKILL);
+    printf("crash: killed %d children at durable=%llu tail=%llu; resume with --recover --path %s\n",
+           npids, (unsigned long long)__atomic_load_n(&j->ctl->durable, __ATOMIC_ACQUIRE),
+           (unsigned long long)__atomic_load_n(&j->ctl->tail, __ATOMIC_ACQUIRE), path);
+    fflush(stdout);
+    _exit(0);
+}
+
+// --recover: every record left after the cursors was replayed exactly once
+// and intact. Returns 1 on a mismatch.
+static int recover_report(const stats_block_t* sb, const recovery_t* rv, FILE* out) {
+    uint64_t received = 0, dups = sb->global_dups, bad = 0;
+    for (uint32_t c = 0; c < sb->consumers; c++) {
+        received += sb->slots[c].received;
+        dups += sb->slots[c].duplicates;
+        bad += sb->slots[c].malformed + sb->slots[c].out_of_range;
+    }
+    int mismatch = received != rv->expected || dups || bad;
+    fprintf(out, "recover: from=%llu end=%llu found_tail=%llu found_durable=%llu dropped=%llu"
+                 " expected=%llu replayed=%llu dup=%llu bad=%llu status=%s\n",
+            (unsigned long long)rv->start, (unsigned long long)rv->end,
+            (unsigned long long)rv->found_tail, (unsigned long long)rv->found_durable,
+            (unsigned long long)rv->dropped, (unsigned long long)rv->expected,
+            (unsigned long long)received, (unsigned long long)dups, (unsigned long long)bad,
+            mismatch ? "mismatch" : "ok");
+    return mismatch;
+}
+
+int main(int argc, char** argv) {
+    config_t cfg = {
+        .producers = DEFAULT_PRODUCERS,
+        .consumers = DEFAULT_CONSUMERS,
+        .messages_per_producer = DEFAULT_MESSAGES_PER_PRODUCER,
+        .msg_size = DEFAULT_MSG_SIZE,
+        .verbose = 0
+    };
+    int log_records = DEFAULT_LOG_RECORDS;
+    int group = DEFAULT_GROUP;
+    int window_us = DEFAULT_WINDOW_US;
+    int sync_each = 0;
+    int sync_mode = SYNC_MSYNC;
+    const char* path = NULL;
+    int keep = 0;
+    int crash_after = 0;
+    int recover = 0;
+    int verify = 0;
+    int sample_ms = 0;
+    double rate = 0.0, rate_per_producer = 0.0;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--producers") && i + 1 < argc) cfg.producers = parse_int(argv[++i]);
+        else if (!strcmp(argv[i], "--consumers") && i + 1 < argc) cfg.consumers = parse_int(argv[++i]);
+        else if (!strcmp(argv[i], "--messages") && i + 1 < argc) cfg.messages_per_producer = (uint32_t)parse_int(argv[++i]);
+        else if (!strcmp(argv[i], "--msg-size") && i + 1 < argc) cfg.msg_size = (uint32_t)parse_int(argv[++i]);
+        else if (!strcmp(argv[i], "--log-records") && i + 1 < argc) log_records = parse_int(argv[++i]);
+        else if (!strcmp(argv[i], "--group") && i + 1 < argc) group = parse_int(argv[++i]);
+        else if (!strcmp(argv[i], "--sync-each")) sync_each = 1;
+        else if (!strcmp(argv[i], "--window-us") && i + 1 < argc) window_us = parse_int(argv[++i]);
+        else if (!strcmp(argv[i], "--sync") && i + 1 < argc) {
+            sync_mode = parse_sync(argv[++i]);
+            if (sync_mode < 0) {
+                fprintf(stderr, "Error: --sync must be 'msync', 'fdatasync' or 'none'.\n");
+                return 2;
+            }
+        }
+        else if (!strcmp(argv[i], "--path") && i + 1 < argc) path = argv[++i];
+        else if (!strcmp(argv[i], "--keep")) keep = 1;
+        else if (!strcmp(argv[i], "--crash-after") && i + 1 < argc) crash_after = parse_int(argv[++i]);
+        else if (!strcmp(argv[i], "--recover")) recover = 1;
+        else if (!strcmp(argv[i], "--latency")) cfg.latency = 1;
+        else if (!strcmp(argv[i], "--checksum") && i + 1 < argc) {
+            cfg.checksum = checksum_parse(argv[++i]);
+            if (cfg.checksum < 0) {
+                fprintf(stderr, "Error: --checksum must be 'none', 'crc32c' or 'crc32c-sw'.\n");
+                return 2;
+            }
+        }
+        else if (!strcmp(argv[i], "--rate") && i + 1 < argc) rate = rate_parse(argv[++i]);
+        else if (!strcmp(argv[i], "--rate-per-producer") && i + 1 < argc) rate_per_producer = rate_parse(argv[++i]);
+        else if (!strcmp(argv[i], "--arrival") && i + 1 < argc) {
+            cfg.arrival = arrival_parse(argv[++i]);
+            if (cfg.arrival < 0) {
+                fprintf(stderr, "Error: --arrival must be 'constant' or 'poisson'.\n");
+                return 2;
+            }
+        }
+        else if (!strcmp(argv[i], "--verify")) verify = 1;
+        else if (!strcmp(argv[i], "--sample-ms") && i + 1 < argc) sample_ms = parse_int(argv[++i]);
+        else if (!strcmp(argv[i], "--verbose")) cfg.verbose = 1;
+        else if (!strcmp(argv[i], "--help") || !strcmp(argv[i], "-h")) { usage(argv[0]); return 0; }
+        else { usage(argv[0]); return 1; }
+    }
+
+    if (cfg.producers <= 0 || cfg.consumers <= 0 || cfg.messages_per_producer == 0 || cfg.msg_size == 0 ||
+        sample_ms < 0 || rate < 0.0 || rate_per_producer < 0.0) {
+        fprintf(stderr, "Error: invalid parameters.\n");
+        return 2;
+    }
+    if (pacer_configure(&cfg, rate, rate_per_producer) < 0) return 2;
+    if (cfg.consumers > MAX_CONSUMERS) {
+        fprintf(stderr, "Error: --consumers must be <= %d.\n", MAX_CONSUMERS);
+        return 2;
+    }
+    if (cfg.msg_size > MAX_JOURNAL_PAYLOAD) {
+        fprintf(stderr, "Error: --msg-size must be <= %u.\n", MAX_JOURNAL_PAYLOAD);
+        return 2;
+    }
+    if (log_records <= 0 || log_records > (int)MAX_LOG_RECORDS) {
+        fprintf(stderr, "Error: --log-records must be between 1 and %u.\n", MAX_LOG_RECORDS);
+        return 2;
+    }
+    if (group <= 0) {
+        fprintf(stderr, "Error: --group must be > 0.\n");
+        return 2;
+    }
+    if (sync_each && group != DEFAULT_GROUP) {
+        fprintf(stderr, "Error: --sync-each and --group do not go together.\n");
+        return 2;
+    }
+    if (window_us <= 0 || window_us > MAX_WINDOW_US) {
+        fprintf(stderr, "Error: --window-us must be between 1 and %d.\n", MAX_WINDOW_US);
+        return 2;
+    }
+    if (crash_after < 0 || (uint64_t)crash_after >= (uint64_t)cfg.producers * cfg.messages_per_producer) {
+        fprintf(stderr, "Error: --crash-after must be below producers * messages.\n");
+        return 2;
+    }
+    if ((crash_after || recover) && !path) {
+        fprintf(stderr, "Error: --crash-after and --recover need --path FILE.\n");
+        return 2;
+    }
+    if (crash_after && recover) {
+        fprintf(stderr, "Error: --crash-after and --recover do not go together.\n");
+        return 2;
+    }
+    if (recover && verify) {
+        fprintf(stderr, "Error: --recover checks the replay itself; drop --verify.\n");
+        return 2;
+    }
+
+    journal_t j;
+    memset(&j, 0, sizeof(j));
+    j.capacity = (uint64_t)log_records;
+    j.rec_bytes = (uint32_t)round_up(sizeof(jrec_hdr_t) + sizeof(msg_hdr_t) + cfg.msg_size, 8);
+    j.consumers = (uint32_t)cfg.consumers;
+    j.group = sync_each ? 1u : (uint32_t)group;
+    j.sync_each = sync_each;
+    j.window_ns = (uint64_t)window_us * 1000ull;
+    j.sync = sync_mode;
+    j.fd = -1;
+    j.stop_at = UINT64_MAX;
+
+    // Default: a fresh file in /var/tmp, which (unlike /tmp) is usually on disk
+    char default_path[128];
+    if (!path) {
+        snprintf(default_path, sizeof(default_path), "/var/tmp/cs4800_journal_%ld.log", (long)getpid());
+        path = default_path;
+    }
+    recovery_t rv;
+    if (recover) {
+        if (journal_recover(&j, path, &cfg, &rv) < 0) return 3;
+    } else if (journal_open(&j, path, path == default_path, &cfg) < 0) {
+        if (j.fd >= 0) {
+            close(j.fd);
+            unlink(path);
+        }
+        return 3;
+    }
+
+    if (cfg.verbose) {
+        fprintf(stderr, "journal=%s rec_bytes=%u capacity=%llu map_bytes=%zu\n",
+                path, j.rec_bytes, (unsigned long long)j.capacity, j.map_bytes);
+    }
+
+    const char* crc_kernel = crc32c_setup((checksum_t)cfg.checksum);
+
+    lat_hist_t* lats = NULL;
+    if (cfg.latency && !(lats = lat_alloc_shared(cfg.consumers))) {
+        perror("mmap latency histograms");
+        return 3;
+    }
+    // --recover keeps the bitmap for its own duplicate check
+    stats_block_t* sb = sb_create(cfg.producers, cfg.consumers, cfg.messages_per_producer, verify || recover);
+    if (!sb) return 3;
+    // --recover only drains what the earlier run left: no producers
+    int producers = recover ? 0 : cfg.producers;
+    pid_t* pids = (pid_t*)calloc((size_t)(cfg.consumers + producers), sizeof(pid_t));
+    if (!pids) return 3;
+    int npids = 0;
+    commit_stats_t* cs = (commit_stats_t*)calloc(1, sizeof(*cs));
+    if (!cs) return 3;
+    lat_reset(&cs->commit);
+    lat_reset(&cs->sync_time);
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    int status = 0;
+    int child_error = 0;
+
+    // Fork consumers first
+    for (int c = 0; c < cfg.consumers; c++) {
+        pid_t pid = fork();
+        if (pid < 0) { perror("fork consumer"); return 4; }
+        pids[npids++] = pid;
+        if (pid == 0) {
+            close(j.fd);
+            stats_t st = { .lat = lats ? &lats[c] : NULL, .sb = sb, .slot = &sb->slots[c] };
+            int rc = consumer_run(&j, c, &cfg, &st);
+            sb_publish_stats(&st);
+            sb_print_consumer(stdout, c, &st);
+            fflush(stdout); // _exit() skips stdio flushing when stdout is a pipe
+            _exit(rc);
+        }
+    }
+
+    // Fork producers
+    for (int p = 0; p < producers; p++) {
+        pid_t pid = fork();
+        if (pid < 0) { perror("fork producer"); return 5; }
+        pids[npids++] = pid;
+        if (pid == 0) {
+            close(j.fd);
+            int rc = producer_run(&j, (uint32_t)p, &cfg, sb);
+            _exit(rc);
+        }
+    }
+
+    // The parent commits. Both threads start after the last fork so no child
+    // inherits a held lock.
+    committer_t cm = { &j, cs, j.ctl->durable };
+    pthread_t committer;
+    if (pthread_create(&committer, NULL, committer_main, &cm) != 0) {
+        perror("pthread_create committer");
+        return 6;
+    }
+    sb_sampler_t* sampler = sample_ms ? sb_sampler_start(sb, sample_ms, stdout) : NULL;
+    if (crash_after) crash_when_durable(&j, (uint64_t)crash_after, pids, npids, path);
+
+    // Consumers only exit on a sentinel, so the first P exits are the producers
+    for (int i = 0; i < producers; i++) {
+        pid_t w = wait(&status);
+        if (w < 0) {
+            if (errno == EINTR) { i--; continue; }
+            perror("wait");
+            child_error = 1;
+            break;
+        }
+        if ((WIFEXITED(status) && WEXITSTATUS(status) != 0) || WIFSIGNALED(status)) child_error = 1;
+    }
+
+    // One sentinel per consumer. C consecutive positions cover every
+    // consumer's stride once, so each reads exactly one. Recovering
+    // consumers stop at stop_at instead.
+    if (!recover) {
+        unsigned char* zero = (unsigned char*)calloc(1, cfg.msg_size);
+        msg_hdr_t shdr = { SENTINEL_PRODUCER_ID, 0, cfg.msg_size, 0, 0 };
+        uint64_t reclaimed = 0;
+        for (int c = 0; c < cfg.consumers && zero; c++) journal_append(&j, &shdr, zero, &reclaimed, NULL);
+        if (!zero) child_error = 1;
+        free(zero);
+    }
+    __atomic_store_n(&j.ctl->closing, 1, __ATOMIC_RELEASE);
+    jw_wake(&j.ctl->commit_wq);
+
+    pthread_join(committer, NULL);
+    while (1) {
+        pid_t w = wait(&status);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if ((WIFEXITED(status) && WEXITSTATUS(status) != 0) || WIFSIGNALED(status)) child_error = 1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    sb_sampler_stop(sampler);
+    double sec = elapsed_sec(t0, t1);
+
+    unsigned long long total_msgs = recover ? rv.expected
+        : (unsigned long long)cfg.producers * (unsigned long long)cfg.messages_per_producer;
+    double msgs_per_sec = (sec > 0.0) ? ((double)total_msgs / sec) : 0.0;
+
+    if (!recover) sb_report_producers(sb, stdout);
+
+    printf("run(journal): producers=%d consumers=%d messages_per_producer=%u msg_size=%u log_records=%d"
+           " sync=%s group=%d window_us=%d",
+           cfg.producers, cfg.consumers, cfg.messages_per_producer, cfg.msg_size, log_records,
+           sync_name((sync_mode_t)sync_mode), group, window_us);
+    if (cfg.checksum) printf(" checksum=crc32c/%s", crc_kernel);
+    if (cfg.rate > 0.0) printf(" rate=%.0f arrival=%s", cfg.rate * cfg.producers, arrival_name((arrival_t)cfg.arrival));
+    if (sync_each) printf(" sync_each=1");
+    if (recover) printf(" recover=1");
+    printf("\n");
+    printf("timing: %.3f sec | approx %.0f msgs/sec\n", sec, msgs_per_sec);
+    if (!recover) {
+        printf("commit: groups=%llu mean_group=%.1f max_group=%llu by_size=%llu by_window=%llu cursor_syncs=%llu"
+               " syncs_per_sec=%.0f\n",
+               (unsigned long long)cs->groups,
+               cs->groups ? (double)cs->records / (double)cs->groups : 0.0,
+               (unsigned long long)cs->max_group,
+               (unsigned long long)cs->by_size, (unsigned long long)cs->by_window,
+               (unsigned long long)cs->cursor_syncs,
+               sec > 0.0 ? (double)(cs->groups + cs->cursor_syncs) / sec : 0.0);
+        lat_print_as(stdout, "commit_latency", &cs->commit);
+        lat_print_as(stdout, "sync_time", &cs->sync_time);
+    }
+    if (lats) {
+        lat_report(stdout, lats, cfg.consumers);
+        lat_free_shared(lats, cfg.consumers);
+    }
+    int mismatch = recover ? recover_report(sb, &rv, stdout) : sb_report(sb, stdout);
+    sb_destroy(sb);
+    free(pids);
+    if (cs->sync_errors) child_error = 1;
+    free(cs);
+
+    munmap(j.ctl, j.map_bytes);
+    close(j.fd);
+    if (keep) printf("journal: kept %s\n", path);
+    else unlink(path);
+
+    if (child_error) return 7;
+    return mismatch ? SB_EXIT_MISMATCH : 0;
+}
@@ -0,0 +1,86 @@
+#include "latency.h"
+#include <string.h>
+#include <sys/mman.h>
+
+lat_hist_t* lat_alloc_shared(int n) {
+    void* p = mmap(NULL, sizeof(lat_hist_t) * (size_t)n, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    return (p == MAP_FAILED) ? NULL : (lat_hist_t*)p; // anonymous pages start zeroed
+}
+
+void lat_free_shared(lat_hist_t* hs, int n) {
+    if (hs) munmap(hs, sizeof(lat_hist_t) * (size_t)n);
+}
+
+void lat_reset(lat_hist_t* h) {
+    memset(h, 0, sizeof(*h));
+}
+
+void lat_merge(lat_hist_t* dst, const lat_hist_t* src) {
+    if (src->count == 0) return;
+    if (dst->count == 0 || src->min_ns < dst->min_ns) dst->min_ns = src->min_ns;
+    if (src->max_ns > dst->max_ns) dst->max_ns = src->max_ns;
+    dst->count += src->count;
+    dst->sum_ns += src->sum_ns;
+    for (uint32_t i = 0; i < LAT_BUCKETS; i++) dst->buckets[i] += src->buckets[i];
+}
+
+static uint64_t bucket_upper(uint32_t idx) {
+    uint32_t group = idx / LAT_SUB;
+    uint32_t sub = idx % LAT_SUB;
+    if (group == 0) return sub;
+    uint64_t lower = (uint64_t)(LAT_SUB + sub) << (group - 1);
+    return lower + ((1ull << (group - 1)) - 1);
+}
+
+uint64_t lat_percentile(const lat_hist_t* h, double q) {
+    if (h->count == 0) return 0;
+    uint64_t rank = (uint64_t)(q * (double)h->count + 0.5);
+    if (rank < 1) rank = 1;
+    if (rank > h->count) rank = h->count;
+
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < LAT_BUCKETS; i++) {
+        seen += h->buckets[i];
+        if (seen >= rank) {
+            uint64_t v = bucket_upper(i);
+            return (v > h->max_ns) ? h->max_ns : v;
+        }
+    }
+    return h->max_ns;
+}
+
+void lat_print_as(FILE* out, const char* label, const lat_hist_t* h) {
+    double mean = h->count ? (double)h->sum_ns / (double)h->count : 0.0;
+    fprintf(out, "%s: samples=%llu min=%.2fus p50=%.2fus p90=%.2fus p99=%.2fus p99.9=%.2fus max=%.2fus mean=%.2fus\n",
+            label, (unsigned long long)h->count,
+            (double)h->min_ns / 1e3,
+            (double)lat_percentile(h, 0.50) / 1e3,
+            (double)lat_percentile(h, 0.90) / 1e3,
+            (double)lat_percentile(h, 0.99) / 1e3,
+            (double)lat_percentile(h, 0.999) / 1e3,
+            (double)h->max_ns / 1e3,
+            mean / 1e3);
+}
+
+void lat_print(FILE* out, const lat_hist_t* h) {
+    lat_print_as(out, "latency", h);
+}
+
+void lat_report(FILE* out, const lat_hist_t* hs, int n) {
+    lat_hist_t all;
+    lat_reset(&all);
+    for (int i = 0; i < n; i++) lat_merge(&all, &hs[i]);
+    lat_print(out, &all);
+}
+
+void lat_report_lanes(FILE* out, const lat_hist_t* hs, int consumers, int lanes) {
+    for (int k = lanes - 1; k >= 0; k--) {
+        lat_hist_t lane;
+        lat_reset(&lane);
+        for (int c = 0; c < consumers; c++) lat_merge(&lane, &hs[c * lanes + k]);
+        char label[32];
+        snprintf(label, sizeof(label), "latency[prio=%d]", k);
+        lat_print_as(out, label, &lane);
+    }
+}
@@ -1,4 +1,11 @@
 #include "common.h"
+#include "latency.h"
+#include "statsblock.h"
+#include "crc32c.h"
+#include "pacer.h"
+#include "onfull.h"
+#include "pipes.h"
+#include "util.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -8,27 +15,18 @@
 #include <sys/wait.h>
 #include <time.h>
 #include <errno.h>
-
-#ifndef PIPE_BUF
-#define PIPE_BUF 4096
-#endif
-
-// Forward declarations
-int producer_run(int out_fd, uint32_t producer_id, const config_t* cfg);
-
-// Must match the struct used in consumer.c
-typedef struct {
-    uint64_t total_received;
-    uint64_t duplicates;
-    uint64_t out_of_range;
-    uint64_t malformed;
-} stats_t;
-
-int consumer_run(int in_fd, const config_t* cfg, stats_t* stats_out);
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <pthread.h>
 
 static void usage(const char* prog) {
     fprintf(stderr,
-        "Usage: %s [--producers N] [--consumers N] [--messages M] [--msg-size BYTES] [--verbose]\n"
+        "Usage: %s [--producers N] [--consumers N] [--messages M] [--msg-size BYTES] [--batch N]\n"
+        "          [--topology shared|fanin] [--zerocopy [--sink PATH]]\n"
+        "          [--engine sync|uring [--uring-depth N]] [--threads] [--latency]\n"
+        "          [--checksum none|crc32c|crc32c-sw] [--verify] [--sample-ms N]\n"
+        "          [--rate MSGS_PER_SEC | --rate-per-producer MSGS_PER_SEC] [--arrival constant|poisson]\n"
+        "          [--on-full block|drop|retry-timeout=US] [--verbose]\n"
         "\n"
         "Example:\n"
         "  %s --producers 4 --consumers 1 --messages 5000 --msg-size 64\n",
@@ -36,18 +34,68 @@ static void usage(const char* prog) {
     );
 }
 
-static int parse_int(const char* s) {
-    char* end = NULL;
-    long v = strtol(s, &end, 10);
-    if (!end || *end != '\0') return -1;
-    if (v < 0 || v > 1000000000L) return -1;
-    return (int)v;
+// Per-run options shared by the process and --threads paths
+typedef struct {
+    const config_t* cfg;
+    topology_t topology;
+    int zerocopy;
+    const char* sink_path;
+    int use_uring;
+    int uring_depth;
+    stats_block_t* sb;
+} run_opts_t;
+
+static int run_consumer(const run_opts_t* o, int c, const int* owned, int nowned, stats_t* st) {
+    // Zero-copy sink: a device such as /dev/null is shared, a regular
+    // file gets one copy per consumer (PATH.<c>)
+    int sink_fd = -1;
+    if (o->zerocopy) {
+        struct stat sb;
+        char path[4096];
+        if (stat(o->sink_path, &sb) == 0 && S_ISCHR(sb.st_mode)) snprintf(path, sizeof(path), "%s", o->sink_path);
+        else snprintf(path, sizeof(path), "%s.%d", o->sink_path, c);
+        sink_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (sink_fd < 0) {
+            perror("open sink");
+            return 1;
+        }
+    }
+
+    int rc;
+    if (o->topology == TOPOLOGY_FANIN) rc = consumer_run_fanin(owned, nowned, sink_fd, o->cfg, st);
+    else if (o->use_uring) rc = consumer_run_uring(owned[0], o->cfg, (uint32_t)o->uring_depth, st);
+    else rc = consumer_run(owned[0], o->cfg, st);
+    if (sink_fd >= 0) close(sink_fd);
+    sb_publish_stats(st);
+    return rc;
 }
 
-static double elapsed_sec(struct timespec a, struct timespec b) {
-    double sec = (double)(b.tv_sec - a.tv_sec);
-    double nsec = (double)(b.tv_nsec - a.tv_nsec) / 1e9;
-    return sec + nsec;
+static int run_producer(const run_opts_t* o, int p, int out_fd) {
+    if (o->zerocopy) return producer_run_zerocopy(out_fd, (uint32_t)p, o->cfg);
+    if (o->use_uring) return producer_run_uring(out_fd, (uint32_t)p, o->cfg, (uint32_t)o->uring_depth);
+    return producer_run(out_fd, (uint32_t)p, o->cfg, o->sb);
+}
+
+// --threads: one pthread per producer/consumer over the same (process-private)
+// pipes, released together by a barrier.
+typedef struct {
+    const run_opts_t* opts;
+    pthread_barrier_t* start;
+    int is_consumer;
+    int id;
+    int* fds;            // consumer: owned read ends; producer: fds[0] is its write end
+    int nfds;
+    int rc;
+    stats_t st;
+    pthread_t tid;
+} worker_t;
+
+static void* worker_main(void* arg) {
+    worker_t* w = (worker_t*)arg;
+    pthread_barrier_wait(w->start);
+    if (w->is_consumer) w->rc = run_consumer(w->opts, w->id, w->fds, w->nfds, &w->st);
+    else w->rc = run_producer(w->opts, w->id, w->fds[0]);
+    return NULL;
 }
 
 int main(int argc, char** argv) {
@@ -56,9 +104,20 @@ int main(int argc, char** argv) {
         .consumers = DEFAULT_CONSUMERS,
         .messages_per_producer = DEFAULT_MESSAGES_PER_PRODUCER,
         .msg_size = DEFAULT_MSG_SIZE,
+        .batch = 1,
         .verbose = 0
     };
 
+    topology_t topology = TOPOLOGY_SHARED;
+    int threads = 0;
+    int zerocopy = 0;
+    const char* sink_path = "/dev/null";
+    int use_uring = 0;
+    int uring_depth = 8;
+    int verify = 0;
+    int sample_ms = 0;
+    double rate = 0.0, rate_per_producer = 0.0;
+
     // Parse args
     for (int i = 1; i < argc; i++) {
         if (!strcmp(argv[i], "--producers") && i + 1 < argc) {
@@ -69,6 +128,59 @@ int main(int argc, char** argv) {
             cfg.messages_per_producer = (uint32_t)parse_int(argv[++i]);
         } else if (!strcmp(argv[i], "--msg-size") && i + 1 < argc) {
             cfg.msg_size = (uint32_t)parse_int(argv[++i]);
+        } else if (!strcmp(argv[i], "--batch") && i + 1 < argc) {
+            cfg.batch = (uint32_t)parse_int(argv[++i]);
+        } else if (!strcmp(argv[i], "--topology") && i + 1 < argc) {
+            const char* t = argv[++i];
+            if (!strcmp(t, "shared")) topology = TOPOLOGY_SHARED;
+            else if (!strcmp(t, "fanin")) topology = TOPOLOGY_FANIN;
+            else {
+                fprintf(stderr, "Error: --topology must be 'shared' or 'fanin'.\n");
+                return 2;
+            }
+        } else if (!strcmp(argv[i], "--threads")) {
+            threads = 1;
+        } else if (!strcmp(argv[i], "--latency")) {
+            cfg.latency = 1;
+        } else if (!strcmp(argv[i], "--checksum") && i + 1 < argc) {
+            cfg.checksum = checksum_parse(argv[++i]);
+            if (cfg.checksum < 0) {
+                fprintf(stderr, "Error: --checksum must be 'none', 'crc32c' or 'crc32c-sw'.\n");
+                return 2;
+            }
+        } else if (!strcmp(argv[i], "--rate") && i + 1 < argc) {
+            rate = rate_parse(argv[++i]);
+        } else if (!strcmp(argv[i], "--rate-per-producer") && i + 1 < argc) {
+            rate_per_producer = rate_parse(argv[++i]);
+        } else if (!strcmp(argv[i], "--arrival") && i + 1 < argc) {
+            cfg.arrival = arrival_parse(argv[++i]);
+            if (cfg.arrival < 0) {
+                fprintf(stderr, "Error: --arrival must be 'constant' or 'poisson'.\n");
+                return 2;
+            }
+        } else if (!strcmp(argv[i], "--on-full") && i + 1 < argc) {
+            if (onfull_parse(argv[++i], &cfg) < 0) {
+                fprintf(stderr, "Error: --on-full must be 'block', 'drop' or 'retry-timeout=US'.\n");
+                return 2;
+            }
+        } else if (!strcmp(argv[i], "--verify")) {
+            verify = 1;
+        } else if (!strcmp(argv[i], "--sample-ms") && i + 1 < argc) {
+            sample_ms = parse_int(argv[++i]);
+        } else if (!strcmp(argv[i], "--zerocopy")) {
+            zerocopy = 1;
+        } else if (!strcmp(argv[i], "--sink") && i + 1 < argc) {
+            sink_path = argv[++i];
+        } else if (!strcmp(argv[i], "--engine") && i + 1 < argc) {
+            const char* e = argv[++i];
+            if (!strcmp(e, "sync")) use_uring = 0;
+            else if (!strcmp(e, "uring")) use_uring = 1;
+            else {
+                fprintf(stderr, "Error: --engine must be 'sync' or 'uring'.\n");
+                return 2;
+            }
+        } else if (!strcmp(argv[i], "--uring-depth") && i + 1 < argc) {
+            uring_depth = parse_int(argv[++i]);
         } else if (!strcmp(argv[i], "--verbose")) {
             cfg.verbose = 1;
         } else if (!strcmp(argv[i], "--help") || !strcmp(argv[i], "-h")) {
@@ -80,113 +192,255 @@ int main(int argc, char** argv) {
         }
     }
 
-    if (cfg.producers <= 0 || cfg.consumers <= 0 || cfg.messages_per_producer == 0 || cfg.msg_size == 0) {
+    if (cfg.producers <= 0 || cfg.consumers <= 0 || cfg.messages_per_producer == 0 || cfg.msg_size == 0 ||
+        cfg.batch == 0 || cfg.batch > 1000000u || sample_ms < 0 || rate < 0.0 || rate_per_producer < 0.0) {
         fprintf(stderr, "Error: invalid parameters.\n");
         usage(argv[0]);
         return 2;
     }
+    if (pacer_configure(&cfg, rate, rate_per_producer) < 0) return 2;
+
+    // vmsplice'd frames reach the pipe in page-sized pieces, so only a pipe
+    // with a single writer keeps them intact
+    if (zerocopy && topology != TOPOLOGY_FANIN) {
+        fprintf(stderr, "Error: --zerocopy needs --topology fanin.\n");
+        return 2;
+    }
+    // Spliced payloads never reach the consumer's memory, so they can't be summed
+    if (zerocopy && cfg.checksum) {
+        fprintf(stderr, "Error: --checksum cannot be combined with --zerocopy.\n");
+        return 2;
+    }
+    const char* crc_kernel = crc32c_setup((checksum_t)cfg.checksum);
+    // Only the sync write paths see a full pipe as EAGAIN; vmsplice and
+    // io_uring writes wait inside the kernel
+    if ((zerocopy || use_uring) && cfg.on_full != ONFULL_BLOCK) {
+        fprintf(stderr, "Error: --on-full drop|retry-timeout needs --engine sync without --zerocopy.\n");
+        return 2;
+    }
+
+    // In-flight uring writes may complete in any order, which is only safe while
+    // each one is a PIPE_BUF-atomic run of whole frames on the shared pipe
+    if (use_uring && topology != TOPOLOGY_SHARED) {
+        fprintf(stderr, "Error: --engine uring needs --topology shared.\n");
+        return 2;
+    }
+    if (uring_depth < 1 || uring_depth > 4096) {
+        fprintf(stderr, "Error: --uring-depth must be between 1 and 4096.\n");
+        return 2;
+    }
 
-    // PIPE_BUF guard: ensure each message write is atomic for multi-producer pipe usage
+    // PIPE_BUF guard: ensure each message write is atomic for multi-producer pipe usage.
+    // Fan-in pipes have a single writer, so any size works there.
     size_t msg_bytes = sizeof(msg_hdr_t) + (size_t)cfg.msg_size;
-    if (msg_bytes > (size_t)PIPE_BUF) {
+    if (topology == TOPOLOGY_SHARED && msg_bytes > (size_t)PIPE_BUF) {
         fprintf(stderr,
-            "Error: message size (%zu) exceeds PIPE_BUF (%d). Reduce --msg-size.\n",
+            "Error: message size (%zu) exceeds PIPE_BUF (%d). Reduce --msg-size or use --topology fanin.\n",
             msg_bytes, PIPE_BUF
         );
         return 2;
     }
 
-    // Create pipe
-    int pipefd[2];
-    if (pipe(pipefd) < 0) {
-        perror("pipe");
+    uint32_t max_batch = pipes_max_batch(topology, msg_bytes);
+    if (cfg.batch > max_batch) cfg.batch = max_batch;
+
+    // Create pipes: one shared, or one per producer
+    int npipes = (topology == TOPOLOGY_SHARED) ? 1 : cfg.producers;
+    int* pipefd = (int*)malloc(sizeof(int) * 2 * (size_t)npipes); // [2p] read end, [2p+1] write end
+    int* owned = (int*)malloc(sizeof(int) * (size_t)npipes);
+    if (!pipefd || !owned) {
+        perror("malloc");
         return 3;
     }
+    for (int k = 0; k < npipes; k++) {
+        if (pipe(&pipefd[2 * k]) < 0) {
+            perror("pipe");
+            return 3;
+        }
+    }
 
     if (cfg.verbose) {
-        fprintf(stderr, "PIPE_BUF=%d, msg_bytes=%zu\n", PIPE_BUF, msg_bytes);
+        fprintf(stderr, "PIPE_BUF=%d, msg_bytes=%zu, batch=%u (%zu bytes/write), pipes=%d\n",
+                PIPE_BUF, msg_bytes, cfg.batch, msg_bytes * cfg.batch, npipes);
     }
 
+    run_opts_t opts = { &cfg, topology, zerocopy, sink_path, use_uring, uring_depth, NULL };
+    int child_rc_nonzero = 0;
+
+    lat_hist_t* lats = NULL;
+    if (cfg.latency && !(lats = lat_alloc_shared(cfg.consumers))) {
+        perror("mmap latency histograms");
+        return 3;
+    }
+    stats_block_t* sb = sb_create(cfg.producers, cfg.consumers, cfg.messages_per_producer, verify);
+    if (!sb) return 3;
+    opts.sb = sb;
+    sb_sampler_t* sampler = NULL;
+
     struct timespec t0, t1;
     clock_gettime(CLOCK_MONOTONIC, &t0);
 
+    if (threads) {
+        // workers[0..C) consumers, workers[C..C+P) producers
+        int total = cfg.consumers + cfg.producers;
+        worker_t* workers = (worker_t*)calloc((size_t)total, sizeof(worker_t));
+        int* fds = (int*)malloc(sizeof(int) * ((size_t)npipes * (size_t)cfg.consumers + (size_t)cfg.producers));
+        pthread_barrier_t start;
+        if (!workers || !fds || pthread_barrier_init(&start, NULL, (unsigned)total + 1) != 0) {
+            perror("threads");
+            return 4;
+        }
+        int* next_fd = fds;
+        for (int k = 0; k < total; k++) {
+            worker_t* w = &workers[k];
+            w->opts = &opts;
+            w->start = &start;
+            w->is_consumer = k < cfg.consumers;
+            w->id = w->is_consumer ? k : k - cfg.consumers;
+            w->st.lat = (lats && w->is_consumer) ? &lats[k] : NULL;
+            w->st.sb = sb;
+            w->st.slot = w->is_consumer ? &sb->slots[k] : NULL;
+            w->fds = next_fd;
+            if (w->is_consumer) {
+                for (int j = 0; j < npipes; j++) {
+                    if (topology == TOPOLOGY_SHARED || j % cfg.consumers == w->id) w->fds[w->nfds++] = pipefd[2 * j];
+                }
+            } else {
+                w->fds[w->nfds++] = pipefd[2 * ((topology == TOPOLOGY_SHARED) ? 0 : w->id) + 1];
+            }
+            next_fd += w->nfds;
+            if (pthread_create(&w->tid, NULL, worker_main, w) != 0) {
+                perror("pthread_create");
+                return 4;
+            }
+        }
+        pthread_barrier_wait(&start);
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        if (sample_ms) sampler = sb_sampler_start(sb, sample_ms, stdout);
+
+        // Producers done: close the write ends so consumers read EOF
+        for (int k = cfg.consumers; k < total; k++) {
+            pthread_join(workers[k].tid, NULL);
+            if (workers[k].rc != 0) child_rc_nonzero = 1;
+        }
+        for (int k = 0; k < npipes; k++) close(pipefd[2 * k + 1]);
+        for (int k = 0; k < cfg.consumers; k++) {
+            pthread_join(workers[k].tid, NULL);
+            sb_print_consumer(stdout, k, &workers[k].st);
+            if (workers[k].rc != 0) child_rc_nonzero = 1;
+        }
+        for (int k = 0; k < npipes; k++) close(pipefd[2 * k]);
+
+        pthread_barrier_destroy(&start);
+        free(workers);
+        free(fds);
+        free(pipefd);
+        free(owned);
+    }
+
     // Fork consumers (read end)
-    for (int c = 0; c < cfg.consumers; c++) {
+    for (int c = 0; c < cfg.consumers && !threads; c++) {
         pid_t pid = fork();
         if (pid < 0) {
             perror("fork (consumer)");
             return 4;
         }
         if (pid == 0) {
-            // child consumer
-            close(pipefd[1]); // close write end
+            // child consumer: keep only the read ends it owns, or EOF never arrives
+            int nowned = 0;
+            for (int k = 0; k < npipes; k++) {
+                close(pipefd[2 * k + 1]);
+                if (topology == TOPOLOGY_SHARED || k % cfg.consumers == c) owned[nowned++] = pipefd[2 * k];
+                else close(pipefd[2 * k]);
+            }
 
-            stats_t st = {0};
-            int rc = consumer_run(pipefd[0], &cfg, &st);
+            stats_t st = { .lat = lats ? &lats[c] : NULL, .sb = sb, .slot = &sb->slots[c] };
+            int rc = run_consumer(&opts, c, owned, nowned, &st);
 
             // Print per-consumer stats (nice evidence)
-            printf("consumer[%d]: received=%llu dup=%llu out_of_range=%llu malformed=%llu\n",
-                   c,
-                   (unsigned long long)st.total_received,
-                   (unsigned long long)st.duplicates,
-                   (unsigned long long)st.out_of_range,
-                   (unsigned long long)st.malformed);
-
-            close(pipefd[0]);
+            sb_print_consumer(stdout, c, &st);
+            fflush(stdout); // _exit() skips stdio flushing when stdout is a pipe
+
+            for (int k = 0; k < nowned; k++) close(owned[k]);
             _exit(rc);
         }
     }
 
     // Fork producers (write end)
-    for (int p = 0; p < cfg.producers; p++) {
+    for (int p = 0; p < cfg.producers && !threads; p++) {
         pid_t pid = fork();
         if (pid < 0) {
             perror("fork (producer)");
             return 5;
         }
         if (pid == 0) {
-            // child producer
-            close(pipefd[0]); // close read end
+            // child producer: keep only its own write end
+            int out = (topology == TOPOLOGY_SHARED) ? 0 : p;
+            for (int k = 0; k < npipes; k++) {
+                close(pipefd[2 * k]);
+                if (k != out) close(pipefd[2 * k + 1]);
+            }
 
-            int rc = producer_run(pipefd[1], (uint32_t)p, &cfg);
+            int rc = run_producer(&opts, p, pipefd[2 * out + 1]);
 
-            close(pipefd[1]);
+            close(pipefd[2 * out + 1]);
             _exit(rc);
         }
     }
 
-    // Parent: close both ends so consumers get EOF when producers exit
-    close(pipefd[0]);
-    close(pipefd[1]);
+    if (!threads) {
+        // Parent: close both ends so consumers get EOF when producers exit
+        for (int k = 0; k < 2 * npipes; k++) close(pipefd[k]);
+        free(pipefd);
+        free(owned);
+        if (sample_ms) sampler = sb_sampler_start(sb, sample_ms, stdout);
 
-    // Wait for all children
-    int status = 0;
-    int child_rc_nonzero = 0;
-    while (1) {
-        pid_t w = wait(&status);
-        if (w < 0) {
-            if (errno == EINTR) continue;
-            break;
-        }
-        if (WIFEXITED(status) && WEXITSTATUS(status) != 0) {
-            child_rc_nonzero = 1;
-        } else if (WIFSIGNALED(status)) {
-            child_rc_nonzero = 1;
+        // Wait for all children
+        int status = 0;
+        while (1) {
+            pid_t w = wait(&status);
+            if (w < 0) {
+                if (errno == EINTR) continue;
+                break;
+            }
+            if (WIFEXITED(status) && WEXITSTATUS(status) != 0) {
+                child_rc_nonzero = 1;
+            } else if (WIFSIGNALED(status)) {
+                child_rc_nonzero = 1;
+            }
         }
     }
 
     clock_gettime(CLOCK_MONOTONIC, &t1);
+    sb_sampler_stop(sampler);
     double sec = elapsed_sec(t0, t1);
 
     unsigned long long total_msgs =
-        (unsigned long long)cfg.producers * (unsigned long long)cfg.messages_per_producer;
+        (unsigned long long)cfg.producers * (unsigned long long)cfg.messages_per_producer - sb_dropped(sb);
 
     double msgs_per_sec = (sec > 0.0) ? ((double)total_msgs / sec) : 0.0;
+    char onfull_buf[32];
+
+    sb_report_producers(sb, stdout);
 
-    printf("run: producers=%d consumers=%d messages_per_producer=%u msg_size=%u\n",
-           cfg.producers, cfg.consumers, cfg.messages_per_producer, cfg.msg_size);
+    printf("run: producers=%d consumers=%d messages_per_producer=%u msg_size=%u batch=%u topology=%s zerocopy=%d engine=%s",
+           cfg.producers, cfg.consumers, cfg.messages_per_producer, cfg.msg_size, cfg.batch,
+           topology == TOPOLOGY_SHARED ? "shared" : "fanin", zerocopy, use_uring ? "uring" : "sync");
+    if (use_uring) printf(" uring_depth=%d", uring_depth);
+    if (cfg.checksum) printf(" checksum=crc32c/%s", crc_kernel);
+    if (cfg.rate > 0.0) printf(" rate=%.0f arrival=%s", cfg.rate * cfg.producers, arrival_name((arrival_t)cfg.arrival));
+    if (cfg.on_full != ONFULL_BLOCK) printf(" on_full=%s", onfull_name(&cfg, onfull_buf, sizeof(onfull_buf)));
+    if (threads) printf(" mode=threads");
+    printf("\n");
     printf("timing: %.3f sec | approx %.0f msgs/sec\n", sec, msgs_per_sec);
+    if (lats) {
+        lat_report(stdout, lats, cfg.consumers);
+        lat_free_shared(lats, cfg.consumers);
+    }
+    int mismatch = sb_report(sb, stdout);
+    sb_destroy(sb);
 
-    return child_rc_nonzero ? 6 : 0;
+    if (child_rc_nonzero) return 6;
+    return mismatch ? SB_EXIT_MISMATCH : 0;
 }
 
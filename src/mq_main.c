@@ -1,4 +1,13 @@
 #include "common.h"
+#include "latency.h"
+#include "seqtrack.h"
+#include "statsblock.h"
+#include "crc32c.h"
+#include "pacer.h"
+#include "onfull.h"
+#include "prio.h"
+#include "mq_shard.h"
+#include "util.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -7,106 +16,43 @@
 #include <unistd.h>
 #include <errno.h>
 #include <time.h>
-#include <fcntl.h>
 #include <sys/wait.h>
-#include <mqueue.h>
-
-#define MAX_PAYLOAD 512
-#define SENTINEL_PRODUCER_ID 0xFFFFFFFFu
-
-typedef struct {
-    uint64_t total_received;
-    uint64_t duplicates;
-    uint64_t out_of_range;
-    uint64_t malformed;
-} stats_t;
-
-typedef struct {
-    msg_hdr_t hdr;
-    unsigned char payload[MAX_PAYLOAD];
-} mq_msg_t;
+#include <pthread.h>
 
 static void usage(const char* prog) {
     fprintf(stderr,
-        "Usage: %s [--producers N] [--consumers N] [--messages M] [--msg-size BYTES] [--maxmsg N] [--verbose]\n"
+        "Usage: %s [--producers N] [--consumers N] [--messages M] [--msg-size BYTES] [--maxmsg N]\n"
+        "          [--queues K] [--pick id|rr] [--threads] [--latency]\n"
+        "          [--checksum none|crc32c|crc32c-sw] [--verify] [--sample-ms N]\n"
+        "          [--rate MSGS_PER_SEC | --rate-per-producer MSGS_PER_SEC] [--arrival constant|poisson]\n"
+        "          [--on-full block|drop|retry-timeout=US] [--priorities K] [--prio-mix W,W,...]\n"
+        "          [--verbose]\n"
         "Example:\n"
         "  %s --producers 2 --consumers 2 --messages 10000 --msg-size 64 --maxmsg 64\n",
         prog, prog
     );
 }
 
-static int parse_int(const char* s) {
-    char* end = NULL;
-    long v = strtol(s, &end, 10);
-    if (!end || *end != '\0') return -1;
-    if (v < 0 || v > 1000000000L) return -1;
-    return (int)v;
-}
-
-static double elapsed_sec(struct timespec a, struct timespec b) {
-    return (double)(b.tv_sec - a.tv_sec) + (double)(b.tv_nsec - a.tv_nsec) / 1e9;
-}
-
-static int producer_run(mqd_t q, uint32_t producer_id, const config_t* cfg) {
-    mq_msg_t msg;
-    memset(&msg, 0, sizeof(msg));
-    msg.hdr.producer_id = producer_id;
-    msg.hdr.payload_len = cfg->msg_size;
-    msg.hdr.crc32 = 0;
-
-    memset(msg.payload, 'A' + (producer_id % 26), cfg->msg_size);
-
-    for (uint32_t i = 0; i < cfg->messages_per_producer; i++) {
-        msg.hdr.seq = i;
-        if (mq_send(q, (const char*)&msg, sizeof(msg_hdr_t) + cfg->msg_size, 0) < 0) {
-            perror("mq_send");
-            return 1;
-        }
-    }
-    return 0;
-}
-
-static int consumer_run(mqd_t q, const config_t* cfg, stats_t* out) {
-    stats_t st = {0};
-
-    size_t P = (size_t)cfg->producers;
-    size_t M = (size_t)cfg->messages_per_producer;
-    size_t seen_sz = P * M;
-    unsigned char* seen = (unsigned char*)calloc(seen_sz, 1);
-    if (!seen) return 1;
-
-    mq_msg_t msg;
-    while (1) {
-        ssize_t r = mq_receive(q, (char*)&msg, sizeof(msg), NULL);
-        if (r < 0) {
-            perror("mq_receive");
-            free(seen);
-            return 2;
-        }
-
-        // sentinel to stop
-        if (msg.hdr.producer_id == SENTINEL_PRODUCER_ID) break;
-
-        if (msg.hdr.payload_len != cfg->msg_size) {
-            st.malformed++;
-            continue;
-        }
-
-        st.total_received++;
-
-        if (msg.hdr.producer_id >= (uint32_t)cfg->producers || msg.hdr.seq >= cfg->messages_per_producer) {
-            st.out_of_range++;
-            continue;
-        }
-
-        size_t idx = (size_t)msg.hdr.producer_id * M + (size_t)msg.hdr.seq;
-        if (seen[idx]) st.duplicates++;
-        else seen[idx] = 1;
-    }
-
-    free(seen);
-    *out = st;
-    return 0;
+// --threads: one pthread per producer/consumer sharing the parent's queue
+// descriptors (the sharded consumer still opens its own non-blocking ones)
+typedef struct {
+    pthread_barrier_t* start;
+    const config_t* cfg;
+    mq_shard_t* mq;
+    int is_consumer;
+    int id;
+    int rc;
+    stats_t st;
+    pthread_t tid;
+} worker_t;
+
+static void* worker_main(void* arg) {
+    worker_t* w = (worker_t*)arg;
+    pthread_barrier_wait(w->start);
+    if (!w->is_consumer) w->rc = mq_shard_producer_run(w->mq, (uint32_t)w->id, w->cfg, w->st.sb);
+    else w->rc = mq_shard_consumer_run(w->mq, w->cfg, &w->st);
+    if (w->is_consumer) sb_publish_stats(&w->st);
+    return NULL;
 }
 
 int main(int argc, char** argv) {
@@ -118,6 +64,13 @@ int main(int argc, char** argv) {
         .verbose = 0
     };
     int maxmsg = 10;
+    int nq = 1;
+    pick_t pick = PICK_ID;
+    int threads = 0;
+    int verify = 0;
+    int sample_ms = 0;
+    double rate = 0.0, rate_per_producer = 0.0;
+    const char* prio_mix = NULL;
 
     for (int i = 1; i < argc; i++) {
         if (!strcmp(argv[i], "--producers") && i + 1 < argc) cfg.producers = parse_int(argv[++i]);
@@ -125,123 +78,224 @@ int main(int argc, char** argv) {
         else if (!strcmp(argv[i], "--messages") && i + 1 < argc) cfg.messages_per_producer = (uint32_t)parse_int(argv[++i]);
         else if (!strcmp(argv[i], "--msg-size") && i + 1 < argc) cfg.msg_size = (uint32_t)parse_int(argv[++i]);
         else if (!strcmp(argv[i], "--maxmsg") && i + 1 < argc) maxmsg = parse_int(argv[++i]);
+        else if (!strcmp(argv[i], "--queues") && i + 1 < argc) nq = parse_int(argv[++i]);
+        else if (!strcmp(argv[i], "--pick") && i + 1 < argc) {
+            const char* v = argv[++i];
+            if (!strcmp(v, "id")) pick = PICK_ID;
+            else if (!strcmp(v, "rr")) pick = PICK_RR;
+            else { fprintf(stderr, "Error: --pick must be 'id' or 'rr'.\n"); return 2; }
+        }
+        else if (!strcmp(argv[i], "--threads")) threads = 1;
+        else if (!strcmp(argv[i], "--latency")) cfg.latency = 1;
+        else if (!strcmp(argv[i], "--checksum") && i + 1 < argc) {
+            cfg.checksum = checksum_parse(argv[++i]);
+            if (cfg.checksum < 0) {
+                fprintf(stderr, "Error: --checksum must be 'none', 'crc32c' or 'crc32c-sw'.\n");
+                return 2;
+            }
+        }
+        else if (!strcmp(argv[i], "--rate") && i + 1 < argc) rate = rate_parse(argv[++i]);
+        else if (!strcmp(argv[i], "--rate-per-producer") && i + 1 < argc) rate_per_producer = rate_parse(argv[++i]);
+        else if (!strcmp(argv[i], "--arrival") && i + 1 < argc) {
+            cfg.arrival = arrival_parse(argv[++i]);
+            if (cfg.arrival < 0) {
+                fprintf(stderr, "Error: --arrival must be 'constant' or 'poisson'.\n");
+                return 2;
+            }
+        }
+        else if (!strcmp(argv[i], "--on-full") && i + 1 < argc) {
+            if (onfull_parse(argv[++i], &cfg) < 0) {
+                fprintf(stderr, "Error: --on-full must be 'block', 'drop' or 'retry-timeout=US'.\n");
+                return 2;
+            }
+        }
+        else if (!strcmp(argv[i], "--priorities") && i + 1 < argc) {
+            cfg.priorities = parse_int(argv[++i]);
+            if (cfg.priorities < 1 || cfg.priorities > MAX_PRIORITIES) {
+                fprintf(stderr, "Error: --priorities must be between 1 and %d.\n", MAX_PRIORITIES);
+                return 2;
+            }
+        }
+        else if (!strcmp(argv[i], "--prio-mix") && i + 1 < argc) prio_mix = argv[++i];
+        else if (!strcmp(argv[i], "--verify")) verify = 1;
+        else if (!strcmp(argv[i], "--sample-ms") && i + 1 < argc) sample_ms = parse_int(argv[++i]);
         else if (!strcmp(argv[i], "--verbose")) cfg.verbose = 1;
         else if (!strcmp(argv[i], "--help") || !strcmp(argv[i], "-h")) { usage(argv[0]); return 0; }
         else { usage(argv[0]); return 1; }
     }
 
-    if (cfg.producers <= 0 || cfg.consumers <= 0 || cfg.messages_per_producer == 0 || cfg.msg_size == 0) {
+    // Real per-queue limits for unprivileged processes (root may go higher)
+    mq_shard_t mq;
+    mq_shard_limits(&mq);
+
+    if (cfg.producers <= 0 || cfg.consumers <= 0 || cfg.messages_per_producer == 0 || cfg.msg_size == 0 ||
+        sample_ms < 0 || rate < 0.0 || rate_per_producer < 0.0) {
         fprintf(stderr, "Error: invalid parameters.\n");
         return 2;
     }
-    if (cfg.msg_size > MAX_PAYLOAD) {
-        fprintf(stderr, "Error: --msg-size must be <= %d.\n", MAX_PAYLOAD);
+    if (pacer_configure(&cfg, rate, rate_per_producer) < 0) return 2;
+    if (prio_configure(&cfg, prio_mix) < 0) return 2;
+    int lanes = cfg.priorities > 1 ? cfg.priorities : 1; // latency histograms per consumer
+    if ((long)(sizeof(msg_hdr_t) + cfg.msg_size) > mq.msgsize_max) {
+        fprintf(stderr, "Error: --msg-size must be <= %ld (%s minus the %zu-byte header).\n",
+                mq.msgsize_max - (long)sizeof(msg_hdr_t), MQ_MSGSIZE_MAX_PATH, sizeof(msg_hdr_t));
         return 2;
     }
     if (maxmsg <= 0) {
         fprintf(stderr, "Error: --maxmsg must be > 0.\n");
         return 2;
     }
-    // Many Linux systems default msg_max to 10 (/proc/sys/fs/mqueue/msg_max).
-    // If maxmsg is too large, mq_open() can fail with EINVAL.
-    if (maxmsg > 10) {
-    fprintf(stderr, "Note: --maxmsg=%d is above typical Linux default; using 10 instead.\n", maxmsg);
-    maxmsg = 10;
-}
-
-    // Unique queue name
-    char qname[128];
-    snprintf(qname, sizeof(qname), "/cs4800_mq_%ld", (long)getpid());
+    if (nq <= 0 || nq > MQ_MAX_QUEUES) {
+        fprintf(stderr, "Error: --queues must be between 1 and %d.\n", MQ_MAX_QUEUES);
+        return 2;
+    }
 
-    struct mq_attr attr;
-    memset(&attr, 0, sizeof(attr));
-    attr.mq_maxmsg = maxmsg;
-    attr.mq_msgsize = sizeof(msg_hdr_t) + cfg.msg_size;
+    if (mq_shard_open(&mq, nq, maxmsg, pick, sizeof(msg_hdr_t) + cfg.msg_size) < 0) return 3;
+    maxmsg = mq.maxmsg;
 
-    mqd_t q = mq_open(qname, O_CREAT | O_EXCL | O_RDWR, 0600, &attr);
-    if (q == (mqd_t)-1) {
-        perror("mq_open");
-        return 3;
+    if (cfg.verbose) {
+        fprintf(stderr, "mq_name=%s queues=%d maxmsg=%d msgsize=%ld (msg_max=%ld msgsize_max=%ld)\n",
+                mq.names[0], nq, maxmsg, mq.msgsize, mq.msg_max, mq.msgsize_max);
     }
 
-    if (cfg.verbose) {
-        fprintf(stderr, "mq_name=%s maxmsg=%d msgsize=%ld\n", qname, maxmsg, (long)attr.mq_msgsize);
+    const char* crc_kernel = crc32c_setup((checksum_t)cfg.checksum);
+
+    int status = 0;
+    int child_error = 0;
+    worker_t* workers = NULL;
+
+    lat_hist_t* lats = NULL;
+    if (cfg.latency && !(lats = lat_alloc_shared(cfg.consumers * lanes))) {
+        perror("mmap latency histograms");
+        return 3;
     }
+    stats_block_t* sb = sb_create(cfg.producers, cfg.consumers, cfg.messages_per_producer, verify);
+    if (!sb) return 3;
+    sb_sampler_t* sampler = NULL;
 
     struct timespec t0, t1;
     clock_gettime(CLOCK_MONOTONIC, &t0);
 
+    pthread_barrier_t start;
+
+    if (threads) {
+        // workers[0..C) consumers, workers[C..C+P) producers
+        int total = cfg.consumers + cfg.producers;
+        workers = (worker_t*)calloc((size_t)total, sizeof(worker_t));
+        if (!workers || pthread_barrier_init(&start, NULL, (unsigned)total + 1) != 0) {
+            perror("threads");
+            return 4;
+        }
+        for (int k = 0; k < total; k++) {
+            worker_t* w = &workers[k];
+            w->start = &start;
+            w->cfg = &cfg;
+            w->mq = &mq;
+            w->is_consumer = k < cfg.consumers;
+            w->id = w->is_consumer ? k : k - cfg.consumers;
+            w->st.lat = (lats && w->is_consumer) ? &lats[k * lanes] : NULL;
+            w->st.sb = sb;
+            w->st.slot = w->is_consumer ? &sb->slots[k] : NULL;
+            if (pthread_create(&w->tid, NULL, worker_main, w) != 0) {
+                perror("pthread_create");
+                return 4;
+            }
+        }
+        pthread_barrier_wait(&start);
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        if (sample_ms) sampler = sb_sampler_start(sb, sample_ms, stdout);
+
+        for (int k = cfg.consumers; k < total; k++) {
+            pthread_join(workers[k].tid, NULL);
+            if (workers[k].rc != 0) child_error = 1;
+        }
+    }
+
     // Fork consumers first
-    for (int c = 0; c < cfg.consumers; c++) {
+    for (int c = 0; c < cfg.consumers && !threads; c++) {
         pid_t pid = fork();
         if (pid < 0) { perror("fork consumer"); return 4; }
         if (pid == 0) {
-            stats_t st = {0};
-            int rc = consumer_run(q, &cfg, &st);
-            printf("consumer[%d]: received=%llu dup=%llu out_of_range=%llu malformed=%llu\n",
-                   c,
-                   (unsigned long long)st.total_received,
-                   (unsigned long long)st.duplicates,
-                   (unsigned long long)st.out_of_range,
-                   (unsigned long long)st.malformed);
+            stats_t st = { .lat = lats ? &lats[c * lanes] : NULL, .sb = sb, .slot = &sb->slots[c] };
+            int rc = mq_shard_consumer_run(&mq, &cfg, &st);
+            sb_publish_stats(&st);
+            sb_print_consumer(stdout, c, &st);
+            fflush(stdout); // _exit() skips stdio flushing when stdout is a pipe
             _exit(rc);
         }
     }
 
     // Fork producers
-    for (int p = 0; p < cfg.producers; p++) {
+    for (int p = 0; p < cfg.producers && !threads; p++) {
         pid_t pid = fork();
         if (pid < 0) { perror("fork producer"); return 5; }
         if (pid == 0) {
-            int rc = producer_run(q, (uint32_t)p, &cfg);
+            int rc = mq_shard_producer_run(&mq, (uint32_t)p, &cfg, sb);
             _exit(rc);
         }
     }
 
+    // Started after the last fork so no child inherits a held stdio lock
+    if (sample_ms && !threads) sampler = sb_sampler_start(sb, sample_ms, stdout);
+
     // Wait for producers to finish (consumers should still be running)
-    int status = 0;
-    int child_error = 0;
-    for (int i = 0; i < cfg.producers; i++) {
+    for (int i = 0; i < cfg.producers && !threads; i++) {
         pid_t w = wait(&status);
         if (w < 0) { perror("wait"); child_error = 1; break; }
         if ((WIFEXITED(status) && WEXITSTATUS(status) != 0) || WIFSIGNALED(status)) child_error = 1;
     }
 
-    // Send sentinels (one per consumer)
-    mq_msg_t sentinel;
-    memset(&sentinel, 0, sizeof(sentinel));
-    sentinel.hdr.producer_id = SENTINEL_PRODUCER_ID;
-    sentinel.hdr.seq = 0;
-    sentinel.hdr.payload_len = cfg.msg_size;
-
-    for (int i = 0; i < cfg.consumers; i++) {
-        if (mq_send(q, (const char*)&sentinel, sizeof(msg_hdr_t) + cfg.msg_size, 0) < 0) {
-            perror("mq_send sentinel");
-            child_error = 1;
-        }
-    }
+    // Send sentinels: one per consumer, on every queue
+    if (mq_shard_finish(&mq, &cfg) < 0) child_error = 1;
 
     // Reap consumers
-    for (int i = 0; i < cfg.consumers; i++) {
+    if (threads) {
+        for (int k = 0; k < cfg.consumers; k++) {
+            pthread_join(workers[k].tid, NULL);
+            sb_print_consumer(stdout, k, &workers[k].st);
+            if (workers[k].rc != 0) child_error = 1;
+        }
+        pthread_barrier_destroy(&start);
+        free(workers);
+    }
+    for (int i = 0; i < cfg.consumers && !threads; i++) {
         pid_t w = wait(&status);
         if (w < 0) { perror("wait consumer"); child_error = 1; break; }
         if ((WIFEXITED(status) && WEXITSTATUS(status) != 0) || WIFSIGNALED(status)) child_error = 1;
     }
 
     clock_gettime(CLOCK_MONOTONIC, &t1);
+    sb_sampler_stop(sampler);
     double sec = elapsed_sec(t0, t1);
 
     unsigned long long total_msgs =
-        (unsigned long long)cfg.producers * (unsigned long long)cfg.messages_per_producer;
+        (unsigned long long)cfg.producers * (unsigned long long)cfg.messages_per_producer - sb_dropped(sb);
 
     double msgs_per_sec = (sec > 0.0) ? ((double)total_msgs / sec) : 0.0;
-
-    printf("run(mq): producers=%d consumers=%d messages_per_producer=%u msg_size=%u maxmsg=%d\n",
-           cfg.producers, cfg.consumers, cfg.messages_per_producer, cfg.msg_size, maxmsg);
+    char onfull_buf[32];
+
+    sb_report_producers(sb, stdout);
+
+    printf("run(mq): producers=%d consumers=%d messages_per_producer=%u msg_size=%u maxmsg=%d queues=%d pick=%s",
+           cfg.producers, cfg.consumers, cfg.messages_per_producer, cfg.msg_size, maxmsg, nq,
+           pick == PICK_RR ? "rr" : "id");
+    if (cfg.checksum) printf(" checksum=crc32c/%s", crc_kernel);
+    if (cfg.rate > 0.0) printf(" rate=%.0f arrival=%s", cfg.rate * cfg.producers, arrival_name((arrival_t)cfg.arrival));
+    if (cfg.on_full != ONFULL_BLOCK) printf(" on_full=%s", onfull_name(&cfg, onfull_buf, sizeof(onfull_buf)));
+    if (lanes > 1) printf(" priorities=%d prio_mix=%s", lanes, prio_mix ? prio_mix : "equal");
+    if (threads) printf(" mode=threads");
+    printf("\n");
     printf("timing: %.3f sec | approx %.0f msgs/sec\n", sec, msgs_per_sec);
+    if (lats) {
+        lat_report(stdout, lats, cfg.consumers * lanes);
+        if (lanes > 1) lat_report_lanes(stdout, lats, cfg.consumers, lanes);
+        lat_free_shared(lats, cfg.consumers * lanes);
+    }
+    int mismatch = sb_report(sb, stdout);
+    sb_destroy(sb);
 
-    mq_close(q);
-    mq_unlink(qname);
+    mq_shard_close(&mq);
 
-    return child_error ? 6 : 0;
+    if (child_error) return 6;
+    return mismatch ? SB_EXIT_MISMATCH : 0;
 }
\ No newline at end of file
@@ -0,0 +1,310 @@
+#include "mq_shard.h"
+#include "latency.h"
+#include "seqtrack.h"
+#include "crc32c.h"
+#include "pacer.h"
+#include "onfull.h"
+#include "prio.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+
+#define SENTINEL_PRODUCER_ID 0xFFFFFFFFu
+
+// Read one integer limit from /proc/sys/fs/mqueue; fallback if unavailable
+static long read_proc_limit(const char* path, long fallback) {
+    FILE* f = fopen(path, "r");
+    if (!f) return fallback;
+    long v = fallback;
+    if (fscanf(f, "%ld", &v) != 1) v = fallback;
+    fclose(f);
+    return v;
+}
+
+// Send one frame. The producers' descriptors are blocking, so mq_timedsend()
+// with an already expired timeout is the non-blocking try; a full queue then
+// waits in mq_send() (block), in mq_timedsend() until the retry deadline, or
+// not at all (drop). prio is the native mqueue priority (prio.h). 1 = sent,
+// 0 = dropped, -1 = error.
+static int send_frame(mqd_t q, const unsigned char* buf, size_t len, unsigned int prio, const config_t* cfg,
+                      sb_prod_t* prod) {
+    static const struct timespec expired = { 0, 0 };
+    int rc;
+    while ((rc = mq_timedsend(q, (const char*)buf, len, prio, &expired)) < 0 && errno == EINTR) {}
+    if (rc == 0) return 1;
+    if (errno != ETIMEDOUT) return -1;
+
+    uint64_t full_ns = lat_now_ns();
+    uint64_t deadline = onfull_deadline(cfg, full_ns);
+    if (deadline == ONFULL_NOW) {
+        sb_note_full(prod, full_ns, full_ns);
+        return 0;
+    }
+    struct timespec ts;
+    if (deadline) onfull_realtime(deadline, &ts);
+    while ((rc = deadline ? mq_timedsend(q, (const char*)buf, len, prio, &ts)
+                          : mq_send(q, (const char*)buf, len, prio)) < 0 && errno == EINTR) {}
+    int err = errno;
+    sb_note_full(prod, full_ns, lat_now_ns());
+    if (rc == 0) return 1;
+    errno = err;
+    return err == ETIMEDOUT ? 0 : -1;
+}
+
+static int producer_run(const mqd_t* qs, int nq, pick_t pick, uint32_t producer_id, const config_t* cfg,
+                        stats_block_t* sb) {
+    size_t msg_bytes = sizeof(msg_hdr_t) + cfg->msg_size;
+    unsigned char* buf = (unsigned char*)malloc(msg_bytes);
+    if (!buf) return 1;
+
+    msg_hdr_t hdr;
+    hdr.producer_id = producer_id;
+    hdr.payload_len = cfg->msg_size;
+    hdr.crc32 = 0;
+    hdr.send_ns = 0;
+
+    memset(buf + sizeof(msg_hdr_t), 'A' + (producer_id % 26), cfg->msg_size);
+
+    pacer_t pacer;
+    pacer_init(&pacer, cfg, producer_id);
+
+    for (uint32_t i = 0; i < cfg->messages_per_producer; i++) {
+        hdr.seq = i;
+        if (pacer.active) pacer_take(&pacer, 1, &hdr.send_ns);
+        else if (cfg->latency) hdr.send_ns = lat_now_ns();
+        if (cfg->checksum) hdr.crc32 = crc32c_frame(&hdr, buf + sizeof(msg_hdr_t));
+        memcpy(buf, &hdr, sizeof(hdr));
+        int k = (pick == PICK_RR) ? (int)((producer_id + i) % (uint32_t)nq) : (int)(producer_id % (uint32_t)nq);
+        int rc = send_frame(qs[k], buf, msg_bytes, prio_of(cfg, producer_id, i), cfg, &sb->prod[producer_id]);
+        if (rc < 0) {
+            perror("mq_send");
+            free(buf);
+            return 1;
+        }
+        if (rc == 0) sb_drop(sb, producer_id, i);
+    }
+    free(buf);
+    return 0;
+}
+
+// prio is the mqueue priority the message arrived with; it picks the histogram
+static void consumer_check(const msg_hdr_t* hdr, const unsigned char* payload, unsigned int prio,
+                           const config_t* cfg, seqtrack_t* seen, stats_t* st) {
+    // A checksum mismatch is a corrupt message: counted as malformed, not received
+    if (hdr->payload_len != cfg->msg_size ||
+        (cfg->checksum && hdr->crc32 != crc32c_frame(hdr, payload))) {
+        st->malformed++;
+        return;
+    }
+
+    st->total_received++;
+    if (st->lat) lat_record(&st->lat[prio], hdr->send_ns, lat_now_ns());
+    if (st->slot) sb_note_received(st->slot, st->total_received);
+
+    if (hdr->producer_id >= (uint32_t)cfg->producers || hdr->seq >= cfg->messages_per_producer) {
+        st->out_of_range++;
+        return;
+    }
+    if (st->sb) sb_mark(st->sb, hdr->producer_id, hdr->seq);
+
+    seq_result_t seq_res = seqtrack_mark(seen, hdr->producer_id, hdr->seq);
+    if (seq_res == SEQ_DUP) st->duplicates++;
+    else if (seq_res == SEQ_LATE) st->late++;
+}
+
+static int consumer_run(mqd_t q, long msgsize, const config_t* cfg, stats_t* out) {
+    stats_t st = { .lat = out->lat, .sb = out->sb, .slot = out->slot };
+
+    seqtrack_t* seen = seqtrack_new((uint32_t)cfg->producers, cfg->messages_per_producer);
+    unsigned char* buf = (unsigned char*)malloc((size_t)msgsize);
+    if (!seen || !buf) { seqtrack_free(seen); free(buf); return 1; }
+
+    msg_hdr_t hdr;
+    unsigned int prio;
+    while (1) {
+        ssize_t r = mq_receive(q, (char*)buf, (size_t)msgsize, &prio);
+        if (r < 0) {
+            perror("mq_receive");
+            seqtrack_free(seen);
+            free(buf);
+            return 2;
+        }
+        memcpy(&hdr, buf, sizeof(hdr));
+
+        // sentinel to stop
+        if (hdr.producer_id == SENTINEL_PRODUCER_ID) break;
+
+        consumer_check(&hdr, buf + sizeof(hdr), prio, cfg, seen, &st);
+    }
+
+    seqtrack_free(seen);
+    free(buf);
+    *out = st;
+    return 0;
+}
+
+// Sharded path: this consumer opens its own O_NONBLOCK descriptor for every
+// queue (the inherited ones share blocking mode with the producers) and waits
+// on all of them with epoll; on Linux an mqd_t is a pollable fd. The parent
+// sends C sentinels to each queue, and a consumer stops watching a queue after
+// its first sentinel there, so every consumer gets exactly one per queue.
+static int consumer_run_sharded(char (*names)[128], int nq, long msgsize, const config_t* cfg, stats_t* out) {
+    stats_t st = { .lat = out->lat, .sb = out->sb, .slot = out->slot };
+    seqtrack_t* seen = seqtrack_new((uint32_t)cfg->producers, cfg->messages_per_producer);
+    unsigned char* buf = (unsigned char*)malloc((size_t)msgsize);
+    mqd_t qs[MQ_MAX_QUEUES];
+    int opened = 0;
+    int rc = 0;
+    int ep = epoll_create1(EPOLL_CLOEXEC);
+    if (!seen || !buf || ep < 0) { rc = 1; goto out; }
+
+    for (; opened < nq; opened++) {
+        qs[opened] = mq_open(names[opened], O_RDONLY | O_NONBLOCK);
+        if (qs[opened] == (mqd_t)-1) {
+            perror("mq_open (consumer)");
+            rc = 3;
+            goto out;
+        }
+        struct epoll_event ev = { .events = EPOLLIN, .data.u32 = (uint32_t)opened };
+        if (epoll_ctl(ep, EPOLL_CTL_ADD, (int)qs[opened], &ev) < 0) {
+            perror("epoll_ctl");
+            opened++;
+            rc = 3;
+            goto out;
+        }
+    }
+
+    int live = nq;
+    struct epoll_event events[MQ_MAX_QUEUES];
+    msg_hdr_t hdr;
+    unsigned int prio;
+    while (live > 0) {
+        int n = epoll_wait(ep, events, MQ_MAX_QUEUES, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait");
+            rc = 4;
+            break;
+        }
+        for (int e = 0; e < n; e++) {
+            int k = (int)events[e].data.u32;
+            // drain what's there; other consumers may race us to it (EAGAIN)
+            while (1) {
+                ssize_t r = mq_receive(qs[k], (char*)buf, (size_t)msgsize, &prio);
+                if (r < 0) {
+                    if (errno == EAGAIN) break;
+                    if (errno == EINTR) continue;
+                    perror("mq_receive");
+                    rc = 2;
+                    live = 0;
+                    break;
+                }
+                memcpy(&hdr, buf, sizeof(hdr));
+                if (hdr.producer_id == SENTINEL_PRODUCER_ID) {
+                    epoll_ctl(ep, EPOLL_CTL_DEL, (int)qs[k], NULL);
+                    live--;
+                    break;
+                }
+                consumer_check(&hdr, buf + sizeof(hdr), prio, cfg, seen, &st);
+            }
+        }
+    }
+
+out:
+    for (int k = 0; k < opened; k++) mq_close(qs[k]);
+    if (ep >= 0) close(ep);
+    seqtrack_free(seen);
+    free(buf);
+    *out = st;
+    return rc;
+}
+
+void mq_shard_limits(mq_shard_t* m) {
+    // Real per-queue limits for unprivileged processes (root may go higher)
+    m->msg_max = read_proc_limit(MQ_MSG_MAX_PATH, 10);
+    m->msgsize_max = read_proc_limit(MQ_MSGSIZE_MAX_PATH, 8192);
+}
+
+int mq_shard_open(mq_shard_t* m, int nq, int maxmsg, pick_t pick, size_t msg_bytes) {
+    m->nq = nq;
+    m->pick = pick;
+    m->maxmsg = maxmsg;
+    m->msgsize = (long)msg_bytes;
+
+    // Unique queue names, one per shard
+    for (int k = 0; k < nq; k++) {
+        if (nq == 1) snprintf(m->names[k], sizeof(m->names[k]), "/cs4800_mq_%ld", (long)getpid());
+        else snprintf(m->names[k], sizeof(m->names[k]), "/cs4800_mq_%ld_%d", (long)getpid(), k);
+    }
+
+    struct mq_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.mq_maxmsg = maxmsg;
+    attr.mq_msgsize = m->msgsize;
+
+    for (int k = 0; k < nq; k++) {
+        m->qs[k] = mq_open(m->names[k], O_CREAT | O_EXCL | O_RDWR, 0600, &attr);
+        // Above msg_max only privileged processes succeed; otherwise use the limit
+        if (m->qs[k] == (mqd_t)-1 && errno == EINVAL && attr.mq_maxmsg > m->msg_max) {
+            fprintf(stderr, "Note: --maxmsg=%d exceeds %s (%ld); using %ld.\n",
+                    m->maxmsg, MQ_MSG_MAX_PATH, m->msg_max, m->msg_max);
+            m->maxmsg = (int)m->msg_max;
+            attr.mq_maxmsg = m->msg_max;
+            m->qs[k] = mq_open(m->names[k], O_CREAT | O_EXCL | O_RDWR, 0600, &attr);
+        }
+        if (m->qs[k] == (mqd_t)-1) {
+            perror("mq_open");
+            for (int j = 0; j < k; j++) {
+                mq_close(m->qs[j]);
+                mq_unlink(m->names[j]);
+            }
+            m->nq = 0;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int mq_shard_producer_run(const mq_shard_t* m, uint32_t producer_id, const config_t* cfg, stats_block_t* sb) {
+    return producer_run(m->qs, m->nq, m->pick, producer_id, cfg, sb);
+}
+
+int mq_shard_consumer_run(mq_shard_t* m, const config_t* cfg, stats_t* st) {
+    if (m->nq == 1) return consumer_run(m->qs[0], m->msgsize, cfg, st);
+    return consumer_run_sharded(m->names, m->nq, m->msgsize, cfg, st);
+}
+
+int mq_shard_finish(const mq_shard_t* m, const config_t* cfg) {
+    size_t msg_bytes = sizeof(msg_hdr_t) + cfg->msg_size;
+    unsigned char* sentinel = (unsigned char*)calloc(1, msg_bytes);
+    if (!sentinel) return -1;
+    msg_hdr_t shdr = { SENTINEL_PRODUCER_ID, 0, cfg->msg_size, 0, 0 };
+    memcpy(sentinel, &shdr, sizeof(shdr));
+
+    int rc = 0;
+    for (int k = 0; k < m->nq; k++) {
+        for (int i = 0; i < cfg->consumers; i++) {
+            if (mq_send(m->qs[k], (const char*)sentinel, msg_bytes, 0) < 0) {
+                perror("mq_send sentinel");
+                rc = -1;
+            }
+        }
+    }
+    free(sentinel);
+    return rc;
+}
+
+void mq_shard_close(mq_shard_t* m) {
+    for (int k = 0; k < m->nq; k++) {
+        mq_close(m->qs[k]);
+        mq_unlink(m->names[k]);
+    }
+    m->nq = 0;
+}
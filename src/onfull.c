@@ -0,0 +1,59 @@
+#include "onfull.h"
+#include "latency.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RETRY_PREFIX "retry-timeout="
+#define MAX_RETRY_US 60000000ul // one minute
+
+int onfull_parse(const char* s, config_t* cfg) {
+    if (!strcmp(s, "block")) {
+        cfg->on_full = ONFULL_BLOCK;
+        return 0;
+    }
+    if (!strcmp(s, "drop")) {
+        cfg->on_full = ONFULL_DROP;
+        return 0;
+    }
+    if (!strncmp(s, RETRY_PREFIX, strlen(RETRY_PREFIX))) {
+        const char* v = s + strlen(RETRY_PREFIX);
+        char* end = NULL;
+        unsigned long us = strtoul(v, &end, 10);
+        if (!v[0] || *end || us == 0 || us > MAX_RETRY_US) return -1;
+        cfg->on_full = ONFULL_RETRY;
+        cfg->retry_us = (uint32_t)us;
+        return 0;
+    }
+    return -1;
+}
+
+const char* onfull_name(const config_t* cfg, char* buf, size_t len) {
+    if (cfg->on_full == ONFULL_RETRY) snprintf(buf, len, RETRY_PREFIX "%u", cfg->retry_us);
+    else snprintf(buf, len, "%s", cfg->on_full == ONFULL_DROP ? "drop" : "block");
+    return buf;
+}
+
+uint64_t onfull_deadline(const config_t* cfg, uint64_t now_ns) {
+    if (cfg->on_full == ONFULL_DROP) return ONFULL_NOW;
+    if (cfg->on_full == ONFULL_RETRY) return now_ns + (uint64_t)cfg->retry_us * 1000ull;
+    return 0;
+}
+
+void onfull_realtime(uint64_t deadline_ns, struct timespec* ts) {
+    uint64_t now = lat_now_ns();
+    uint64_t left = deadline_ns > now ? deadline_ns - now : 0;
+    clock_gettime(CLOCK_REALTIME, ts);
+    ts->tv_sec += (time_t)(left / 1000000000ull);
+    ts->tv_nsec += (long)(left % 1000000000ull);
+    if (ts->tv_nsec >= 1000000000L) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000L;
+    }
+}
+
+void onfull_remaining(uint64_t deadline_ns, uint64_t now_ns, struct timespec* ts) {
+    uint64_t left = deadline_ns > now_ns ? deadline_ns - now_ns : 0;
+    ts->tv_sec = (time_t)(left / 1000000000ull);
+    ts->tv_nsec = (long)(left % 1000000000ull);
+}
@@ -0,0 +1,77 @@
+#include "pacer.h"
+#include "latency.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/prctl.h>
+
+double rate_parse(const char* s) {
+    char* end = NULL;
+    double v = strtod(s, &end);
+    if (!s[0] || !end || *end || !(v > 0.0) || v > 1e10) return -1.0;
+    return v;
+}
+
+int pacer_configure(config_t* cfg, double total, double per_producer) {
+    if (total > 0.0 && per_producer > 0.0) {
+        fprintf(stderr, "Error: give either --rate or --rate-per-producer, not both.\n");
+        return -1;
+    }
+    cfg->rate = per_producer > 0.0 ? per_producer : (total > 0.0 ? total / cfg->producers : 0.0);
+    if (cfg->rate > 0.0) cfg->latency = 1;
+    return 0;
+}
+
+int arrival_parse(const char* s) {
+    if (!strcmp(s, "constant")) return ARRIVAL_CONSTANT;
+    if (!strcmp(s, "poisson")) return ARRIVAL_POISSON;
+    return -1;
+}
+
+const char* arrival_name(arrival_t a) {
+    return a == ARRIVAL_POISSON ? "poisson" : "constant";
+}
+
+void pacer_init(pacer_t* p, const config_t* cfg, uint32_t producer_id) {
+    memset(p, 0, sizeof(*p));
+    if (cfg->rate <= 0.0) return;
+    p->active = 1;
+    p->poisson = cfg->arrival == ARRIVAL_POISSON;
+    p->gap_ns = 1e9 / cfg->rate;
+    p->next_ns = (double)lat_now_ns();
+    p->rng = 0x9e3779b97f4a7c15ull * (producer_id + 1);
+
+    // The default 50 us timer slack would delay every wakeup; ask for 1 ns
+    prctl(PR_SET_TIMERSLACK, 1UL, 0, 0, 0);
+}
+
+static double next_gap(pacer_t* p) {
+    if (!p->poisson) return p->gap_ns;
+    p->rng ^= p->rng << 13;
+    p->rng ^= p->rng >> 7;
+    p->rng ^= p->rng << 17;
+    double u = (double)((p->rng >> 11) + 1) / 9007199254740993.0; // (0, 1]
+    return -log(u) * p->gap_ns;
+}
+
+uint32_t pacer_take(pacer_t* p, uint32_t max, uint64_t* stamps) {
+    // Sleep, not spin: producers and consumers may share one CPU, and a late
+    // wakeup is charged to latency anyway since stamps are intended times
+    uint64_t due = (uint64_t)p->next_ns;
+    uint64_t now = lat_now_ns();
+    if (now < due) {
+        struct timespec ts = { (time_t)(due / 1000000000ull), (long)(due % 1000000000ull) };
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {}
+        now = lat_now_ns();
+    }
+
+    uint32_t n = 0;
+    do {
+        stamps[n++] = (uint64_t)p->next_ns;
+        p->next_ns += next_gap(p);
+    } while (n < max && (uint64_t)p->next_ns <= now);
+    return n;
+}
@@ -0,0 +1,51 @@
+#include "prio.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+int prio_configure(config_t* cfg, const char* mix) {
+    uint64_t w[MAX_PRIORITIES];
+    int n = 0;
+    if (mix) {
+        const char* s = mix;
+        for (;;) {
+            char* end = NULL;
+            unsigned long v = strtoul(s, &end, 10);
+            if (end == s || v > 1000000ul || n == MAX_PRIORITIES) {
+                fprintf(stderr, "Error: --prio-mix takes up to %d comma-separated weights (0..1000000).\n",
+                        MAX_PRIORITIES);
+                return -1;
+            }
+            w[n++] = v;
+            if (*end == '\0') break;
+            if (*end != ',') {
+                fprintf(stderr, "Error: --prio-mix takes comma-separated weights, e.g. 95,5.\n");
+                return -1;
+            }
+            s = end + 1;
+        }
+        if (!cfg->priorities) cfg->priorities = n;
+        if (n != cfg->priorities) {
+            fprintf(stderr, "Error: --prio-mix has %d weights for --priorities %d.\n", n, cfg->priorities);
+            return -1;
+        }
+    }
+    if (cfg->priorities <= 1) return 0;
+    if (!mix) {
+        n = cfg->priorities;
+        for (int k = 0; k < n; k++) w[k] = 1;
+    }
+
+    uint64_t total = 0;
+    for (int k = 0; k < n; k++) total += w[k];
+    if (total == 0) {
+        fprintf(stderr, "Error: --prio-mix weights must not all be 0.\n");
+        return -1;
+    }
+    // Priority k takes hash values in [cut[k-1], cut[k]) out of [0, 2^32)
+    uint64_t cum = 0;
+    for (int k = 0; k < n; k++) {
+        cum += w[k];
+        cfg->prio_cut[k] = (cum << 32) / total;
+    }
+    return 0;
+}
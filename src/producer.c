@@ -1,12 +1,124 @@
+#define _GNU_SOURCE // vmsplice, F_GETPIPE_SZ, ppoll
 #include "common.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <unistd.h>
+#include <poll.h>
+#include <sys/uio.h>
+#include "uring.h"
+#include "latency.h"
+#include "crc32c.h"
+#include "pacer.h"
+#include "statsblock.h"
+#include "onfull.h"
+#include "pipes.h"
 
-ssize_t write_all(int fd, const void* buf, size_t n);
+// The sync paths write to an O_NONBLOCK pipe, so a full pipe is an EAGAIN
+// that write_frames() handles under cfg->on_full instead of a sleep in write().
+static int set_nonblocking(int fd) {
+    int fl = fcntl(fd, F_GETFL);
+    return (fl < 0 || fcntl(fd, F_SETFL, fl | O_NONBLOCK) < 0) ? -1 : 0;
+}
+
+// Write a run of whole frames. When the pipe is full, wait in ppoll() for
+// room (block), until the retry deadline, or not at all (drop). A write of
+// at most PIPE_BUF bytes lands whole or not at all; a longer fan-in write
+// that has started must finish, so only an untouched run is ever dropped.
+// Returns 1 if written, 0 if dropped, -1 on error.
+static int write_frames(int fd, const unsigned char* buf, size_t len, const config_t* cfg, sb_prod_t* prod) {
+    size_t done = 0;
+    uint64_t full_ns = 0, deadline = 0;
+    while (done < len) {
+        ssize_t w = write(fd, buf + done, len - done);
+        if (w > 0) {
+            done += (size_t)w;
+            continue;
+        }
+        if (w < 0 && errno == EINTR) continue;
+        if (w == 0 || errno != EAGAIN) return -1;
+
+        uint64_t now = lat_now_ns();
+        if (!full_ns) {
+            full_ns = now;
+            deadline = onfull_deadline(cfg, now);
+        }
+        if (done) deadline = 0;
+        if (deadline && now >= deadline) {
+            sb_note_full(prod, full_ns, now);
+            return 0;
+        }
+        struct timespec left;
+        if (deadline) onfull_remaining(deadline, now, &left);
+        struct pollfd pfd = { fd, POLLOUT, 0 };
+        if (ppoll(&pfd, 1, deadline ? &left : NULL, NULL) < 0 && errno != EINTR) return -1;
+    }
+    if (full_ns) sb_note_full(prod, full_ns, lat_now_ns());
+    return 1;
+}
+
+// Batched path: pack up to cfg->batch whole frames into one write. The caller
+// caps batch * msg_bytes at PIPE_BUF, so each write is still atomic and frames
+// from different producers never interleave.
+static int producer_run_batch(int out_fd, uint32_t producer_id, const config_t* cfg, stats_block_t* sb) {
+    size_t msg_bytes = sizeof(msg_hdr_t) + cfg->msg_size;
+    uint32_t batch = cfg->batch;
+
+    unsigned char* buf = (unsigned char*)malloc(msg_bytes * batch);
+    uint64_t* stamps = (uint64_t*)malloc(sizeof(uint64_t) * batch);
+    if (!buf || !stamps) { free(buf); free(stamps); return 1; }
+
+    // payloads never change, so fill them once
+    for (uint32_t k = 0; k < batch; k++) {
+        memset(buf + k * msg_bytes + sizeof(msg_hdr_t), 'A' + (producer_id % 26), cfg->msg_size);
+    }
+
+    msg_hdr_t hdr;
+    hdr.producer_id = producer_id;
+    hdr.payload_len = cfg->msg_size;
+    hdr.crc32 = 0;
+    hdr.send_ns = 0;
+
+    pacer_t pacer;
+    pacer_init(&pacer, cfg, producer_id);
+
+    uint32_t i = 0;
+    while (i < cfg->messages_per_producer) {
+        uint32_t n = cfg->messages_per_producer - i;
+        if (n > batch) n = batch;
+        if (pacer.active) n = pacer_take(&pacer, n, stamps); // --rate: only what is due
+        else if (cfg->latency) hdr.send_ns = lat_now_ns(); // one write, one timestamp
+        for (uint32_t k = 0; k < n; k++) {
+            hdr.seq = i + k;
+            if (pacer.active) hdr.send_ns = stamps[k];
+            if (cfg->checksum) hdr.crc32 = crc32c_frame(&hdr, buf + k * msg_bytes + sizeof(msg_hdr_t));
+            memcpy(buf + k * msg_bytes, &hdr, sizeof(hdr));
+        }
+        int rc = write_frames(out_fd, buf, msg_bytes * n, cfg, &sb->prod[producer_id]);
+        if (rc < 0) {
+            perror("producer write batch");
+            free(buf);
+            free(stamps);
+            return 2;
+        }
+        for (uint32_t k = 0; k < n && rc == 0; k++) sb_drop(sb, producer_id, i + k);
+        i += n;
+    }
+
+    free(buf);
+    free(stamps);
+    return 0;
+}
+
+int producer_run(int out_fd, uint32_t producer_id, const config_t* cfg, stats_block_t* sb) {
+    if (set_nonblocking(out_fd) < 0) {
+        perror("producer fcntl O_NONBLOCK");
+        return 1;
+    }
+    if (cfg->batch > 1) return producer_run_batch(out_fd, producer_id, cfg, sb);
 
-int producer_run(int out_fd, uint32_t producer_id, const config_t* cfg) {
     // total bytes per message written in ONE call (header + payload)
     size_t msg_bytes = sizeof(msg_hdr_t) + cfg->msg_size;
 
@@ -21,22 +133,213 @@ int producer_run(int out_fd, uint32_t producer_id, const config_t* cfg) {
     hdr.producer_id = producer_id;
     hdr.payload_len = cfg->msg_size;
     hdr.crc32 = 0;
+    hdr.send_ns = 0;
+
+    pacer_t pacer;
+    pacer_init(&pacer, cfg, producer_id);
 
     for (uint32_t i = 0; i < cfg->messages_per_producer; i++) {
         hdr.seq = i;
+        if (pacer.active) pacer_take(&pacer, 1, &hdr.send_ns);
+        else if (cfg->latency) hdr.send_ns = lat_now_ns();
+        if (cfg->checksum) hdr.crc32 = crc32c_frame(&hdr, payload);
 
         // copy header into the front of msgbuf
         memcpy(msgbuf, &hdr, sizeof(hdr));
 
         // atomic message write (header+payload together)
-        if (write_all(out_fd, msgbuf, msg_bytes) < 0) {
+        int rc = write_frames(out_fd, msgbuf, msg_bytes, cfg, &sb->prod[producer_id]);
+        if (rc < 0) {
             perror("producer write message");
             free(msgbuf);
             return 2;
         }
+        if (rc == 0) sb_drop(sb, producer_id, i);
     }
 
     free(msgbuf);
     return 0;
 }
 
+
+// Zero-copy path (fan-in only, so each pipe has one writer): frames live in
+// page-aligned buffers that are gifted to the pipe with vmsplice instead of
+// being copied in. The pipe then references our pages, so a buffer can only be
+// rewritten once it has drained; we rotate through more buffers than the pipe
+// has slots (each frame takes at least one), plus one batch of headroom.
+int producer_run_zerocopy(int out_fd, uint32_t producer_id, const config_t* cfg) {
+    size_t msg_bytes = sizeof(msg_hdr_t) + cfg->msg_size;
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t frame_alloc = (msg_bytes + page - 1) / page * page;
+    uint32_t batch = cfg->batch;
+
+    int pipe_bytes = fcntl(out_fd, F_GETPIPE_SZ);
+    if (pipe_bytes <= 0) pipe_bytes = 65536;
+    size_t nbuf = (size_t)pipe_bytes / page + batch + 1;
+
+    unsigned char* pool = NULL;
+    struct iovec* iov = (struct iovec*)malloc(sizeof(struct iovec) * batch);
+    uint64_t* stamps = (uint64_t*)malloc(sizeof(uint64_t) * batch);
+    if (!iov || !stamps || posix_memalign((void**)&pool, page, frame_alloc * nbuf) != 0) {
+        free(iov);
+        free(stamps);
+        return 1;
+    }
+    for (size_t b = 0; b < nbuf; b++) {
+        memset(pool + b * frame_alloc + sizeof(msg_hdr_t), 'A' + (producer_id % 26), cfg->msg_size);
+    }
+
+    msg_hdr_t hdr;
+    hdr.producer_id = producer_id;
+    hdr.payload_len = cfg->msg_size;
+    hdr.crc32 = 0;
+    hdr.send_ns = 0;
+
+    pacer_t pacer;
+    pacer_init(&pacer, cfg, producer_id);
+
+    size_t next = 0;
+    int rc = 0;
+    uint32_t i = 0;
+    while (i < cfg->messages_per_producer && rc == 0) {
+        uint32_t n = cfg->messages_per_producer - i;
+        if (n > batch) n = batch;
+        if (pacer.active) n = pacer_take(&pacer, n, stamps);
+        else if (cfg->latency) hdr.send_ns = lat_now_ns();
+        for (uint32_t k = 0; k < n; k++) {
+            unsigned char* frame = pool + next * frame_alloc;
+            next = (next + 1) % nbuf;
+            hdr.seq = i + k;
+            if (pacer.active) hdr.send_ns = stamps[k];
+            if (cfg->checksum) hdr.crc32 = crc32c_frame(&hdr, frame + sizeof(msg_hdr_t));
+            memcpy(frame, &hdr, sizeof(hdr));
+            iov[k].iov_base = frame;
+            iov[k].iov_len = msg_bytes;
+        }
+
+        // vmsplice may take only part of the vector when the pipe fills up
+        struct iovec* v = iov;
+        int left = (int)n;
+        while (left > 0) {
+            ssize_t w = vmsplice(out_fd, v, (unsigned long)left, SPLICE_F_GIFT);
+            if (w < 0) {
+                if (errno == EINTR) continue;
+                perror("producer vmsplice");
+                rc = 2;
+                break;
+            }
+            while (left > 0 && (size_t)w >= v->iov_len) {
+                w -= (ssize_t)v->iov_len;
+                v++;
+                left--;
+            }
+            if (left > 0) {
+                v->iov_base = (unsigned char*)v->iov_base + w;
+                v->iov_len -= (size_t)w;
+            }
+        }
+        i += n;
+    }
+
+    free(iov);
+    free(stamps);
+    free(pool);
+    return rc;
+}
+
+// io_uring path: `depth` buffers of up to cfg->batch frames each. Every free
+// buffer is queued as a write and the whole set goes to the kernel in one
+// io_uring_enter, which also waits for at least one completion. Writes stay
+// within PIPE_BUF (capped by the caller), so each lands atomically; the order
+// between in-flight writes doesn't matter to the consumers.
+int producer_run_uring(int out_fd, uint32_t producer_id, const config_t* cfg, uint32_t depth) {
+    size_t msg_bytes = sizeof(msg_hdr_t) + cfg->msg_size;
+    uint32_t batch = cfg->batch;
+
+    uring_t ring;
+    if (uring_init(&ring, depth) < 0) {
+        perror("producer io_uring_setup");
+        return 1;
+    }
+    unsigned char* pool = (unsigned char*)malloc(msg_bytes * batch * depth);
+    uint32_t* free_list = (uint32_t*)malloc(sizeof(uint32_t) * depth);
+    unsigned* lens = (unsigned*)malloc(sizeof(unsigned) * depth);
+    uint64_t* stamps = (uint64_t*)malloc(sizeof(uint64_t) * batch);
+    if (!pool || !free_list || !lens || !stamps) {
+        free(pool); free(free_list); free(lens); free(stamps);
+        uring_exit(&ring);
+        return 1;
+    }
+    for (uint32_t b = 0; b < depth; b++) {
+        free_list[b] = b;
+        for (uint32_t k = 0; k < batch; k++) {
+            memset(pool + (b * batch + k) * msg_bytes + sizeof(msg_hdr_t), 'A' + (producer_id % 26), cfg->msg_size);
+        }
+    }
+
+    msg_hdr_t hdr;
+    hdr.producer_id = producer_id;
+    hdr.payload_len = cfg->msg_size;
+    hdr.crc32 = 0;
+    hdr.send_ns = 0;
+
+    pacer_t pacer;
+    pacer_init(&pacer, cfg, producer_id);
+
+    uint32_t nfree = depth, inflight = 0, i = 0;
+    int rc = 0;
+    while ((i < cfg->messages_per_producer || inflight > 0) && rc == 0) {
+        // --rate: one buffer of whatever is due per submit, so nothing waits
+        // in an unsubmitted buffer for later messages to come due
+        int queued = 0;
+        while (nfree > 0 && i < cfg->messages_per_producer && !(pacer.active && queued)) {
+            struct io_uring_sqe* sqe = uring_get_sqe(&ring);
+            if (!sqe) break;
+            uint32_t b = free_list[--nfree];
+            unsigned char* buf = pool + (size_t)b * batch * msg_bytes;
+            uint32_t n = cfg->messages_per_producer - i;
+            if (n > batch) n = batch;
+            if (pacer.active) n = pacer_take(&pacer, n, stamps);
+            else if (cfg->latency) hdr.send_ns = lat_now_ns();
+            for (uint32_t k = 0; k < n; k++) {
+                hdr.seq = i + k;
+                if (pacer.active) hdr.send_ns = stamps[k];
+                if (cfg->checksum) hdr.crc32 = crc32c_frame(&hdr, buf + k * msg_bytes + sizeof(msg_hdr_t));
+                memcpy(buf + k * msg_bytes, &hdr, sizeof(hdr));
+            }
+            lens[b] = (unsigned)(n * msg_bytes);
+            uring_prep_rw(sqe, IORING_OP_WRITE, out_fd, buf, lens[b], b);
+            i += n;
+            inflight++;
+            queued++;
+        }
+
+        if (uring_submit_and_wait(&ring, 1) < 0) {
+            perror("producer io_uring_enter");
+            rc = 2;
+            break;
+        }
+
+        struct io_uring_cqe* cqe;
+        while ((cqe = uring_peek_cqe(&ring)) != NULL) {
+            uint32_t b = (uint32_t)cqe->user_data;
+            if (cqe->res != (int)lens[b]) {
+                // a short write would split frames, which the pipe never does below PIPE_BUF
+                errno = cqe->res < 0 ? -cqe->res : EIO;
+                perror("producer uring write");
+                rc = 2;
+            }
+            uring_cqe_seen(&ring);
+            free_list[nfree++] = b;
+            inflight--;
+        }
+    }
+
+    if (cfg->verbose) {
+        fprintf(stderr, "producer[%u]: io_uring_enter calls=%llu for %u messages\n", producer_id,
+                (unsigned long long)ring.enters, cfg->messages_per_producer);
+    }
+    uring_exit(&ring);
+    free(pool); free(free_list); free(lens); free(stamps);
+    return rc;
+}
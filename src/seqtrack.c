@@ -0,0 +1,97 @@
+#include "seqtrack.h"
+#include <stdlib.h>
+#include <string.h>
+
+static uint32_t pow2_at_least(uint32_t n) {
+    uint32_t w = 64;
+    while (w < n && w < SEQTRACK_MAX_WINDOW) w <<= 1;
+    return w;
+}
+
+seqtrack_t* seqtrack_new(uint32_t producers, uint32_t messages_per_producer) {
+    // Small runs get a window covering every seq, which never slides
+    uint32_t window = pow2_at_least(messages_per_producer);
+    if (window > SEQTRACK_WINDOW) window = SEQTRACK_WINDOW;
+
+    seqtrack_t* t = (seqtrack_t*)calloc(1, sizeof(*t));
+    if (!t) return NULL;
+    t->producers = producers;
+    t->win = (seqwin_t*)calloc(producers, sizeof(seqwin_t));
+    if (!t->win) {
+        free(t);
+        return NULL;
+    }
+    for (uint32_t p = 0; p < producers; p++) {
+        t->win[p].window = window;
+        t->win[p].bits = (uint64_t*)calloc(window / 64, sizeof(uint64_t));
+        if (!t->win[p].bits) {
+            seqtrack_free(t);
+            return NULL;
+        }
+    }
+    return t;
+}
+
+void seqtrack_free(seqtrack_t* t) {
+    if (!t) return;
+    for (uint32_t p = 0; p < t->producers; p++) free(t->win[p].bits);
+    free(t->win);
+    free(t);
+}
+
+// Clear the bits of seqs [from, from + n). The window is a power of two and a
+// multiple of 64, so a run inside one word never wraps.
+static void win_clear(seqwin_t* w, uint32_t from, uint32_t n) {
+    if (n >= w->window) {
+        memset(w->bits, 0, w->window / 8);
+        return;
+    }
+    while (n > 0) {
+        uint32_t i = from & (w->window - 1);
+        uint32_t off = i & 63;
+        uint32_t take = 64 - off;
+        if (take > n) take = n;
+        uint64_t mask = (take == 64) ? ~0ull : (((1ull << take) - 1) << off);
+        w->bits[i >> 6] &= ~mask;
+        from += take;
+        n -= take;
+    }
+}
+
+// Re-home the window into `window` bits, keeping what the old one knew
+static void win_grow(seqwin_t* w, uint32_t window) {
+    uint64_t* bits = (uint64_t*)calloc(window / 64, sizeof(uint64_t));
+    if (!bits) return; // keep tracking with the old window
+    uint32_t keep = (w->high < w->window) ? w->high : w->window;
+    for (uint32_t s = w->high - keep; s < w->high; s++) {
+        uint32_t i = s & (w->window - 1);
+        if (w->bits[i >> 6] & (1ull << (i & 63))) {
+            uint32_t j = s & (window - 1);
+            bits[j >> 6] |= 1ull << (j & 63);
+        }
+    }
+    free(w->bits);
+    w->bits = bits;
+    w->window = window;
+}
+
+seq_result_t seqtrack_mark(seqtrack_t* t, uint32_t producer, uint32_t seq) {
+    seqwin_t* w = &t->win[producer];
+    seq_result_t res = SEQ_NEW;
+
+    if (seq >= w->high) {
+        win_clear(w, w->high, seq - w->high + 1);
+        w->high = seq + 1;
+    } else if (w->high - seq > w->window) {
+        res = SEQ_LATE;
+        uint32_t dist = w->high - seq;
+        if (w->window < SEQTRACK_MAX_WINDOW) win_grow(w, pow2_at_least(dist > SEQTRACK_MAX_WINDOW ? dist : 2 * dist));
+        if (w->high - seq > w->window) return res; // still out of reach
+    }
+
+    uint32_t i = seq & (w->window - 1);
+    uint64_t bit = 1ull << (i & 63);
+    if (w->bits[i >> 6] & bit) return SEQ_DUP;
+    w->bits[i >> 6] |= bit;
+    return res;
+}
@@ -0,0 +1,1728 @@
+#define _GNU_SOURCE // mbind / sched_yield
+#include "shm_ring.h"
+#include "latency.h"
+#include "seqtrack.h"
+#include "crc32c.h"
+#include "pacer.h"
+#include "onfull.h"
+#include "prio.h"
+#include "work.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <semaphore.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+
+#define MAX_SLOTS 1024
+#define MAX_PAYLOAD 512
+#define SENTINEL_PRODUCER_ID 0xFFFFFFFFu
+#define CACHE_LINE 64
+#define LF_SPIN_LIMIT 128
+#define MIN_RING_BYTES 4096u
+#define MAX_RING_BYTES (1u << 29)
+#define HUGE_PAGE_BYTES (2u << 20)
+#define MPOL_BIND_MODE 2     // MPOL_BIND from <numaif.h>, which needs libnuma headers
+#define WQ_TIMEDOUT 1        // a wait with a deadline (onfull.h) gave up
+#define STEAL_POLL_NS 50000ull // idle stealing consumer: look at the other deques this often
+
+typedef struct {
+    msg_hdr_t hdr;
+    unsigned char payload[MAX_PAYLOAD];
+} shm_msg_t;
+
+// Where a blocked producer or consumer parks. `waiters` counts registered
+// sleepers; wake tokens go to `sem` (WAIT_SEM), the futex word `seq`
+// (WAIT_FUTEX) or the eventfd `efd` (WAIT_EVENTFD).
+typedef struct {
+    uint32_t waiters;
+    uint32_t seq;
+    sem_t sem;
+    int efd;             // EFD_SEMAPHORE eventfd, created before fork so the number is valid everywhere
+} waitq_t;
+
+// Slow-path counters, bumped only when a try fails (shared by all processes)
+typedef struct {
+    uint64_t spins;        // spin phases that ended without success
+    uint64_t yields;
+    uint64_t futex_waits;
+    uint64_t sem_waits;
+    uint64_t efd_waits;    // blocking eventfd reads
+    uint64_t wakes;        // sem_post / FUTEX_WAKE / eventfd writes issued by wakers
+} wait_stats_t;
+
+// One lane of the sem engine's K-lane ring (--priorities K): a bounded buffer
+// of `slots` messages at ring[k * slots], with its own empty semaphore and
+// mutex. shm_region_t.full counts messages across all lanes.
+typedef struct {
+    sem_t empty;
+    sem_t mutex;
+    uint32_t write_idx;
+    uint32_t read_idx;
+    uint32_t count;      // messages queued; written under mutex, read without it as a hint
+} __attribute__((aligned(CACHE_LINE))) lane_t;
+
+struct shm_region {
+    sem_t empty;
+    sem_t full;
+    sem_t mutex;
+
+    uint32_t write_idx;
+    uint32_t read_idx;
+
+    uint32_t slots;      // configured ring size
+    uint32_t msg_size;   // configured payload size
+    uint32_t engine;     // engine_t
+    uint32_t topology;   // topology_t
+    uint32_t producers;
+    uint32_t spsc_stride; // bytes per spsc_ring_t (incl. slots) following this struct
+    uint32_t ring_bytes;  // byte ring capacity (power of two), ENGINE_BYTES only
+    uint32_t ring_mask;   // ring_bytes - 1
+    uint32_t wait_policy; // wait_policy_t
+    uint32_t lanes;       // priority lanes (sem engine), 1 = the plain FIFO ring
+    uint32_t starve_limit; // --starve-limit: passes before a waiting lower lane is served, 0 = strict
+    uint32_t consumers;
+    uint32_t consumer_mode; // consumer_mode_t
+    uint32_t deque_stride;  // bytes per steal_deque_t (incl. slots), CONSUMER_STEAL only
+    uint32_t deque_mask;    // deque slots - 1
+    uint64_t deque_offset;  // first steal_deque_t, from the start of this struct
+
+    // Lock-free engine state. Producers claim positions from tail, consumers
+    // from head; each lives on its own cache line so the two sides don't
+    // false-share. Blocked callers park on space_wq / data_wq instead of empty/full.
+    // The byte ring reuses head/tail as monotonically increasing byte offsets.
+    uint64_t tail __attribute__((aligned(CACHE_LINE)));
+    uint64_t head __attribute__((aligned(CACHE_LINE)));
+    waitq_t space_wq __attribute__((aligned(CACHE_LINE))); // producers waiting for room
+    waitq_t data_wq __attribute__((aligned(CACHE_LINE)));  // consumers waiting for data
+    wait_stats_t wait_stats __attribute__((aligned(CACHE_LINE)));
+
+    // slot_seq[i] == pos      -> slot free for the producer claiming pos
+    // slot_seq[i] == pos + 1  -> slot holds the message written at pos
+    uint64_t slot_seq[MAX_SLOTS] __attribute__((aligned(CACHE_LINE)));
+
+    lane_t lane[MAX_PRIORITIES];
+
+    // Data area, sized at startup: `slots` messages for the shared ring (per
+    // lane with --priorities), the per-producer rings for spsc, or
+    // `ring_bytes` of records for the byte ring.
+    shm_msg_t ring[] __attribute__((aligned(CACHE_LINE)));
+};
+
+// Byte ring record: [rec_hdr_t][msg_hdr_t][payload], padded to 8 bytes so the
+// next header stays aligned. Records never straddle the end of the ring; a
+// REC_PAD record fills the tail end and the writer continues at offset 0.
+typedef struct {
+    uint32_t len;        // total record bytes, including this header
+    uint32_t flags;
+} rec_hdr_t;
+
+#define REC_PAD 1u
+
+typedef int (*wq_try_fn)(shm_region_t* shm, void* arg);
+
+// Per-producer ring for TOPOLOGY_SPSC, laid out back to back after
+// shm_region_t in the same mapping. Only the owning producer writes `tail`,
+// so publishing is a plain release store. Consumers take turns on a ring by
+// claiming `owner`; whoever holds it is the single consumer for that drain.
+typedef struct {
+    uint64_t tail __attribute__((aligned(CACHE_LINE)));
+    uint32_t closed;         // producer finished; set after its last publish
+
+    uint64_t head __attribute__((aligned(CACHE_LINE)));
+    uint32_t owner;          // 0 = unclaimed, else consumer id + 1
+
+    waitq_t space_wq __attribute__((aligned(CACHE_LINE))); // producer parks here when full
+
+    shm_msg_t ring[] __attribute__((aligned(CACHE_LINE)));
+} spsc_ring_t;
+
+#define SPSC_DRAIN_MAX 64    // messages taken per ownership claim
+
+// Chase-Lev deque of one consumer for --consumer-mode steal, laid out back to
+// back after the ring in the same mapping. The owner pushes and pops at
+// `bottom`; other consumers steal from `top` with a CAS, so a steal that
+// loses a race just discards what it copied.
+typedef struct {
+    int64_t top __attribute__((aligned(CACHE_LINE)));
+    int64_t bottom __attribute__((aligned(CACHE_LINE)));
+    shm_msg_t buf[] __attribute__((aligned(CACHE_LINE)));
+} steal_deque_t;
+
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+// Copy the header plus only the payload bytes in use, never the whole
+// MAX_PAYLOAD slot.
+static void msg_copy(shm_msg_t* dst, const shm_msg_t* src) {
+    uint32_t len = src->hdr.payload_len;
+    if (len > MAX_PAYLOAD) len = MAX_PAYLOAD;
+    dst->hdr = src->hdr;
+    memcpy(dst->payload, src->payload, len);
+}
+
+// Buffer for one frame of up to max(msg_size, MAX_PAYLOAD) payload bytes, so
+// it also holds a byte-ring frame (--engine bytes allows larger messages)
+static shm_msg_t* frame_alloc(size_t msg_size) {
+    if (msg_size < MAX_PAYLOAD) msg_size = MAX_PAYLOAD;
+    return (shm_msg_t*)malloc(offsetof(shm_msg_t, payload) + msg_size);
+}
+
+static void frame_copy(shm_msg_t* dst, const shm_msg_t* src, size_t cap) {
+    uint32_t len = src->hdr.payload_len;
+    if (len > cap) len = (uint32_t)cap;
+    dst->hdr = src->hdr;
+    memcpy(dst->payload, src->payload, len);
+}
+
+// Handle for a ring slot between reserve/commit (producer) or peek/release
+// (consumer). `msg` points straight into shared memory.
+typedef struct {
+    shm_msg_t* msg;
+    uint64_t pos;        // claimed ring position (lock-free) or byte offset (byte ring)
+    uint32_t lane;       // priority lane (--priorities), set by the producer before reserve
+} slot_ref_t;
+
+// Take one token from a counting semaphore: wait with no deadline (0), try
+// once (ONFULL_NOW) or wait until the deadline. 0, WQ_TIMEDOUT or -1.
+static int sem_take(sem_t* sem, uint64_t deadline) {
+    if (!deadline) return sem_wait(sem) < 0 ? -1 : 0;
+    if (deadline == ONFULL_NOW) {
+        if (sem_trywait(sem) == 0) return 0;
+        return errno == EAGAIN ? WQ_TIMEDOUT : -1;
+    }
+    struct timespec ts;
+    onfull_realtime(deadline, &ts);
+    while (sem_timedwait(sem, &ts) < 0) {
+        if (errno == ETIMEDOUT) return WQ_TIMEDOUT;
+        if (errno != EINTR) return -1;
+    }
+    return 0;
+}
+
+// Semaphore engine: the slot is filled/inspected in place while `mutex` is
+// held, i.e. inside the same critical section the old struct copy used.
+static int sem_reserve_slot(shm_region_t* shm, shm_msg_t** msg_out, uint64_t deadline) {
+    int rc = sem_take(&shm->empty, deadline);
+    if (rc != 0) return rc;
+    if (sem_wait(&shm->mutex) < 0) return -1;
+    *msg_out = &shm->ring[shm->write_idx];
+    return 0;
+}
+
+static int sem_commit_slot(shm_region_t* shm) {
+    shm->write_idx = (shm->write_idx + 1) % shm->slots;
+    if (sem_post(&shm->mutex) < 0) return -1;
+    if (sem_post(&shm->full) < 0) return -1;
+    return 0;
+}
+
+static shm_msg_t* sem_peek_slot(shm_region_t* shm) {
+    if (sem_wait(&shm->full) < 0) return NULL;
+    if (sem_wait(&shm->mutex) < 0) return NULL;
+    return &shm->ring[shm->read_idx];
+}
+
+static int sem_release_slot(shm_region_t* shm) {
+    shm->read_idx = (shm->read_idx + 1) % shm->slots;
+    if (sem_post(&shm->mutex) < 0) return -1;
+    if (sem_post(&shm->empty) < 0) return -1;
+    return 0;
+}
+
+// K-lane ring: a producer queues in its message's lane exactly as the plain
+// sem engine does. A consumer takes one `full` token, then the head of the
+// highest non-empty lane, unless some lower lane has waited through
+// starve_limit of this consumer's pops in a row; that lane goes first. A
+// sentinel (lane 0) is only taken once every higher lane is empty.
+typedef struct {
+    uint32_t passed[MAX_PRIORITIES]; // consecutive pops that skipped a non-empty lane
+} lane_sched_t;
+
+static uint32_t lane_count(shm_region_t* shm, uint32_t k) {
+    return __atomic_load_n(&shm->lane[k].count, __ATOMIC_RELAXED);
+}
+
+static shm_msg_t* lane_slot(shm_region_t* shm, uint32_t k, uint32_t idx) {
+    return &shm->ring[(size_t)k * shm->slots + idx];
+}
+
+static int lane_reserve(shm_region_t* shm, slot_ref_t* ref, uint64_t deadline) {
+    lane_t* l = &shm->lane[ref->lane];
+    int rc = sem_take(&l->empty, deadline);
+    if (rc != 0) return rc;
+    if (sem_wait(&l->mutex) < 0) return -1;
+    ref->msg = lane_slot(shm, ref->lane, l->write_idx);
+    return 0;
+}
+
+static int lane_commit(shm_region_t* shm, slot_ref_t* ref) {
+    lane_t* l = &shm->lane[ref->lane];
+    l->write_idx = (l->write_idx + 1) % shm->slots;
+    __atomic_store_n(&l->count, l->count + 1, __ATOMIC_RELAXED);
+    if (sem_post(&l->mutex) < 0) return -1;
+    if (sem_post(&shm->full) < 0) return -1;
+    return 0;
+}
+
+// Highest non-empty lane, or a starved lower one; -1 if all look empty
+static int lane_pick(shm_region_t* shm, const lane_sched_t* ls) {
+    int top = -1;
+    for (int k = (int)shm->lanes - 1; k >= 0 && top < 0; k--) {
+        if (lane_count(shm, (uint32_t)k)) top = k;
+    }
+    if (shm->starve_limit) {
+        for (int k = 0; k < top; k++) {
+            if (ls->passed[k] >= shm->starve_limit && lane_count(shm, (uint32_t)k)) return k;
+        }
+    }
+    return top;
+}
+
+// A retry in lane_peek() waits on other consumers finishing their pops,
+// which post nothing to sleep on: spin a little, then give up the CPU so
+// they can run (on one CPU a bare spin only delays them).
+static void lane_backoff(int* tries) {
+    if (++*tries < LF_SPIN_LIMIT) {
+        cpu_relax();
+        return;
+    }
+    *tries = 0;
+    sched_yield();
+}
+
+static int lane_peek(shm_region_t* shm, lane_sched_t* ls, slot_ref_t* ref) {
+    if (sem_wait(&shm->full) < 0) return -1;
+    // The token guarantees a message in some lane, but another consumer may
+    // take the one we saw first; then back off and look again.
+    int tries = 0;
+    for (;;) {
+        int k = lane_pick(shm, ls);
+        if (k < 0) {
+            lane_backoff(&tries);
+            continue;
+        }
+        lane_t* l = &shm->lane[k];
+        if (sem_wait(&l->mutex) < 0) return -1;
+        if (l->count == 0) {
+            sem_post(&l->mutex);
+            lane_backoff(&tries);
+            continue;
+        }
+        shm_msg_t* msg = lane_slot(shm, (uint32_t)k, l->read_idx);
+        if (msg->hdr.producer_id == SENTINEL_PRODUCER_ID) {
+            int busy = 0;
+            for (uint32_t j = (uint32_t)k + 1; j < shm->lanes; j++) busy |= lane_count(shm, j) != 0;
+            if (busy) {
+                sem_post(&l->mutex);
+                ls->passed[k] = 0;
+                lane_backoff(&tries);
+                continue;
+            }
+        }
+        for (int j = 0; j < k; j++) ls->passed[j] = lane_count(shm, (uint32_t)j) ? ls->passed[j] + 1 : 0;
+        ls->passed[k] = 0;
+        ref->lane = (uint32_t)k;
+        ref->msg = msg;
+        return 0;
+    }
+}
+
+static int lane_release(shm_region_t* shm, slot_ref_t* ref) {
+    lane_t* l = &shm->lane[ref->lane];
+    l->read_idx = (l->read_idx + 1) % shm->slots;
+    __atomic_store_n(&l->count, l->count - 1, __ATOMIC_RELAXED);
+    if (sem_post(&l->mutex) < 0) return -1;
+    if (sem_post(&l->empty) < 0) return -1;
+    return 0;
+}
+
+// Bounded MPMC ring (Vyukov style). A producer may claim position `pos` once
+// slot_seq says the slot is free for it, fills the slot, then publishes by
+// storing pos + 1; a consumer claims pos once it sees pos + 1 and retires the
+// slot for the next lap by storing pos + slots.
+// Returns 1 if a position was claimed, 0 if the ring is full.
+static int lf_try_reserve(shm_region_t* shm, uint64_t* pos_out) {
+    uint64_t pos = __atomic_load_n(&shm->tail, __ATOMIC_RELAXED);
+    for (;;) {
+        uint64_t seq = __atomic_load_n(&shm->slot_seq[pos % shm->slots], __ATOMIC_ACQUIRE);
+        int64_t dif = (int64_t)(seq - pos);
+        if (dif == 0) {
+            if (__atomic_compare_exchange_n(&shm->tail, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                *pos_out = pos;
+                return 1;
+            }
+            // CAS failure reloaded pos; retry
+        } else if (dif < 0) {
+            return 0;
+        } else {
+            pos = __atomic_load_n(&shm->tail, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+// Returns 1 if a filled position was claimed, 0 if the ring is empty.
+static int lf_try_acquire(shm_region_t* shm, uint64_t* pos_out) {
+    uint64_t pos = __atomic_load_n(&shm->head, __ATOMIC_RELAXED);
+    for (;;) {
+        uint64_t seq = __atomic_load_n(&shm->slot_seq[pos % shm->slots], __ATOMIC_ACQUIRE);
+        int64_t dif = (int64_t)(seq - (pos + 1));
+        if (dif == 0) {
+            if (__atomic_compare_exchange_n(&shm->head, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                *pos_out = pos;
+                return 1;
+            }
+        } else if (dif < 0) {
+            return 0;
+        } else {
+            pos = __atomic_load_n(&shm->head, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+static shm_msg_t* lf_slot(shm_region_t* shm, uint64_t pos) {
+    return &shm->ring[pos % shm->slots];
+}
+
+static void lf_publish(shm_region_t* shm, uint64_t pos) {
+    __atomic_store_n(&shm->slot_seq[pos % shm->slots], pos + 1, __ATOMIC_RELEASE);
+}
+
+static void lf_retire(shm_region_t* shm, uint64_t pos) {
+    __atomic_store_n(&shm->slot_seq[pos % shm->slots], pos + shm->slots, __ATOMIC_RELEASE);
+}
+
+// ---------------------------------------------------------------------------
+// Wait strategy layer. Everything except the sem engine blocks through a
+// waitq_t: spin on the try/ready check with `pause`, then depending on
+// --wait keep spinning, sched_yield(), sleep on a futex, or sleep on a
+// semaphore. Wakers only pay for a syscall when a sleeper is registered.
+// ---------------------------------------------------------------------------
+
+static long futex_op(uint32_t* uaddr, int op, uint32_t val, const struct timespec* timeout) {
+    // Not FUTEX_PRIVATE_FLAG: the word lives in a MAP_SHARED region
+    return syscall(SYS_futex, uaddr, op, val, timeout, NULL, 0);
+}
+
+static void wait_count(uint64_t* counter) {
+    __atomic_fetch_add(counter, 1, __ATOMIC_RELAXED);
+}
+
+static int sem_wait_retry(sem_t* sem) {
+    while (sem_wait(sem) < 0) {
+        if (errno != EINTR) return -1;
+    }
+    return 0;
+}
+
+static int wq_init(waitq_t* wq, wait_policy_t policy, int pshared) {
+    wq->efd = -1;
+    if (sem_init(&wq->sem, pshared, 0) < 0) return -1;
+    if (policy == WAIT_EVENTFD) {
+        wq->efd = eventfd(0, EFD_SEMAPHORE | EFD_NONBLOCK | EFD_CLOEXEC);
+        if (wq->efd < 0) return -1;
+    }
+    return 0;
+}
+
+static void wq_destroy(waitq_t* wq) {
+    sem_destroy(&wq->sem);
+    if (wq->efd >= 0) close(wq->efd);
+}
+
+// Sleeping policies (WAIT_SEM, WAIT_FUTEX, WAIT_EVENTFD) share one protocol:
+// a sleeper registers in `waiters` before its final re-check; a waker claims
+// one registration and hands over one token, so a burst of pushes wakes once,
+// not once per message. Tokens live in `sem` for WAIT_SEM, in the futex word
+// `seq` (a minimal futex semaphore) for WAIT_FUTEX, and in the EFD_SEMAPHORE
+// counter for WAIT_EVENTFD, where a read takes exactly one. With a deadline
+// (lat_now_ns() clock, 0 = none) the sleep gives up with WQ_TIMEDOUT.
+static int wq_take_token(shm_region_t* shm, waitq_t* wq, uint64_t deadline) {
+    struct timespec left;
+    if (shm->wait_policy == WAIT_EVENTFD) {
+        // Non-blocking eventfd, so the sleep in ppoll() can carry a timeout
+        uint64_t one;
+        wait_count(&shm->wait_stats.efd_waits);
+        for (;;) {
+            if (read(wq->efd, &one, sizeof(one)) == (ssize_t)sizeof(one)) return 0;
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN) return -1;
+            if (deadline) {
+                uint64_t now = lat_now_ns();
+                if (now >= deadline) return WQ_TIMEDOUT;
+                onfull_remaining(deadline, now, &left);
+            }
+            struct pollfd pfd = { wq->efd, POLLIN, 0 };
+            if (ppoll(&pfd, 1, deadline ? &left : NULL, NULL) < 0 && errno != EINTR) return -1;
+        }
+    }
+    if (shm->wait_policy != WAIT_FUTEX) {
+        wait_count(&shm->wait_stats.sem_waits);
+        return sem_take(&wq->sem, deadline);
+    }
+    for (;;) {
+        uint32_t t = __atomic_load_n(&wq->seq, __ATOMIC_ACQUIRE);
+        while (t > 0) {
+            if (__atomic_compare_exchange_n(&wq->seq, &t, t - 1, 1, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+                return 0;
+        }
+        if (deadline) {
+            uint64_t now = lat_now_ns();
+            if (now >= deadline) return WQ_TIMEDOUT;
+            onfull_remaining(deadline, now, &left);
+        }
+        wait_count(&shm->wait_stats.futex_waits);
+        if (futex_op(&wq->seq, FUTEX_WAIT, 0, deadline ? &left : NULL) < 0 && errno != EAGAIN &&
+            errno != EINTR && errno != ETIMEDOUT) {
+            return -1;
+        }
+    }
+}
+
+static int wq_give_token(shm_region_t* shm, waitq_t* wq) {
+    wait_count(&shm->wait_stats.wakes);
+    if (shm->wait_policy == WAIT_EVENTFD) {
+        uint64_t one = 1;
+        return write(wq->efd, &one, sizeof(one)) == (ssize_t)sizeof(one) ? 0 : -1;
+    }
+    if (shm->wait_policy != WAIT_FUTEX) return sem_post(&wq->sem);
+    __atomic_fetch_add(&wq->seq, 1, __ATOMIC_RELEASE);
+    return futex_op(&wq->seq, FUTEX_WAKE, 1, NULL) < 0 ? -1 : 0;
+}
+
+// The re-check succeeded after registering: drop the registration, or, when
+// a waker already claimed it, swallow the token that waker handed over.
+static int wq_cancel(shm_region_t* shm, waitq_t* wq) {
+    uint32_t n = __atomic_load_n(&wq->waiters, __ATOMIC_RELAXED);
+    while (n > 0) {
+        if (__atomic_compare_exchange_n(&wq->waiters, &n, n - 1, 1, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+            return 0;
+    }
+    return wq_take_token(shm, wq, 0);
+}
+
+// Block until try_fn(shm, arg) returns nonzero. try_fn is either the claim
+// itself (lock-free ring) or a side-effect-free readiness check. With a
+// deadline (onfull.h; 0 = none) give up with WQ_TIMEDOUT once it passes;
+// ONFULL_NOW makes this a single try.
+static int wq_wait(shm_region_t* shm, waitq_t* wq, wq_try_fn try_fn, void* arg, uint64_t deadline) {
+    for (;;) {
+        for (int spin = 0; spin < LF_SPIN_LIMIT; spin++) {
+            if (try_fn(shm, arg)) return 0;
+            if (deadline && lat_now_ns() >= deadline) return WQ_TIMEDOUT;
+            cpu_relax();
+        }
+        wait_count(&shm->wait_stats.spins);
+
+        if (shm->wait_policy == WAIT_SPIN) continue;
+        if (shm->wait_policy == WAIT_YIELD) {
+            wait_count(&shm->wait_stats.yields);
+            sched_yield();
+            continue;
+        }
+
+        __atomic_fetch_add(&wq->waiters, 1, __ATOMIC_SEQ_CST);
+        if (try_fn(shm, arg)) return wq_cancel(shm, wq);
+        int rc = wq_take_token(shm, wq, deadline);
+        if (rc == WQ_TIMEDOUT) return wq_cancel(shm, wq) < 0 ? -1 : WQ_TIMEDOUT;
+        if (rc < 0) return -1;
+    }
+}
+
+// The seq_cst fence pairs with the sleeper's registration: either the sleeper
+// sees our publish on its re-check, or we see it registered here.
+static int wq_wake_n(shm_region_t* shm, waitq_t* wq, uint32_t max) {
+    wait_policy_t policy = (wait_policy_t)shm->wait_policy;
+    if (policy == WAIT_SPIN || policy == WAIT_YIELD) return 0; // nobody ever sleeps
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    uint32_t n = __atomic_load_n(&wq->waiters, __ATOMIC_RELAXED);
+    while (n > 0) {
+        uint32_t take = n < max ? n : max;
+        if (__atomic_compare_exchange_n(&wq->waiters, &n, n - take, 1, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+            for (uint32_t k = 0; k < take; k++) {
+                if (wq_give_token(shm, wq) < 0) return -1;
+            }
+            return 0;
+        }
+    }
+    return 0;
+}
+
+static int wq_wake(shm_region_t* shm, waitq_t* wq) {
+    return wq_wake_n(shm, wq, 1);
+}
+
+static int wq_wake_all(shm_region_t* shm, waitq_t* wq) {
+    return wq_wake_n(shm, wq, UINT32_MAX >> 1);
+}
+
+static int lf_try_reserve_fn(shm_region_t* shm, void* arg) {
+    return lf_try_reserve(shm, (uint64_t*)arg);
+}
+
+static int lf_try_acquire_fn(shm_region_t* shm, void* arg) {
+    return lf_try_acquire(shm, (uint64_t*)arg);
+}
+
+// Blocking claim of a free position (until deadline, 0 = none)
+static int lf_reserve(shm_region_t* shm, uint64_t* pos_out, uint64_t deadline) {
+    return wq_wait(shm, &shm->space_wq, lf_try_reserve_fn, pos_out, deadline);
+}
+
+// Blocking claim of a filled position (until deadline, 0 = none)
+static int lf_acquire(shm_region_t* shm, uint64_t* pos_out, uint64_t deadline) {
+    return wq_wait(shm, &shm->data_wq, lf_try_acquire_fn, pos_out, deadline);
+}
+
+static uint32_t rec_bytes(uint32_t payload_len) {
+    return ((uint32_t)(sizeof(rec_hdr_t) + sizeof(msg_hdr_t)) + payload_len + 7u) & ~7u;
+}
+
+static rec_hdr_t* bytes_rec(shm_region_t* shm, uint64_t pos) {
+    return (rec_hdr_t*)((unsigned char*)shm->ring + (pos & shm->ring_mask));
+}
+
+// The message inside a record. Only hdr + payload_len bytes are valid, which
+// is all the reserve/peek callers ever touch.
+static shm_msg_t* bytes_msg(rec_hdr_t* rec) {
+    return (shm_msg_t*)(rec + 1);
+}
+
+// Byte ring: producers and consumers serialize on `mutex` (held from
+// reserve to commit, or peek to release) and block through space_wq/data_wq
+// when there is no room or no data.
+static int bytes_has_space(shm_region_t* shm, void* arg) {
+    uint64_t need = *(const uint64_t*)arg;
+    uint64_t used = __atomic_load_n(&shm->tail, __ATOMIC_ACQUIRE) - __atomic_load_n(&shm->head, __ATOMIC_ACQUIRE);
+    return shm->ring_bytes - used >= need;
+}
+
+static int bytes_has_data(shm_region_t* shm, void* arg) {
+    (void)arg;
+    return __atomic_load_n(&shm->tail, __ATOMIC_ACQUIRE) != __atomic_load_n(&shm->head, __ATOMIC_ACQUIRE);
+}
+
+// 0 with *msg_out set, WQ_TIMEDOUT if deadline (0 = none) passed, or -1
+static int bytes_reserve(shm_region_t* shm, uint64_t* pos_out, shm_msg_t** msg_out, uint64_t deadline) {
+    uint32_t need = rec_bytes(shm->msg_size);
+    for (;;) {
+        if (sem_wait_retry(&shm->mutex) < 0) return -1;
+
+        uint64_t tail = shm->tail;
+        uint32_t till_end = shm->ring_bytes - (uint32_t)(tail & shm->ring_mask);
+        uint64_t total = need + (need > till_end ? till_end : 0);
+        uint64_t used = tail - __atomic_load_n(&shm->head, __ATOMIC_ACQUIRE);
+        if (shm->ring_bytes - used >= total) {
+            if (need > till_end) {
+                rec_hdr_t* pad = bytes_rec(shm, tail);
+                pad->len = till_end;
+                pad->flags = REC_PAD;
+                tail += till_end;
+            }
+            rec_hdr_t* rec = bytes_rec(shm, tail);
+            rec->len = need;
+            rec->flags = 0;
+            *pos_out = tail;
+            *msg_out = bytes_msg(rec);
+            return 0;
+        }
+        if (sem_post(&shm->mutex) < 0) return -1;
+        int rc = wq_wait(shm, &shm->space_wq, bytes_has_space, &total, deadline);
+        if (rc != 0) return rc;
+    }
+}
+
+static int bytes_commit(shm_region_t* shm, uint64_t pos) {
+    __atomic_store_n(&shm->tail, pos + bytes_rec(shm, pos)->len, __ATOMIC_RELEASE);
+    if (sem_post(&shm->mutex) < 0) return -1;
+    return wq_wake(shm, &shm->data_wq);
+}
+
+static shm_msg_t* bytes_peek(shm_region_t* shm, uint64_t* pos_out) {
+    for (;;) {
+        if (sem_wait_retry(&shm->mutex) < 0) return NULL;
+
+        uint64_t head = shm->head;
+        while (head != __atomic_load_n(&shm->tail, __ATOMIC_ACQUIRE)) {
+            rec_hdr_t* rec = bytes_rec(shm, head);
+            if (rec->flags & REC_PAD) {
+                head += rec->len;
+                __atomic_store_n(&shm->head, head, __ATOMIC_RELEASE);
+                continue;
+            }
+            *pos_out = head;
+            return bytes_msg(rec);
+        }
+        if (sem_post(&shm->mutex) < 0) return NULL;
+        if (wq_wait(shm, &shm->data_wq, bytes_has_data, NULL, 0) < 0) return NULL;
+    }
+}
+
+static int bytes_release(shm_region_t* shm, uint64_t pos) {
+    __atomic_store_n(&shm->head, pos + bytes_rec(shm, pos)->len, __ATOMIC_RELEASE);
+    if (sem_post(&shm->mutex) < 0) return -1;
+    return wq_wake(shm, &shm->space_wq);
+}
+
+static size_t spsc_stride(uint32_t slots) {
+    size_t bytes = sizeof(spsc_ring_t) + (size_t)slots * sizeof(shm_msg_t);
+    return (bytes + CACHE_LINE - 1) & ~(size_t)(CACHE_LINE - 1);
+}
+
+static spsc_ring_t* spsc_ring(shm_region_t* shm, uint32_t i) {
+    return (spsc_ring_t*)((char*)shm + sizeof(shm_region_t) + (size_t)i * shm->spsc_stride);
+}
+
+static int spsc_has_space(shm_region_t* shm, void* arg) {
+    spsc_ring_t* r = (spsc_ring_t*)arg;
+    return r->tail - __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) < shm->slots;
+}
+
+// Wait (until deadline, 0 = none) for a free slot in the producer's own ring
+// and hand it out in *slot_out for in-place filling; spsc_commit() publishes
+// it. 0, WQ_TIMEDOUT or -1.
+static int spsc_reserve(shm_region_t* shm, spsc_ring_t* r, shm_msg_t** slot_out, uint64_t deadline) {
+    uint64_t tail = r->tail; // only this producer writes it
+    if (tail - __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) >= shm->slots) {
+        int rc = wq_wait(shm, &r->space_wq, spsc_has_space, r, deadline);
+        if (rc != 0) return rc;
+    }
+    *slot_out = &r->ring[tail % shm->slots];
+    return 0;
+}
+
+static int spsc_commit(shm_region_t* shm, spsc_ring_t* r) {
+    __atomic_store_n(&r->tail, r->tail + 1, __ATOMIC_RELEASE);
+    return wq_wake(shm, &shm->data_wq);
+}
+
+static int spsc_close(shm_region_t* shm, spsc_ring_t* r) {
+    __atomic_store_n(&r->closed, 1, __ATOMIC_RELEASE);
+    return wq_wake_all(shm, &shm->data_wq);
+}
+
+// Nonzero if some ring has unclaimed messages, or every ring is closed and
+// drained (so a consumer about to park should look again instead).
+static int spsc_should_scan(shm_region_t* shm, void* arg) {
+    (void)arg;
+    int all_done = 1;
+    for (uint32_t i = 0; i < shm->producers; i++) {
+        spsc_ring_t* r = spsc_ring(shm, i);
+        uint32_t closed = __atomic_load_n(&r->closed, __ATOMIC_ACQUIRE);
+        uint64_t tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+        uint64_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+        if (tail != head) {
+            if (__atomic_load_n(&r->owner, __ATOMIC_RELAXED) == 0) return 1;
+            all_done = 0;
+        } else if (!closed) {
+            all_done = 0;
+        }
+    }
+    return all_done;
+}
+
+// Reserve up to n tokens from a counting semaphore: wait for the first one
+// (sem_take(), so 0 if the deadline passes first), then take whatever else is
+// already available without sleeping.
+static int sem_reserve(sem_t* sem, int n, uint64_t deadline) {
+    int rc = sem_take(sem, deadline);
+    if (rc != 0) return rc == WQ_TIMEDOUT ? 0 : -1;
+    int got = 1;
+    while (got < n && sem_trywait(sem) == 0) got++;
+    return got;
+}
+
+// Push up to n messages under one mutex hold. Returns how many were pushed
+// (at least 1 unless the deadline passed first), or -1 on error.
+static int sem_queue_push_batch(shm_region_t* shm, const shm_msg_t* msgs, int n, uint64_t deadline) {
+    int k = sem_reserve(&shm->empty, n, deadline);
+    if (k <= 0) return k;
+    if (sem_wait(&shm->mutex) < 0) return -1;
+
+    for (int j = 0; j < k; j++) {
+        msg_copy(&shm->ring[shm->write_idx], &msgs[j]);
+        shm->write_idx = (shm->write_idx + 1) % shm->slots;
+    }
+
+    if (sem_post(&shm->mutex) < 0) return -1;
+    for (int j = 0; j < k; j++) {
+        if (sem_post(&shm->full) < 0) return -1;
+    }
+    return k;
+}
+
+// Pop up to n messages under one mutex hold, stopping after a sentinel so a
+// consumer never takes another consumer's shutdown marker. Reserved tokens
+// that were not used are handed back to `full`. 0 if the deadline passed.
+static int sem_queue_pop_batch(shm_region_t* shm, shm_msg_t* out, int n, uint64_t deadline) {
+    int k = sem_reserve(&shm->full, n, deadline);
+    if (k <= 0) return k;
+    if (sem_wait(&shm->mutex) < 0) return -1;
+
+    int taken = 0;
+    while (taken < k) {
+        msg_copy(&out[taken], &shm->ring[shm->read_idx]);
+        shm->read_idx = (shm->read_idx + 1) % shm->slots;
+        if (out[taken++].hdr.producer_id == SENTINEL_PRODUCER_ID) break;
+    }
+
+    if (sem_post(&shm->mutex) < 0) return -1;
+    for (int j = taken; j < k; j++) {
+        if (sem_post(&shm->full) < 0) return -1;
+    }
+    for (int j = 0; j < taken; j++) {
+        if (sem_post(&shm->empty) < 0) return -1;
+    }
+    return taken;
+}
+
+// The lock-free ring has no multi-slot claim; batching here just defers the
+// waiter check to once per batch while the ring keeps up. Returns how many
+// were pushed, fewer than n only if the deadline passed.
+static int lf_push_batch(shm_region_t* shm, const shm_msg_t* msgs, int n, uint64_t deadline) {
+    for (int j = 0; j < n; j++) {
+        uint64_t pos;
+        if (!lf_try_reserve(shm, &pos)) {
+            // Wake for what we already published before we (maybe) park
+            if (wq_wake(shm, &shm->data_wq) < 0) return -1;
+            int rc = lf_reserve(shm, &pos, deadline);
+            if (rc == WQ_TIMEDOUT) return j;
+            if (rc < 0) return -1;
+        }
+        msg_copy(lf_slot(shm, pos), &msgs[j]);
+        lf_publish(shm, pos);
+    }
+    if (wq_wake(shm, &shm->data_wq) < 0) return -1;
+    return n;
+}
+
+static int lf_pop_batch(shm_region_t* shm, shm_msg_t* out, int n, uint64_t deadline) {
+    uint64_t pos;
+    int rc = lf_acquire(shm, &pos, deadline);
+    if (rc != 0) return rc == WQ_TIMEDOUT ? 0 : -1;
+    int taken = 0;
+    for (;;) {
+        msg_copy(&out[taken], lf_slot(shm, pos));
+        lf_retire(shm, pos);
+        if (out[taken++].hdr.producer_id == SENTINEL_PRODUCER_ID) break;
+        if (taken == n || !lf_try_acquire(shm, &pos)) break;
+    }
+    if (wq_wake(shm, &shm->space_wq) < 0) return -1;
+    return taken;
+}
+
+// Publish all n messages with one release store per run of free slots.
+// Returns how many were published, fewer than n only if the deadline passed.
+static int spsc_push_batch(shm_region_t* shm, spsc_ring_t* r, const shm_msg_t* msgs, int n, uint64_t deadline) {
+    uint64_t tail = r->tail;
+    int done = 0;
+    while (done < n) {
+        uint64_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+        uint64_t space = shm->slots - (tail - head);
+        if (space == 0) {
+            shm_msg_t* slot = NULL;
+            int rc = spsc_reserve(shm, r, &slot, deadline); // parks until a slot frees
+            if (rc == WQ_TIMEDOUT) return done;
+            if (rc < 0) return -1;
+            msg_copy(slot, &msgs[done]);
+            if (spsc_commit(shm, r) < 0) return -1;
+            tail++;
+            done++;
+            continue;
+        }
+        uint64_t k = (uint64_t)(n - done);
+        if (k > space) k = space;
+        for (uint64_t j = 0; j < k; j++) msg_copy(&r->ring[(tail + j) % shm->slots], &msgs[done + (int)j]);
+        tail += k;
+        done += (int)k;
+        __atomic_store_n(&r->tail, tail, __ATOMIC_RELEASE);
+        if (wq_wake(shm, &shm->data_wq) < 0) return -1;
+    }
+    return n;
+}
+
+// Zero-copy producer API: reserve a slot, fill ref->msg in place (header and
+// payload_len bytes only), then commit it. The wait for a slot ends at
+// deadline (onfull.h; 0 = none) with WQ_TIMEDOUT.
+static int queue_reserve(shm_region_t* shm, slot_ref_t* ref, uint64_t deadline) {
+    if (shm->engine == ENGINE_BYTES) return bytes_reserve(shm, &ref->pos, &ref->msg, deadline);
+    if (shm->engine == ENGINE_LOCKFREE) {
+        int rc = lf_reserve(shm, &ref->pos, deadline);
+        if (rc == 0) ref->msg = lf_slot(shm, ref->pos);
+        return rc;
+    }
+    if (shm->lanes > 1) return lane_reserve(shm, ref, deadline);
+    return sem_reserve_slot(shm, &ref->msg, deadline);
+}
+
+static int queue_commit(shm_region_t* shm, slot_ref_t* ref) {
+    if (shm->engine == ENGINE_BYTES) return bytes_commit(shm, ref->pos);
+    if (shm->engine == ENGINE_LOCKFREE) {
+        lf_publish(shm, ref->pos);
+        return wq_wake(shm, &shm->data_wq);
+    }
+    if (shm->lanes > 1) return lane_commit(shm, ref);
+    return sem_commit_slot(shm);
+}
+
+// Zero-copy consumer API: peek at the next message where it sits in shared
+// memory, then release the slot back to producers.
+static int queue_peek(shm_region_t* shm, slot_ref_t* ref) {
+    if (shm->engine == ENGINE_BYTES) {
+        ref->msg = bytes_peek(shm, &ref->pos);
+        return ref->msg ? 0 : -1;
+    }
+    if (shm->engine == ENGINE_LOCKFREE) {
+        if (lf_acquire(shm, &ref->pos, 0) < 0) return -1;
+        ref->msg = lf_slot(shm, ref->pos);
+        return 0;
+    }
+    ref->msg = sem_peek_slot(shm);
+    return ref->msg ? 0 : -1;
+}
+
+static int queue_release(shm_region_t* shm, slot_ref_t* ref) {
+    if (shm->engine == ENGINE_BYTES) return bytes_release(shm, ref->pos);
+    if (shm->engine == ENGINE_LOCKFREE) {
+        lf_retire(shm, ref->pos);
+        return wq_wake(shm, &shm->space_wq);
+    }
+    if (shm->lanes > 1) return lane_release(shm, ref);
+    return sem_release_slot(shm);
+}
+
+// Lane 0 with --priorities, so a sentinel queues behind all real traffic
+static int queue_push(shm_region_t* shm, const shm_msg_t* msg) {
+    slot_ref_t ref = { NULL, 0, 0 };
+    if (queue_reserve(shm, &ref, 0) < 0) return -1;
+    msg_copy(ref.msg, msg);
+    return queue_commit(shm, &ref);
+}
+
+// Returns the number of messages pushed (1..n, or 0 once the deadline has
+// passed), or -1 on error.
+static int queue_push_batch(shm_region_t* shm, const shm_msg_t* msgs, int n, uint64_t deadline) {
+    if (shm->engine == ENGINE_LOCKFREE) return lf_push_batch(shm, msgs, n, deadline);
+    return sem_queue_push_batch(shm, msgs, n, deadline);
+}
+
+// Returns the number of messages popped (1..n, or 0 once the deadline has
+// passed), or -1 on error. A sentinel, if present, is always the last
+// message returned.
+static int queue_pop_batch(shm_region_t* shm, shm_msg_t* out, int n, uint64_t deadline) {
+    if (shm->engine == ENGINE_LOCKFREE) return lf_pop_batch(shm, out, n, deadline);
+    return sem_queue_pop_batch(shm, out, n, deadline);
+}
+
+// Claim the slot for the next message: try without waiting, and only if the
+// ring is full wait as cfg->on_full says, timing the wait. 0 = ref->msg is
+// ready to fill, 1 = dropped, -1 = error.
+static int producer_reserve(shm_region_t* shm, spsc_ring_t* r, slot_ref_t* ref, const config_t* cfg,
+                            sb_prod_t* prod) {
+    int rc = r ? spsc_reserve(shm, r, &ref->msg, ONFULL_NOW) : queue_reserve(shm, ref, ONFULL_NOW);
+    if (rc != WQ_TIMEDOUT) return rc;
+    uint64_t full_ns = lat_now_ns();
+    uint64_t deadline = onfull_deadline(cfg, full_ns);
+    if (deadline == ONFULL_NOW) {
+        sb_note_full(prod, full_ns, full_ns);
+        return 1;
+    }
+    rc = r ? spsc_reserve(shm, r, &ref->msg, deadline) : queue_reserve(shm, ref, deadline);
+    sb_note_full(prod, full_ns, lat_now_ns());
+    return rc == WQ_TIMEDOUT ? 1 : rc;
+}
+
+static int producer_run_batch(shm_region_t* shm, uint32_t producer_id, const config_t* cfg, stats_block_t* sb) {
+    int n = (int)cfg->batch;
+    shm_msg_t* msgs = (shm_msg_t*)calloc((size_t)n, sizeof(shm_msg_t));
+    uint64_t* stamps = (uint64_t*)malloc(sizeof(uint64_t) * (size_t)n);
+    if (!msgs || !stamps) { free(msgs); free(stamps); return 1; }
+    for (int j = 0; j < n; j++) {
+        msgs[j].hdr.producer_id = producer_id;
+        msgs[j].hdr.payload_len = cfg->msg_size;
+        msgs[j].hdr.crc32 = 0;
+        msgs[j].hdr.send_ns = 0;
+        memset(msgs[j].payload, 'A' + (producer_id % 26), cfg->msg_size);
+    }
+
+    spsc_ring_t* r = (shm->topology == TOPOLOGY_SPSC) ? spsc_ring(shm, producer_id) : NULL;
+    pacer_t pacer;
+    pacer_init(&pacer, cfg, producer_id);
+
+    uint32_t i = 0;
+    while (i < cfg->messages_per_producer) {
+        int fill = n;
+        if (cfg->messages_per_producer - i < (uint32_t)fill) fill = (int)(cfg->messages_per_producer - i);
+        // --rate: only what is due; otherwise the batch goes out together
+        if (pacer.active) fill = (int)pacer_take(&pacer, (uint32_t)fill, stamps);
+        uint64_t now_ns = (cfg->latency && !pacer.active) ? lat_now_ns() : 0;
+        for (int j = 0; j < fill; j++) {
+            msgs[j].hdr.seq = i + (uint32_t)j;
+            msgs[j].hdr.send_ns = pacer.active ? stamps[j] : now_ns;
+            if (cfg->checksum) msgs[j].hdr.crc32 = crc32c_frame(&msgs[j].hdr, msgs[j].payload);
+        }
+
+        // Push what fits without waiting; once the ring is full, wait for the
+        // rest as cfg->on_full says and drop whatever misses the deadline
+        int off = 0;
+        uint64_t full_ns = 0, deadline = ONFULL_NOW;
+        while (off < fill) {
+            int k = r ? spsc_push_batch(shm, r, msgs + off, fill - off, deadline)
+                      : queue_push_batch(shm, msgs + off, fill - off, deadline);
+            if (k < 0) {
+                perror("queue_push_batch (producer)");
+                free(msgs);
+                free(stamps);
+                return 1;
+            }
+            off += k;
+            if (off < fill && !full_ns) {
+                full_ns = lat_now_ns();
+                deadline = onfull_deadline(cfg, full_ns);
+            } else if (off < fill && k == 0) {
+                for (; off < fill; off++) sb_drop(sb, producer_id, i + (uint32_t)off);
+            }
+        }
+        if (full_ns) sb_note_full(&sb->prod[producer_id], full_ns, lat_now_ns());
+        i += (uint32_t)fill;
+    }
+
+    free(msgs);
+    free(stamps);
+    if (r && spsc_close(shm, r) < 0) {
+        perror("spsc_close (producer)");
+        return 1;
+    }
+    return 0;
+}
+
+static int producer_run(shm_region_t* shm, uint32_t producer_id, const config_t* cfg, stats_block_t* sb) {
+    if (cfg->batch > 1) return producer_run_batch(shm, producer_id, cfg, sb);
+
+    msg_hdr_t hdr;
+    hdr.producer_id = producer_id;
+    hdr.payload_len = cfg->msg_size;
+    hdr.crc32 = 0;
+    hdr.send_ns = 0;
+    unsigned char fill = (unsigned char)('A' + (producer_id % 26));
+    pacer_t pacer;
+    pacer_init(&pacer, cfg, producer_id);
+
+    // Messages are built directly in the ring slot; only the header and
+    // msg_size payload bytes are written.
+    if (shm->topology == TOPOLOGY_SPSC) {
+        spsc_ring_t* r = spsc_ring(shm, producer_id);
+        for (uint32_t i = 0; i < cfg->messages_per_producer; i++) {
+            if (pacer.active) pacer_take(&pacer, 1, &hdr.send_ns); // due before a slot is held
+            slot_ref_t ref = { NULL, 0, 0 };
+            int rc = producer_reserve(shm, r, &ref, cfg, &sb->prod[producer_id]);
+            if (rc < 0) {
+                perror("spsc_reserve (producer)");
+                return 1;
+            }
+            if (rc == 1) {
+                sb_drop(sb, producer_id, i);
+                continue;
+            }
+            shm_msg_t* slot = ref.msg;
+            hdr.seq = i;
+            if (cfg->latency && !pacer.active) hdr.send_ns = lat_now_ns();
+            memset(slot->payload, fill, cfg->msg_size);
+            if (cfg->checksum) hdr.crc32 = crc32c_frame(&hdr, slot->payload);
+            slot->hdr = hdr;
+            if (spsc_commit(shm, r) < 0) {
+                perror("spsc_commit (producer)");
+                return 1;
+            }
+        }
+        if (spsc_close(shm, r) < 0) {
+            perror("spsc_close (producer)");
+            return 1;
+        }
+        return 0;
+    }
+
+    for (uint32_t i = 0; i < cfg->messages_per_producer; i++) {
+        if (pacer.active) pacer_take(&pacer, 1, &hdr.send_ns);
+        slot_ref_t ref = { NULL, 0, prio_of(cfg, producer_id, i) };
+        int rc = producer_reserve(shm, NULL, &ref, cfg, &sb->prod[producer_id]);
+        if (rc < 0) {
+            perror("queue_reserve (producer)");
+            return 1;
+        }
+        if (rc == 1) {
+            sb_drop(sb, producer_id, i);
+            continue;
+        }
+        hdr.seq = i;
+        if (cfg->latency && !pacer.active) hdr.send_ns = lat_now_ns();
+        memset(ref.msg->payload, fill, cfg->msg_size);
+        if (cfg->checksum) hdr.crc32 = crc32c_frame(&hdr, ref.msg->payload);
+        ref.msg->hdr = hdr;
+        if (queue_commit(shm, &ref) < 0) {
+            perror("queue_commit (producer)");
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Returns 1 for the shutdown sentinel, 0 otherwise. now_ns is when the
+// message was dequeued (--latency), read once per pop or drain by the caller;
+// lane picks the histogram.
+static int consumer_check(const shm_msg_t* msg, uint32_t lane, const config_t* cfg, stats_t* st,
+                          seqtrack_t* seen, uint64_t now_ns) {
+    const msg_hdr_t* hdr = &msg->hdr;
+    if (hdr->producer_id == SENTINEL_PRODUCER_ID) return 1;
+
+    // A checksum mismatch is a corrupt message: counted as malformed, not received
+    if (hdr->payload_len != cfg->msg_size ||
+        (cfg->checksum && hdr->crc32 != crc32c_frame(hdr, msg->payload))) {
+        st->malformed++;
+        return 0;
+    }
+
+    st->total_received++;
+    if (cfg->work) {
+        work_spin(work_draw(cfg, &st->work_rng));
+        if (st->lat) now_ns = lat_now_ns(); // queueing plus service time
+    }
+    if (st->lat) lat_record(&st->lat[lane], hdr->send_ns, now_ns);
+    if (st->slot) sb_note_received(st->slot, st->total_received);
+
+    if (hdr->producer_id >= (uint32_t)cfg->producers || hdr->seq >= cfg->messages_per_producer) {
+        st->out_of_range++;
+        return 0;
+    }
+    if (st->sb) sb_mark(st->sb, hdr->producer_id, hdr->seq);
+
+    seq_result_t seq_res = seqtrack_mark(seen, hdr->producer_id, hdr->seq);
+    if (seq_res == SEQ_DUP) st->duplicates++;
+    else if (seq_res == SEQ_LATE) st->late++;
+    return 0;
+}
+
+// Fan-in over the per-producer rings. Each pass claims every ring it can,
+// drains up to SPSC_DRAIN_MAX messages, and hands it back. Consumers exit
+// once every ring is closed and empty; there are no sentinels in this mode.
+static int consumer_run_spsc(shm_region_t* shm, int consumer_id, const config_t* cfg,
+                             stats_t* st, seqtrack_t* seen, shm_msg_t* local) {
+    uint32_t P = shm->producers;
+    uint32_t me = (uint32_t)consumer_id + 1;
+    uint32_t start = (uint32_t)consumer_id % P;
+
+    for (;;) {
+        uint64_t got = 0;
+        int all_done = 1;
+
+        for (uint32_t k = 0; k < P; k++) {
+            spsc_ring_t* r = spsc_ring(shm, (start + k) % P);
+            uint32_t unowned = 0;
+            if (!__atomic_compare_exchange_n(&r->owner, &unowned, me, 0,
+                                             __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+                all_done = 0;
+                continue;
+            }
+
+            uint32_t closed = __atomic_load_n(&r->closed, __ATOMIC_ACQUIRE);
+            uint64_t head = r->head;
+            uint64_t tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+            uint64_t n = tail - head;
+            if (n > SPSC_DRAIN_MAX) n = SPSC_DRAIN_MAX;
+
+            uint64_t now_ns = (n && st->lat) ? lat_now_ns() : 0;
+            for (uint64_t j = 0; j < n; j++) {
+                const shm_msg_t* msg = &r->ring[(head + j) % shm->slots];
+                if (local) msg_copy(&local[j], msg);
+                else consumer_check(msg, 0, cfg, st, seen, now_ns);
+            }
+            if (n) __atomic_store_n(&r->head, head + n, __ATOMIC_RELEASE);
+            __atomic_store_n(&r->owner, 0, __ATOMIC_RELEASE);
+            for (uint64_t j = 0; local && j < n; j++) consumer_check(&local[j], 0, cfg, st, seen, now_ns);
+
+            if (n && wq_wake(shm, &r->space_wq) < 0) return -1;
+            // `closed` was read before `tail`, so closed && drained means finished
+            if (!closed || head + n != tail) all_done = 0;
+            got += n;
+        }
+
+        if (all_done) return 0;
+        if (got) continue;
+
+        if (wq_wait(shm, &shm->data_wq, spsc_should_scan, NULL, 0) < 0) return -1;
+    }
+}
+
+static steal_deque_t* steal_deque(shm_region_t* shm, uint32_t c) {
+    return (steal_deque_t*)((unsigned char*)shm + shm->deque_offset + (size_t)c * shm->deque_stride);
+}
+
+// Owner only. The owner pulls only into an empty deque, and never more than
+// it holds, so a push cannot overwrite a slot a thief is still copying.
+static void deque_push(shm_region_t* shm, steal_deque_t* d, const shm_msg_t* msg) {
+    int64_t b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED);
+    msg_copy(&d->buf[b & shm->deque_mask], msg);
+    __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELEASE);
+}
+
+// Owner only: 1 with *out filled, 0 if empty or a thief won the last message
+static int deque_pop(shm_region_t* shm, steal_deque_t* d, shm_msg_t* out) {
+    int64_t b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED) - 1;
+    __atomic_store_n(&d->bottom, b, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    int64_t t = __atomic_load_n(&d->top, __ATOMIC_RELAXED);
+    if (t > b) {
+        __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+        return 0;
+    }
+    msg_copy(out, &d->buf[b & shm->deque_mask]);
+    if (t < b) return 1;
+    int won = __atomic_compare_exchange_n(&d->top, &t, t + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+    __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+    return won;
+}
+
+static int deque_steal(shm_region_t* shm, steal_deque_t* d, shm_msg_t* out) {
+    int64_t t = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    int64_t b = __atomic_load_n(&d->bottom, __ATOMIC_ACQUIRE);
+    if (t >= b) return 0;
+    msg_copy(out, &d->buf[t & shm->deque_mask]);
+    return __atomic_compare_exchange_n(&d->top, &t, t + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+}
+
+// One pass over the other consumers' deques, starting after our own
+static int steal_any(shm_region_t* shm, uint32_t me, shm_msg_t* out) {
+    for (uint32_t k = 1; k < shm->consumers; k++) {
+        if (deque_steal(shm, steal_deque(shm, (me + k) % shm->consumers), out)) return 1;
+    }
+    return 0;
+}
+
+static int deques_empty(shm_region_t* shm) {
+    for (uint32_t c = 0; c < shm->consumers; c++) {
+        steal_deque_t* d = steal_deque(shm, c);
+        if (__atomic_load_n(&d->top, __ATOMIC_ACQUIRE) < __atomic_load_n(&d->bottom, __ATOMIC_ACQUIRE)) return 0;
+    }
+    return 1;
+}
+
+// --consumer-mode steal: work from our own deque first, then steal one
+// message at a time from the others, and only then pull up to --batch
+// messages from the ring. A batch is pushed newest first, so the owner
+// works through it oldest first while thieves take the newest, which would
+// otherwise wait longest. An idle consumer waits on the ring for at most
+// STEAL_POLL_NS before looking at the deques again. After its sentinel it
+// keeps helping until every deque is empty.
+static int consumer_run_steal(shm_region_t* shm, int consumer_id, const config_t* cfg,
+                              stats_t* st, seqtrack_t* seen) {
+    int n = (int)cfg->batch;
+    shm_msg_t* pulled = (shm_msg_t*)malloc((size_t)n * sizeof(shm_msg_t));
+    if (!pulled) return -1;
+    steal_deque_t* mine = steal_deque(shm, (uint32_t)consumer_id);
+    shm_msg_t msg;
+    int done = 0;
+    int idle = 0;
+
+    for (;;) {
+        int got = deque_pop(shm, mine, &msg);
+        if (!got && steal_any(shm, (uint32_t)consumer_id, &msg)) {
+            got = 1;
+            st->stolen++;
+        }
+        if (got) {
+            consumer_check(&msg, 0, cfg, st, seen, st->lat ? lat_now_ns() : 0);
+            idle = 0;
+            continue;
+        }
+        if (done) {
+            if (deques_empty(shm)) break;
+            sched_yield();
+            continue;
+        }
+
+        int k = queue_pop_batch(shm, pulled, n, idle ? lat_now_ns() + STEAL_POLL_NS : ONFULL_NOW);
+        if (k < 0) {
+            free(pulled);
+            return -1;
+        }
+        if (k > 0 && pulled[k - 1].hdr.producer_id == SENTINEL_PRODUCER_ID) {
+            done = 1;
+            k--;
+        }
+        for (int j = k - 1; j >= 0; j--) deque_push(shm, mine, &pulled[j]);
+        idle = (k == 0);
+    }
+    free(pulled);
+    return 0;
+}
+
+static int consumer_run(shm_region_t* shm, int consumer_id, const config_t* cfg, stats_t* st_out) {
+    stats_t st = { .lat = st_out->lat, .sb = st_out->sb, .slot = st_out->slot };
+    st.work_rng = 0x9e3779b97f4a7c15ull * (uint64_t)(consumer_id + 1);
+
+    seqtrack_t* seen = seqtrack_new((uint32_t)cfg->producers, cfg->messages_per_producer);
+    if (!seen) return 1;
+
+    if (shm->consumer_mode == CONSUMER_STEAL) {
+        int rc = consumer_run_steal(shm, consumer_id, cfg, &st, seen);
+        seqtrack_free(seen);
+        *st_out = st;
+        if (rc < 0) {
+            perror("work stealing (consumer)");
+            return 2;
+        }
+        return 0;
+    }
+
+    if (shm->topology == TOPOLOGY_SPSC) {
+        // --work-ns: drain into a local copy and hand the ring back first
+        shm_msg_t* local = cfg->work ? (shm_msg_t*)malloc(SPSC_DRAIN_MAX * sizeof(shm_msg_t)) : NULL;
+        if (cfg->work && !local) { seqtrack_free(seen); return 1; }
+        int rc = consumer_run_spsc(shm, consumer_id, cfg, &st, seen, local);
+        free(local);
+        seqtrack_free(seen);
+        *st_out = st;
+        if (rc < 0) {
+            perror("spsc fan-in (consumer)");
+            return 2;
+        }
+        return 0;
+    }
+
+    if (cfg->batch > 1) {
+        int n = (int)cfg->batch;
+        shm_msg_t* msgs = (shm_msg_t*)malloc((size_t)n * sizeof(shm_msg_t));
+        if (!msgs) { seqtrack_free(seen); return 1; }
+        int done = 0;
+        while (!done) {
+            int k = queue_pop_batch(shm, msgs, n, 0);
+            if (k < 0) {
+                perror("queue_pop_batch (consumer)");
+                free(msgs);
+                seqtrack_free(seen);
+                return 2;
+            }
+            uint64_t now_ns = st.lat ? lat_now_ns() : 0;
+            for (int j = 0; j < k; j++) {
+                if (consumer_check(&msgs[j], 0, cfg, &st, seen, now_ns)) done = 1; // sentinel is always last
+            }
+        }
+        free(msgs);
+        seqtrack_free(seen);
+        *st_out = st;
+        return 0;
+    }
+
+    // Validate each message where it sits in the ring, then hand the slot back.
+    // The sem and bytes engines and the lanes hold a mutex until the release,
+    // so with --work-ns the message is copied out and released first: the
+    // simulated service time must not run inside the lock.
+    shm_msg_t* local = cfg->work ? frame_alloc(cfg->msg_size) : NULL;
+    if (cfg->work && !local) { seqtrack_free(seen); return 1; }
+    lane_sched_t sched;
+    memset(&sched, 0, sizeof(sched));
+    while (1) {
+        slot_ref_t ref = { NULL, 0, 0 };
+        int rc = (shm->lanes > 1) ? lane_peek(shm, &sched, &ref) : queue_peek(shm, &ref);
+        if (rc < 0) {
+            perror("queue_peek (consumer)");
+            free(local);
+            seqtrack_free(seen);
+            return 2;
+        }
+
+        uint64_t now_ns = st.lat ? lat_now_ns() : 0;
+        int stop = 0;
+        if (local) frame_copy(local, ref.msg, cfg->msg_size);
+        else stop = consumer_check(ref.msg, ref.lane, cfg, &st, seen, now_ns);
+
+        if (queue_release(shm, &ref) < 0) {
+            perror("queue_release (consumer)");
+            free(local);
+            seqtrack_free(seen);
+            return 2;
+        }
+        if (local) stop = consumer_check(local, ref.lane, cfg, &st, seen, now_ns);
+        if (stop) {
+            break; // graceful shutdown marker
+        }
+    }
+
+    free(local);
+    seqtrack_free(seen);
+    *st_out = st;
+    return 0;
+}
+
+
+// Bind the mapping's pages to one node before anything touches them. Raw
+// syscall so the build doesn't need libnuma.
+static int bind_numa_node(void* addr, size_t len, int node) {
+    unsigned long mask[64 / (8 * sizeof(unsigned long)) + 1] = {0};
+    mask[node / (8 * (int)sizeof(unsigned long))] |= 1ul << (node % (8 * (int)sizeof(unsigned long)));
+    return (int)syscall(SYS_mbind, addr, len, MPOL_BIND_MODE, mask, 64ul + 1, 0u);
+}
+
+static size_t round_up(size_t v, size_t align) {
+    return (v + align - 1) / align * align;
+}
+
+
+// ---- Public API (shm_ring.h) ----
+
+void shm_opts_init(shm_opts_t* o) {
+    memset(o, 0, sizeof(*o));
+    o->slots = SHM_DEFAULT_SLOTS;
+    o->engine = ENGINE_SEM;
+    o->topology = TOPOLOGY_SHARED;
+    o->wait_policy = WAIT_SEM;
+    o->lanes = 1;
+    o->starve_limit = SHM_DEFAULT_STARVE_LIMIT;
+    o->consumer_mode = CONSUMER_PULL;
+    o->numa_node = -1;
+}
+
+int shm_parse_engine(const char* s, shm_opts_t* o) {
+    // eventfd = the lock-free ring with eventfd wakeups
+    o->eventfd = !strcmp(s, "eventfd");
+    if (o->eventfd || !strcmp(s, "lockfree")) o->engine = ENGINE_LOCKFREE;
+    else if (!strcmp(s, "sem")) o->engine = ENGINE_SEM;
+    else if (!strcmp(s, "bytes")) o->engine = ENGINE_BYTES;
+    else o->engine = -1;
+    return o->engine < 0 ? -1 : 0;
+}
+
+int shm_parse_topology(const char* s) {
+    if (!strcmp(s, "shared")) return TOPOLOGY_SHARED;
+    if (!strcmp(s, "spsc")) return TOPOLOGY_SPSC;
+    return -1;
+}
+
+int shm_parse_wait(const char* s) {
+    if (!strcmp(s, "sem")) return WAIT_SEM;
+    if (!strcmp(s, "spin")) return WAIT_SPIN;
+    if (!strcmp(s, "yield")) return WAIT_YIELD;
+    if (!strcmp(s, "futex")) return WAIT_FUTEX;
+    if (!strcmp(s, "eventfd")) return WAIT_EVENTFD;
+    return -1;
+}
+
+const char* shm_engine_name(const shm_opts_t* o) {
+    if (o->eventfd) return "eventfd";
+    switch (o->engine) {
+    case ENGINE_LOCKFREE: return "lockfree";
+    case ENGINE_BYTES: return "bytes";
+    default: return "sem";
+    }
+}
+
+const char* shm_topology_name(int topology) {
+    return topology == TOPOLOGY_SPSC ? "spsc" : "shared";
+}
+
+const char* shm_wait_name(int wait_policy) {
+    switch (wait_policy) {
+    case WAIT_SPIN: return "spin";
+    case WAIT_YIELD: return "yield";
+    case WAIT_FUTEX: return "futex";
+    case WAIT_EVENTFD: return "eventfd";
+    default: return "sem";
+    }
+}
+
+const char* shm_ring_check(shm_opts_t* o, const config_t* cfg, char* buf, size_t len) {
+    o->lanes = cfg->priorities > 1 ? cfg->priorities : 1;
+    if (o->slots <= 0 || o->slots > MAX_SLOTS) {
+        snprintf(buf, len, "--slots must be between 1 and %d.", MAX_SLOTS);
+        return buf;
+    }
+    if (o->engine < 0) {
+        snprintf(buf, len, "--engine must be 'sem', 'lockfree', 'eventfd' or 'bytes'.");
+        return buf;
+    }
+    if (o->eventfd) {
+        if (o->wait_given && o->wait_policy != WAIT_EVENTFD) {
+            snprintf(buf, len, "--engine eventfd implies --wait eventfd.");
+            return buf;
+        }
+        o->wait_policy = WAIT_EVENTFD;
+    }
+    int byte_ring = (o->engine == ENGINE_BYTES && o->topology == TOPOLOGY_SHARED);
+    if (cfg->msg_size > MAX_PAYLOAD && !byte_ring) {
+        snprintf(buf, len, "--msg-size must be <= %d for shared-memory ring slots.", MAX_PAYLOAD);
+        return buf;
+    }
+    if (byte_ring) {
+        if (o->ring_bytes == 0) {
+            // Room for --slots records, rounded up to a power of two
+            uint64_t want = (uint64_t)o->slots * rec_bytes(cfg->msg_size);
+            o->ring_bytes = (int)MIN_RING_BYTES;
+            while ((uint64_t)o->ring_bytes < want && o->ring_bytes < (int)MAX_RING_BYTES) o->ring_bytes <<= 1;
+        }
+        if (o->ring_bytes < (int)MIN_RING_BYTES || o->ring_bytes > (int)MAX_RING_BYTES ||
+            (o->ring_bytes & (o->ring_bytes - 1)) != 0) {
+            snprintf(buf, len, "--ring-bytes must be a power of two between %u and %u.",
+                     MIN_RING_BYTES, MAX_RING_BYTES);
+            return buf;
+        }
+        // A record plus the worst-case wrap padding must fit in an empty ring
+        if ((uint64_t)rec_bytes(cfg->msg_size) * 2 > (uint64_t)o->ring_bytes) {
+            snprintf(buf, len, "--msg-size %u needs --ring-bytes >= %llu.", cfg->msg_size,
+                     (unsigned long long)rec_bytes(cfg->msg_size) * 2);
+            return buf;
+        }
+        if (cfg->batch > 1) {
+            snprintf(buf, len, "--batch is not supported with --engine bytes.");
+            return buf;
+        }
+    } else if (o->ring_bytes != 0) {
+        snprintf(buf, len, "--ring-bytes only applies to --engine bytes.");
+        return buf;
+    }
+    // With one slot, "free for pos+1" and "full at pos" have the same sequence value
+    if (o->engine == ENGINE_LOCKFREE && o->slots < 2) {
+        snprintf(buf, len, "--engine lockfree needs --slots >= 2.");
+        return buf;
+    }
+    if (o->topology < 0) {
+        snprintf(buf, len, "--topology must be 'shared' or 'spsc'.");
+        return buf;
+    }
+    if (o->wait_policy < 0) {
+        snprintf(buf, len, "--wait must be 'spin', 'yield', 'futex', 'eventfd' or 'sem'.");
+        return buf;
+    }
+    // The sem engine blocks in sem_wait on its counting semaphores by design
+    if (o->engine == ENGINE_SEM && o->topology == TOPOLOGY_SHARED && o->wait_policy != WAIT_SEM) {
+        snprintf(buf, len, "--wait %s needs --engine lockfree or bytes (or --topology spsc).",
+                 shm_wait_name(o->wait_policy));
+        return buf;
+    }
+    if (cfg->batch == 0 || cfg->batch > MAX_SLOTS) {
+        snprintf(buf, len, "--batch must be between 1 and %d.", MAX_SLOTS);
+        return buf;
+    }
+    if (o->lanes > 1 && (o->engine != ENGINE_SEM || o->topology != TOPOLOGY_SHARED || cfg->batch > 1)) {
+        snprintf(buf, len, "--priorities needs --engine sem --topology shared without --batch.");
+        return buf;
+    }
+    if (o->consumer_mode == CONSUMER_STEAL &&
+        (o->engine == ENGINE_BYTES || o->topology != TOPOLOGY_SHARED || o->lanes > 1)) {
+        snprintf(buf, len, "--consumer-mode steal needs --engine sem or lockfree with --topology shared"
+                           " and no --priorities.");
+        return buf;
+    }
+    return NULL;
+}
+
+int shm_ring_create(shm_ring_t* r, const shm_opts_t* o, const config_t* cfg) {
+    memset(r, 0, sizeof(*r));
+    r->opts = *o;
+    int slots = o->slots;
+    int lanes = o->lanes;
+    int byte_ring = (o->engine == ENGINE_BYTES && o->topology == TOPOLOGY_SHARED);
+
+    // The data area follows the fixed header in one mapping and is sized for
+    // what this run actually uses.
+    size_t stride = spsc_stride((uint32_t)slots);
+    size_t map_bytes = sizeof(shm_region_t);
+    if (o->topology == TOPOLOGY_SPSC) map_bytes += (size_t)cfg->producers * stride;
+    else if (byte_ring) map_bytes += (size_t)o->ring_bytes;
+    else map_bytes += (size_t)lanes * (size_t)slots * sizeof(shm_msg_t);
+    // --consumer-mode steal: one deque per consumer after the ring, each
+    // large enough for a whole --batch
+    uint32_t deque_slots = 1;
+    while (deque_slots < cfg->batch) deque_slots <<= 1;
+    size_t deque_stride = round_up(sizeof(steal_deque_t) + deque_slots * sizeof(shm_msg_t), CACHE_LINE);
+    size_t deque_offset = round_up(map_bytes, CACHE_LINE);
+    if (o->consumer_mode == CONSUMER_STEAL) map_bytes = deque_offset + (size_t)cfg->consumers * deque_stride;
+
+    // --hugepages: an anonymous MAP_SHARED|MAP_HUGETLB mapping is inherited by
+    // the forked children, so no hugetlbfs mount or shm name is needed. If the
+    // pool has no free pages we fall back to the regular shm_open object.
+    shm_region_t* shm = MAP_FAILED;
+    r->page_mode = "4k";
+    // --threads: the ring is ordinary private anonymous memory of this process
+    int anon_flags = o->threads ? (MAP_PRIVATE | MAP_ANONYMOUS) : (MAP_SHARED | MAP_ANONYMOUS);
+    if (o->hugepages) {
+        size_t huge_bytes = round_up(map_bytes, HUGE_PAGE_BYTES);
+        shm = (shm_region_t*)mmap(NULL, huge_bytes, PROT_READ | PROT_WRITE,
+                                  anon_flags | MAP_HUGETLB, -1, 0);
+        if (shm != MAP_FAILED) {
+            map_bytes = huge_bytes;
+            r->page_mode = "huge";
+        } else {
+            fprintf(stderr, "warning: MAP_HUGETLB failed (%s); using 4 KB pages "
+                            "(see /proc/sys/vm/nr_hugepages)\n", strerror(errno));
+            r->page_mode = "4k(fallback)";
+        }
+    }
+
+    if (shm == MAP_FAILED && o->threads) {
+        shm = (shm_region_t*)mmap(NULL, map_bytes, PROT_READ | PROT_WRITE, anon_flags, -1, 0);
+        if (shm == MAP_FAILED) {
+            perror("mmap");
+            return 5;
+        }
+    }
+
+    if (shm == MAP_FAILED) {
+        // Create unique shm object name
+        snprintf(r->name, sizeof(r->name), "/cs4800_shm_%ld", (long)getpid());
+
+        int fd = shm_open(r->name, O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (fd < 0) {
+            perror("shm_open");
+            return 3;
+        }
+
+        if (ftruncate(fd, (off_t)map_bytes) < 0) {
+            perror("ftruncate");
+            shm_unlink(r->name);
+            close(fd);
+            return 4;
+        }
+
+        shm = (shm_region_t*)mmap(NULL, map_bytes,
+                                  PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (shm == MAP_FAILED) {
+            perror("mmap");
+            shm_unlink(r->name);
+            close(fd);
+            return 5;
+        }
+        close(fd);
+    }
+    r->shm = shm;
+    r->map_bytes = map_bytes;
+
+    // Nothing has been touched yet, so every page faults in on the bound node
+    if (o->numa_node >= 0 && bind_numa_node(shm, map_bytes, o->numa_node) < 0) {
+        perror("mbind");
+        munmap(shm, map_bytes);
+        if (r->name[0]) shm_unlink(r->name);
+        return 5;
+    }
+
+    memset(shm, 0, sizeof(*shm));
+    shm->slots = (uint32_t)slots;
+    shm->msg_size = cfg->msg_size;
+    shm->engine = (uint32_t)o->engine;
+    shm->topology = (uint32_t)o->topology;
+    shm->producers = (uint32_t)cfg->producers;
+    shm->spsc_stride = (uint32_t)stride;
+    shm->ring_bytes = (uint32_t)o->ring_bytes;
+    shm->ring_mask = (uint32_t)o->ring_bytes - 1;
+    shm->wait_policy = (uint32_t)o->wait_policy;
+    shm->lanes = (uint32_t)lanes;
+    shm->consumers = (uint32_t)cfg->consumers;
+    shm->consumer_mode = (uint32_t)o->consumer_mode;
+    shm->deque_stride = (uint32_t)deque_stride;
+    shm->deque_mask = deque_slots - 1;
+    shm->deque_offset = deque_offset;
+    shm->starve_limit = (uint32_t)o->starve_limit;
+    for (int i = 0; i < slots; i++) shm->slot_seq[i] = (uint64_t)i;
+
+    // Only the sem engine counts slots with empty/full; the others just park on them
+    unsigned int empty_init = (o->engine == ENGINE_SEM) ? (unsigned int)slots : 0u;
+    int pshared = !o->threads; // --threads: process-private semaphores
+    wait_policy_t wait = (wait_policy_t)o->wait_policy;
+    int ok = sem_init(&shm->empty, pshared, empty_init) == 0 &&
+             sem_init(&shm->full, pshared, 0) == 0 &&
+             sem_init(&shm->mutex, pshared, 1) == 0 &&
+             wq_init(&shm->space_wq, wait, pshared) == 0 &&
+             wq_init(&shm->data_wq, wait, pshared) == 0;
+    for (int k = 0; ok && k < lanes && lanes > 1; k++) {
+        ok = sem_init(&shm->lane[k].empty, pshared, (unsigned int)slots) == 0 &&
+             sem_init(&shm->lane[k].mutex, pshared, 1) == 0;
+    }
+    for (int p = 0; ok && p < cfg->producers && o->topology == TOPOLOGY_SPSC; p++) {
+        ok = wq_init(&spsc_ring(shm, (uint32_t)p)->space_wq, wait, pshared) == 0;
+    }
+    if (!ok) {
+        perror("sem_init");
+        munmap(shm, map_bytes);
+        if (r->name[0]) shm_unlink(r->name);
+        r->shm = NULL;
+        return 6;
+    }
+    return 0;
+}
+
+int shm_producer_run(shm_ring_t* r, uint32_t producer_id, const config_t* cfg, stats_block_t* sb) {
+    return producer_run(r->shm, producer_id, cfg, sb);
+}
+
+int shm_consumer_run(shm_ring_t* r, int consumer_id, const config_t* cfg, stats_t* st) {
+    return consumer_run(r->shm, consumer_id, cfg, st);
+}
+
+int shm_ring_finish(shm_ring_t* r) {
+    shm_region_t* shm = r->shm;
+    if (shm->topology != TOPOLOGY_SHARED) return 0;
+
+    shm_msg_t sentinel;
+    memset(&sentinel, 0, sizeof(sentinel));
+    sentinel.hdr.producer_id = SENTINEL_PRODUCER_ID;
+    sentinel.hdr.seq = 0;
+    sentinel.hdr.payload_len = shm->msg_size;
+
+    int rc = 0;
+    for (uint32_t i = 0; i < shm->consumers; i++) {
+        if (queue_push(shm, &sentinel) < 0) {
+            perror("queue_push sentinel");
+            rc = -1;
+        }
+    }
+    return rc;
+}
+
+void shm_ring_report_waits(const shm_ring_t* r, FILE* out) {
+    const shm_region_t* shm = r->shm;
+    if (shm->engine == ENGINE_SEM && shm->topology == TOPOLOGY_SHARED) return;
+    const wait_stats_t* ws = &shm->wait_stats;
+    fprintf(out, "wait(%s): spins=%llu yields=%llu futex_waits=%llu sem_waits=%llu efd_waits=%llu wakes=%llu\n",
+            shm_wait_name((int)shm->wait_policy),
+            (unsigned long long)ws->spins, (unsigned long long)ws->yields,
+            (unsigned long long)ws->futex_waits, (unsigned long long)ws->sem_waits,
+            (unsigned long long)ws->efd_waits, (unsigned long long)ws->wakes);
+}
+
+void shm_ring_destroy(shm_ring_t* r) {
+    shm_region_t* shm = r->shm;
+    if (!shm) return;
+    sem_destroy(&shm->empty);
+    sem_destroy(&shm->full);
+    sem_destroy(&shm->mutex);
+    for (uint32_t k = 0; k < shm->lanes && shm->lanes > 1; k++) {
+        sem_destroy(&shm->lane[k].empty);
+        sem_destroy(&shm->lane[k].mutex);
+    }
+    wq_destroy(&shm->space_wq);
+    wq_destroy(&shm->data_wq);
+    if (shm->topology == TOPOLOGY_SPSC) {
+        for (uint32_t p = 0; p < shm->producers; p++) wq_destroy(&spsc_ring(shm, p)->space_wq);
+    }
+    munmap(shm, r->map_bytes);
+    if (r->name[0]) shm_unlink(r->name);
+    r->shm = NULL;
+}
@@ -1,277 +1,429 @@
+#define _GNU_SOURCE // CPU_SET / sched_setaffinity
 #include "common.h"
+#include "latency.h"
+#include "statsblock.h"
+#include "crc32c.h"
+#include "pacer.h"
+#include "onfull.h"
+#include "prio.h"
+#include "work.h"
+#include "shm_ring.h"
+#include "util.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
 #include <unistd.h>
-#include <fcntl.h>
 #include <errno.h>
 #include <time.h>
-#include <sys/mman.h>
-#include <sys/stat.h>
 #include <sys/wait.h>
-#include <semaphore.h>
+#include <pthread.h>
+#include <sched.h>
 
-#define MAX_SLOTS 1024
-#define MAX_PAYLOAD 512
-#define SENTINEL_PRODUCER_ID 0xFFFFFFFFu
-
-typedef struct {
-    msg_hdr_t hdr;
-    unsigned char payload[MAX_PAYLOAD];
-} shm_msg_t;
-
-typedef struct {
-    sem_t empty;
-    sem_t full;
-    sem_t mutex;
-
-    uint32_t write_idx;
-    uint32_t read_idx;
-
-    uint32_t slots;      // configured ring size
-    uint32_t msg_size;   // configured payload size
-
-    // Ring buffer
-    shm_msg_t ring[MAX_SLOTS];
-} shm_region_t;
-
-typedef struct {
-    uint64_t total_received;
-    uint64_t duplicates;
-    uint64_t out_of_range;
-    uint64_t malformed;
-} stats_t;
+#define MAX_PIN_CPUS 1024
 
 static void usage(const char* prog) {
     fprintf(stderr,
-        "Usage: %s [--producers N] [--consumers N] [--messages M] [--msg-size BYTES] [--slots N] [--verbose]\n"
+        "Usage: %s [--producers N] [--consumers N] [--messages M] [--msg-size BYTES] [--slots N]\n"
+        "          [--engine sem|lockfree|eventfd|bytes] [--ring-bytes N] [--topology shared|spsc] [--batch N]\n"
+        "          [--wait spin|yield|futex|eventfd|sem] [--hugepages] [--numa-node N]\n"
+        "          [--pin compact|scatter|CPU,CPU-CPU,...] [--threads] [--latency]\n"
+        "          [--checksum none|crc32c|crc32c-sw] [--verify] [--sample-ms N]\n"
+        "          [--rate MSGS_PER_SEC | --rate-per-producer MSGS_PER_SEC] [--arrival constant|poisson]\n"
+        "          [--on-full block|drop|retry-timeout=US] [--priorities K] [--prio-mix W,W,...]\n"
+        "          [--starve-limit N] [--work-ns NS|fixed:NS|exp:NS|bimodal:NS,NS,P]\n"
+        "          [--consumer-mode pull|steal] [--verbose]\n"
         "Example:\n"
-        "  %s --producers 2 --consumers 2 --messages 10000 --msg-size 64 --slots 64\n",
-        prog, prog
+        "  %s --producers 2 --consumers 2 --messages 10000 --msg-size 64 --slots 64\n"
+        "  %s --producers 4 --consumers 1 --messages 20000 --msg-size 64 --engine lockfree\n",
+        prog, prog, prog
     );
 }
 
-static int parse_int(const char* s) {
-    char* end = NULL;
-    long v = strtol(s, &end, 10);
-    if (!end || *end != '\0') return -1;
-    if (v < 0 || v > 1000000000L) return -1;
-    return (int)v;
-}
+// ---- Placement: huge pages, NUMA binding, CPU pinning ----
 
-static double elapsed_sec(struct timespec a, struct timespec b) {
-    return (double)(b.tv_sec - a.tv_sec) + (double)(b.tv_nsec - a.tv_nsec) / 1e9;
-}
+typedef enum {
+    PIN_NONE = 0,
+    PIN_COMPACT,   // children fill CPUs in order, so neighbours share a node
+    PIN_SCATTER,   // children alternate across NUMA nodes
+    PIN_LIST       // explicit --pin CPU list, reused round-robin
+} pin_policy_t;
 
-static int queue_push(shm_region_t* shm, const shm_msg_t* msg) {
-    if (sem_wait(&shm->empty) < 0) return -1;
-    if (sem_wait(&shm->mutex) < 0) return -1;
-
-    shm->ring[shm->write_idx] = *msg;
-    shm->write_idx = (shm->write_idx + 1) % shm->slots;
-
-    if (sem_post(&shm->mutex) < 0) return -1;
-    if (sem_post(&shm->full) < 0) return -1;
-    return 0;
+typedef struct {
+    int policy;
+    int ncpus;
+    int cpus[MAX_PIN_CPUS];  // child k runs on cpus[k % ncpus]
+} pin_plan_t;
+
+static const char* pin_name(pin_policy_t p) {
+    switch (p) {
+        case PIN_COMPACT: return "compact";
+        case PIN_SCATTER: return "scatter";
+        case PIN_LIST: return "list";
+        default: return "none";
+    }
 }
 
-static int queue_pop(shm_region_t* shm, shm_msg_t* msg_out) {
-    if (sem_wait(&shm->full) < 0) return -1;
-    if (sem_wait(&shm->mutex) < 0) return -1;
-
-    *msg_out = shm->ring[shm->read_idx];
-    shm->read_idx = (shm->read_idx + 1) % shm->slots;
+// Parse "0,2,4-7" into cpus[]; returns the count, or -1 on a malformed list
+static int parse_cpu_list(const char* s, int* cpus, int max) {
+    int n = 0;
+    while (*s) {
+        char* end = NULL;
+        long lo = strtol(s, &end, 10);
+        if (end == s || lo < 0 || lo >= CPU_SETSIZE) return -1;
+        long hi = lo;
+        if (*end == '-') {
+            s = end + 1;
+            hi = strtol(s, &end, 10);
+            if (end == s || hi < lo || hi >= CPU_SETSIZE) return -1;
+        }
+        for (long c = lo; c <= hi; c++) {
+            if (n >= max) return -1;
+            cpus[n++] = (int)c;
+        }
+        if (*end == ',') end++;
+        else if (*end != '\0') return -1;
+        s = end;
+    }
+    return n;
+}
 
-    if (sem_post(&shm->mutex) < 0) return -1;
-    if (sem_post(&shm->empty) < 0) return -1;
+static int parse_pin(const char* s, pin_plan_t* plan) {
+    if (!strcmp(s, "compact")) plan->policy = PIN_COMPACT;
+    else if (!strcmp(s, "scatter")) plan->policy = PIN_SCATTER;
+    else {
+        plan->ncpus = parse_cpu_list(s, plan->cpus, MAX_PIN_CPUS);
+        if (plan->ncpus <= 0) return -1;
+        plan->policy = PIN_LIST;
+    }
     return 0;
 }
 
-static int producer_run(shm_region_t* shm, uint32_t producer_id, const config_t* cfg) {
-    shm_msg_t msg;
-    memset(&msg, 0, sizeof(msg));
-    msg.hdr.producer_id = producer_id;
-    msg.hdr.payload_len = cfg->msg_size;
-    msg.hdr.crc32 = 0;
-    memset(msg.payload, 'A' + (producer_id % 26), cfg->msg_size);
-
-    for (uint32_t i = 0; i < cfg->messages_per_producer; i++) {
-        msg.hdr.seq = i;
-        if (queue_push(shm, &msg) < 0) {
-            perror("queue_push (producer)");
-            return 1;
-        }
+static int numa_node_of(int cpu) {
+    char path[96];
+    for (int node = 0; node < 64; node++) {
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/node%d", cpu, node);
+        if (access(path, F_OK) == 0) return node;
     }
     return 0;
 }
 
-static int consumer_run(shm_region_t* shm, const config_t* cfg, stats_t* st_out) {
-    stats_t st = {0};
-
-    size_t P = (size_t)cfg->producers;
-    size_t M = (size_t)cfg->messages_per_producer;
-    size_t seen_sz = P * M;
-    unsigned char* seen = (unsigned char*)calloc(seen_sz, 1);
-    if (!seen) return 1;
-
-    shm_msg_t msg;
-    while (1) {
-        if (queue_pop(shm, &msg) < 0) {
-            perror("queue_pop (consumer)");
-            free(seen);
-            return 2;
+// Build the CPU order for compact/scatter from the CPUs this process may use.
+// Scatter deals the CPUs of each node out in turn (n0, n1, n0, n1, ...).
+// An explicit list is checked up front: a child that can't pin would exit and
+// leave its peers blocked on the ring.
+static int pin_plan_build(pin_plan_t* plan) {
+    if (plan->policy == PIN_NONE) return 0;
+
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) < 0) return -1;
+    if (plan->policy == PIN_LIST) {
+        for (int i = 0; i < plan->ncpus; i++) {
+            if (!CPU_ISSET(plan->cpus[i], &allowed)) return -1;
         }
-
-        if (msg.hdr.producer_id == SENTINEL_PRODUCER_ID) {
-            break; // graceful shutdown marker
-        }
-
-        if (msg.hdr.payload_len != cfg->msg_size) {
-            st.malformed++;
-            continue;
-        }
-
-        st.total_received++;
-
-        if (msg.hdr.producer_id >= (uint32_t)cfg->producers || msg.hdr.seq >= cfg->messages_per_producer) {
-            st.out_of_range++;
-            continue;
+        return 0;
+    }
+    int avail[MAX_PIN_CPUS], node[MAX_PIN_CPUS], n = 0;
+    for (int c = 0; c < CPU_SETSIZE && n < MAX_PIN_CPUS; c++) {
+        if (!CPU_ISSET(c, &allowed)) continue;
+        avail[n] = c;
+        node[n] = numa_node_of(c);
+        n++;
+    }
+    if (n == 0) return -1;
+
+    if (plan->policy == PIN_COMPACT) {
+        memcpy(plan->cpus, avail, (size_t)n * sizeof(int));
+    } else {
+        int taken[MAX_PIN_CPUS] = {0};
+        int out = 0;
+        while (out < n) {
+            int last_node = -1;
+            for (int i = 0; i < n; i++) {
+                if (taken[i] || node[i] <= last_node) continue;
+                taken[i] = 1;
+                last_node = node[i];
+                plan->cpus[out++] = avail[i];
+            }
         }
-
-        size_t idx = (size_t)msg.hdr.producer_id * M + (size_t)msg.hdr.seq;
-        if (seen[idx]) st.duplicates++;
-        else seen[idx] = 1;
     }
+    plan->ncpus = n;
+    return 0;
+}
 
-    free(seen);
-    *st_out = st;
+// Called in each forked child; k is the child's fork order (consumers first)
+static int pin_child(const pin_plan_t* plan, int k, const char* role, int id, int verbose) {
+    if (plan->policy == PIN_NONE) return 0;
+    int cpu = plan->cpus[k % plan->ncpus];
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) < 0) {
+        fprintf(stderr, "%s[%d]: sched_setaffinity(cpu %d): %s\n", role, id, cpu, strerror(errno));
+        return -1;
+    }
+    if (verbose) fprintf(stderr, "%s[%d]: pinned to cpu %d\n", role, id, cpu);
     return 0;
 }
 
+// --threads: the same producer/consumer bodies as pthreads of one process.
+// `slot` is the fork-order index used for pinning (consumers first).
+typedef struct {
+    shm_ring_t* ring;
+    const config_t* cfg;
+    const pin_plan_t* pin;
+    pthread_barrier_t* start;
+    int id;
+    int slot;
+    int rc;
+    stats_t st;
+    pthread_t tid;
+} worker_t;
+
+static void* consumer_thread(void* arg) {
+    worker_t* w = (worker_t*)arg;
+    pthread_barrier_wait(w->start);
+    if (pin_child(w->pin, w->slot, "consumer", w->id, w->cfg->verbose) < 0) w->rc = 1;
+    else w->rc = shm_consumer_run(w->ring, w->id, w->cfg, &w->st);
+    sb_publish_stats(&w->st);
+    return NULL;
+}
+
+static void* producer_thread(void* arg) {
+    worker_t* w = (worker_t*)arg;
+    pthread_barrier_wait(w->start);
+    if (pin_child(w->pin, w->slot, "producer", w->id, w->cfg->verbose) < 0) w->rc = 1;
+    else w->rc = shm_producer_run(w->ring, (uint32_t)w->id, w->cfg, w->st.sb);
+    return NULL;
+}
+
 int main(int argc, char** argv) {
     config_t cfg = {
         .producers = DEFAULT_PRODUCERS,
         .consumers = DEFAULT_CONSUMERS,
         .messages_per_producer = DEFAULT_MESSAGES_PER_PRODUCER,
         .msg_size = DEFAULT_MSG_SIZE,
+        .batch = 1,
         .verbose = 0
     };
-    int slots = 64;
+    shm_opts_t opts;
+    shm_opts_init(&opts);
+    int threads = 0;
+    int numa_given = 0;
+    pin_plan_t pin = {0};
+    int pin_ok = 0;
+    int verify = 0;
+    int sample_ms = 0;
+    double rate = 0.0, rate_per_producer = 0.0;
+    const char* prio_mix = NULL;
 
     for (int i = 1; i < argc; i++) {
         if (!strcmp(argv[i], "--producers") && i + 1 < argc) cfg.producers = parse_int(argv[++i]);
         else if (!strcmp(argv[i], "--consumers") && i + 1 < argc) cfg.consumers = parse_int(argv[++i]);
         else if (!strcmp(argv[i], "--messages") && i + 1 < argc) cfg.messages_per_producer = (uint32_t)parse_int(argv[++i]);
         else if (!strcmp(argv[i], "--msg-size") && i + 1 < argc) cfg.msg_size = (uint32_t)parse_int(argv[++i]);
-        else if (!strcmp(argv[i], "--slots") && i + 1 < argc) slots = parse_int(argv[++i]);
+        else if (!strcmp(argv[i], "--slots") && i + 1 < argc) opts.slots = parse_int(argv[++i]);
+        else if (!strcmp(argv[i], "--engine") && i + 1 < argc) shm_parse_engine(argv[++i], &opts);
+        else if (!strcmp(argv[i], "--topology") && i + 1 < argc) opts.topology = shm_parse_topology(argv[++i]);
+        else if (!strcmp(argv[i], "--ring-bytes") && i + 1 < argc) opts.ring_bytes = parse_int(argv[++i]);
+        else if (!strcmp(argv[i], "--wait") && i + 1 < argc) {
+            opts.wait_policy = shm_parse_wait(argv[++i]);
+            opts.wait_given = 1;
+        }
+        else if (!strcmp(argv[i], "--batch") && i + 1 < argc) cfg.batch = (uint32_t)parse_int(argv[++i]);
+        else if (!strcmp(argv[i], "--threads")) threads = 1;
+        else if (!strcmp(argv[i], "--latency")) cfg.latency = 1;
+        else if (!strcmp(argv[i], "--checksum") && i + 1 < argc) {
+            cfg.checksum = checksum_parse(argv[++i]);
+            if (cfg.checksum < 0) {
+                fprintf(stderr, "Error: --checksum must be 'none', 'crc32c' or 'crc32c-sw'.\n");
+                return 2;
+            }
+        }
+        else if (!strcmp(argv[i], "--rate") && i + 1 < argc) rate = rate_parse(argv[++i]);
+        else if (!strcmp(argv[i], "--rate-per-producer") && i + 1 < argc) rate_per_producer = rate_parse(argv[++i]);
+        else if (!strcmp(argv[i], "--arrival") && i + 1 < argc) {
+            cfg.arrival = arrival_parse(argv[++i]);
+            if (cfg.arrival < 0) {
+                fprintf(stderr, "Error: --arrival must be 'constant' or 'poisson'.\n");
+                return 2;
+            }
+        }
+        else if (!strcmp(argv[i], "--on-full") && i + 1 < argc) {
+            if (onfull_parse(argv[++i], &cfg) < 0) {
+                fprintf(stderr, "Error: --on-full must be 'block', 'drop' or 'retry-timeout=US'.\n");
+                return 2;
+            }
+        }
+        else if (!strcmp(argv[i], "--priorities") && i + 1 < argc) {
+            cfg.priorities = parse_int(argv[++i]);
+            if (cfg.priorities < 1 || cfg.priorities > MAX_PRIORITIES) {
+                fprintf(stderr, "Error: --priorities must be between 1 and %d.\n", MAX_PRIORITIES);
+                return 2;
+            }
+        }
+        else if (!strcmp(argv[i], "--prio-mix") && i + 1 < argc) prio_mix = argv[++i];
+        else if (!strcmp(argv[i], "--starve-limit") && i + 1 < argc) opts.starve_limit = parse_int(argv[++i]);
+        else if (!strcmp(argv[i], "--work-ns") && i + 1 < argc) {
+            if (work_parse(argv[++i], &cfg) < 0) {
+                fprintf(stderr, "Error: --work-ns must be NS, 'fixed:NS', 'exp:NS' or 'bimodal:NS,NS,P'.\n");
+                return 2;
+            }
+        }
+        else if (!strcmp(argv[i], "--consumer-mode") && i + 1 < argc) {
+            const char* v = argv[++i];
+            if (!strcmp(v, "pull")) opts.consumer_mode = CONSUMER_PULL;
+            else if (!strcmp(v, "steal")) opts.consumer_mode = CONSUMER_STEAL;
+            else { fprintf(stderr, "Error: --consumer-mode must be 'pull' or 'steal'.\n"); return 2; }
+        }
+        else if (!strcmp(argv[i], "--verify")) verify = 1;
+        else if (!strcmp(argv[i], "--sample-ms") && i + 1 < argc) sample_ms = parse_int(argv[++i]);
+        else if (!strcmp(argv[i], "--hugepages")) opts.hugepages = 1;
+        else if (!strcmp(argv[i], "--numa-node") && i + 1 < argc) { opts.numa_node = parse_int(argv[++i]); numa_given = 1; }
+        else if (!strcmp(argv[i], "--pin") && i + 1 < argc) pin_ok = parse_pin(argv[++i], &pin);
         else if (!strcmp(argv[i], "--verbose")) cfg.verbose = 1;
         else if (!strcmp(argv[i], "--help") || !strcmp(argv[i], "-h")) { usage(argv[0]); return 0; }
         else { usage(argv[0]); return 1; }
     }
 
-    if (cfg.producers <= 0 || cfg.consumers <= 0 || cfg.messages_per_producer == 0 || cfg.msg_size == 0) {
+    if (cfg.producers <= 0 || cfg.consumers <= 0 || cfg.messages_per_producer == 0 || cfg.msg_size == 0 ||
+        sample_ms < 0 || rate < 0.0 || rate_per_producer < 0.0 || opts.starve_limit < 0) {
         fprintf(stderr, "Error: invalid parameters.\n");
         return 2;
     }
-    if (slots <= 0 || slots > MAX_SLOTS) {
-        fprintf(stderr, "Error: --slots must be between 1 and %d.\n", MAX_SLOTS);
+    if (pacer_configure(&cfg, rate, rate_per_producer) < 0) return 2;
+    if (prio_configure(&cfg, prio_mix) < 0) return 2;
+    opts.threads = threads;
+    char why[160];
+    if (shm_ring_check(&opts, &cfg, why, sizeof(why))) {
+        fprintf(stderr, "Error: %s\n", why);
         return 2;
     }
-    if (cfg.msg_size > MAX_PAYLOAD) {
-        fprintf(stderr, "Error: --msg-size must be <= %d for shared-memory ring slots.\n", MAX_PAYLOAD);
+    int lanes = opts.lanes;
+    if (pin_ok < 0 || pin_plan_build(&pin) < 0) {
+        fprintf(stderr, "Error: --pin must be 'compact', 'scatter' or a list of allowed CPUs like 0,2,4-7.\n");
         return 2;
     }
-
-    // Create unique shm object name
-    char shm_name[128];
-    snprintf(shm_name, sizeof(shm_name), "/cs4800_shm_%ld", (long)getpid());
-
-    int fd = shm_open(shm_name, O_CREAT | O_EXCL | O_RDWR, 0600);
-    if (fd < 0) {
-        perror("shm_open");
-        return 3;
+    if (numa_given) {
+        char node_path[64];
+        snprintf(node_path, sizeof(node_path), "/sys/devices/system/node/node%d", opts.numa_node);
+        if (opts.numa_node < 0 || opts.numa_node >= 64 || access(node_path, F_OK) != 0) {
+            fprintf(stderr, "Error: --numa-node %d is not a NUMA node on this machine.\n", opts.numa_node);
+            return 2;
+        }
     }
 
-    if (ftruncate(fd, sizeof(shm_region_t)) < 0) {
-        perror("ftruncate");
-        shm_unlink(shm_name);
-        close(fd);
-        return 4;
-    }
+    shm_ring_t ring;
+    int create_rc = shm_ring_create(&ring, &opts, &cfg);
+    if (create_rc != 0) return create_rc;
 
-    shm_region_t* shm = (shm_region_t*)mmap(NULL, sizeof(shm_region_t),
-                                            PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-    if (shm == MAP_FAILED) {
-        perror("mmap");
-        shm_unlink(shm_name);
-        close(fd);
-        return 5;
-    }
-    close(fd);
-
-    memset(shm, 0, sizeof(*shm));
-    shm->slots = (uint32_t)slots;
-    shm->msg_size = cfg.msg_size;
-
-    if (sem_init(&shm->empty, 1, (unsigned int)slots) < 0 ||
-        sem_init(&shm->full, 1, 0) < 0 ||
-        sem_init(&shm->mutex, 1, 1) < 0) {
-        perror("sem_init");
-        munmap(shm, sizeof(*shm));
-        shm_unlink(shm_name);
-        return 6;
+    if (cfg.verbose) {
+        fprintf(stderr, "shm_name=%s slots=%d msg_size=%u engine=%s topology=%s map_bytes=%zu\n",
+                ring.name[0] ? ring.name : "(anonymous)", opts.slots, cfg.msg_size, shm_engine_name(&opts),
+                shm_topology_name(opts.topology), ring.map_bytes);
     }
 
-    if (cfg.verbose) {
-        fprintf(stderr, "shm_name=%s slots=%d msg_size=%u\n", shm_name, slots, cfg.msg_size);
+    const char* crc_kernel = crc32c_setup((checksum_t)cfg.checksum);
+
+    lat_hist_t* lats = NULL;
+    if (cfg.latency && !(lats = lat_alloc_shared(cfg.consumers * lanes))) {
+        perror("mmap latency histograms");
+        return 7;
     }
+    stats_block_t* sb = sb_create(cfg.producers, cfg.consumers, cfg.messages_per_producer, verify);
+    if (!sb) return 7;
 
     struct timespec t0, t1;
     clock_gettime(CLOCK_MONOTONIC, &t0);
 
+    int status = 0;
+    int child_error = 0;
+    int total_children = cfg.producers + cfg.consumers;
+    int reaped = 0;
+
+    // --threads: workers[0..C) are consumers, workers[C..C+P) producers. They
+    // all start together off a barrier, and the clock starts when it opens.
+    worker_t* workers = NULL;
+    pthread_barrier_t start;
+    if (threads) {
+        workers = (worker_t*)calloc((size_t)total_children, sizeof(worker_t));
+        if (!workers || pthread_barrier_init(&start, NULL, (unsigned)total_children + 1) != 0) {
+            perror("threads");
+            return 7;
+        }
+        for (int k = 0; k < total_children; k++) {
+            worker_t* w = &workers[k];
+            int is_consumer = k < cfg.consumers;
+            w->ring = &ring;
+            w->cfg = &cfg;
+            w->pin = &pin;
+            w->start = &start;
+            w->slot = k;
+            w->id = is_consumer ? k : k - cfg.consumers;
+            w->st.lat = (lats && is_consumer) ? &lats[k * lanes] : NULL;
+            w->st.sb = sb;
+            w->st.slot = is_consumer ? &sb->slots[k] : NULL;
+            if (pthread_create(&w->tid, NULL, is_consumer ? consumer_thread : producer_thread, w) != 0) {
+                perror("pthread_create");
+                return 7;
+            }
+        }
+        pthread_barrier_wait(&start);
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+    }
+
     // Fork consumers
-    for (int c = 0; c < cfg.consumers; c++) {
+    for (int c = 0; c < cfg.consumers && !threads; c++) {
         pid_t pid = fork();
         if (pid < 0) {
             perror("fork consumer");
             return 7;
         }
         if (pid == 0) {
-            stats_t st = {0};
-            int rc = consumer_run(shm, &cfg, &st);
-            printf("consumer[%d]: received=%llu dup=%llu out_of_range=%llu malformed=%llu\n",
-                   c,
-                   (unsigned long long)st.total_received,
-                   (unsigned long long)st.duplicates,
-                   (unsigned long long)st.out_of_range,
-                   (unsigned long long)st.malformed);
+            if (pin_child(&pin, c, "consumer", c, cfg.verbose) < 0) _exit(1);
+            stats_t st = { .lat = lats ? &lats[c * lanes] : NULL, .sb = sb, .slot = &sb->slots[c] };
+            int rc = shm_consumer_run(&ring, c, &cfg, &st);
+            sb_publish_stats(&st);
+            sb_print_consumer(stdout, c, &st);
+            fflush(stdout); // _exit() skips stdio flushing when stdout is a pipe
             _exit(rc);
         }
     }
 
     // Fork producers
-    for (int p = 0; p < cfg.producers; p++) {
+    for (int p = 0; p < cfg.producers && !threads; p++) {
         pid_t pid = fork();
         if (pid < 0) {
             perror("fork producer");
             return 8;
         }
         if (pid == 0) {
-            int rc = producer_run(shm, (uint32_t)p, &cfg);
+            if (pin_child(&pin, cfg.consumers + p, "producer", p, cfg.verbose) < 0) _exit(1);
+            int rc = shm_producer_run(&ring, (uint32_t)p, &cfg, sb);
             _exit(rc);
         }
     }
 
-    // Wait for producers first
-    int status = 0;
-    int producers_done = 0;
-    int child_error = 0;
-    int total_children = cfg.producers + cfg.consumers;
-    int reaped = 0;
+    // Started after the last fork so no child inherits a held stdio lock
+    sb_sampler_t* sampler = sample_ms ? sb_sampler_start(sb, sample_ms, stdout) : NULL;
 
-    while (producers_done < cfg.producers) {
+    // In the spsc topology producers close their own rings, so there is no
+    // sentinel phase and consumers may exit before the last producer is reaped.
+    // Otherwise consumers stay blocked until their sentinel, so the first
+    // cfg.producers children to exit are the producers.
+    int producers_to_wait = (opts.topology == TOPOLOGY_SHARED) ? cfg.producers : 0;
+
+    if (threads) {
+        for (int p = 0; p < cfg.producers; p++) {
+            worker_t* w = &workers[cfg.consumers + p];
+            pthread_join(w->tid, NULL);
+            if (w->rc != 0) child_error = 1;
+        }
+        producers_to_wait = 0;
+    }
+
+    for (int producers_done = 0; producers_done < producers_to_wait; ) {
         pid_t w = wait(&status);
         if (w < 0) {
             if (errno == EINTR) continue;
@@ -280,24 +432,23 @@ int main(int argc, char** argv) {
             break;
         }
         reaped++;
-        producers_done++; // we don't distinguish here; good enough if producers were forked last? no
-        // Correction: this loop assumes producer-only waits, but consumers may exit later only after sentinel.
-        // Consumers should still be blocked, so the first cfg.producers exits should all be producers.
+        producers_done++;
         if ((WIFEXITED(status) && WEXITSTATUS(status) != 0) || WIFSIGNALED(status)) child_error = 1;
     }
 
     // Send one sentinel per consumer
-    shm_msg_t sentinel;
-    memset(&sentinel, 0, sizeof(sentinel));
-    sentinel.hdr.producer_id = SENTINEL_PRODUCER_ID;
-    sentinel.hdr.seq = 0;
-    sentinel.hdr.payload_len = cfg.msg_size;
-
-    for (int i = 0; i < cfg.consumers; i++) {
-        if (queue_push(shm, &sentinel) < 0) {
-            perror("queue_push sentinel");
-            child_error = 1;
+    if (shm_ring_finish(&ring) < 0) child_error = 1;
+
+    if (threads) {
+        for (int c = 0; c < cfg.consumers; c++) {
+            worker_t* w = &workers[c];
+            pthread_join(w->tid, NULL);
+            sb_print_consumer(stdout, c, &w->st);
+            if (w->rc != 0) child_error = 1;
         }
+        pthread_barrier_destroy(&start);
+        free(workers);
+        reaped = total_children;
     }
 
     // Reap remaining consumers
@@ -312,21 +463,43 @@ int main(int argc, char** argv) {
     }
 
     clock_gettime(CLOCK_MONOTONIC, &t1);
+    sb_sampler_stop(sampler);
     double sec = elapsed_sec(t0, t1);
 
     unsigned long long total_msgs =
-        (unsigned long long)cfg.producers * (unsigned long long)cfg.messages_per_producer;
+        (unsigned long long)cfg.producers * (unsigned long long)cfg.messages_per_producer - sb_dropped(sb);
     double msgs_per_sec = (sec > 0.0) ? ((double)total_msgs / sec) : 0.0;
-
-    printf("run(shm_sem): producers=%d consumers=%d messages_per_producer=%u msg_size=%u slots=%d\n",
-           cfg.producers, cfg.consumers, cfg.messages_per_producer, cfg.msg_size, slots);
+    char onfull_buf[32];
+    char work_buf[64];
+
+    sb_report_producers(sb, stdout);
+    printf("run(shm_sem): producers=%d consumers=%d messages_per_producer=%u msg_size=%u slots=%d engine=%s topology=%s batch=%u",
+           cfg.producers, cfg.consumers, cfg.messages_per_producer, cfg.msg_size, opts.slots,
+           shm_engine_name(&opts), shm_topology_name(opts.topology), cfg.batch);
+    if (threads) printf(" mode=threads");
+    if (opts.engine == ENGINE_BYTES && opts.topology == TOPOLOGY_SHARED) printf(" ring_bytes=%d", opts.ring_bytes);
+    if (cfg.checksum) printf(" checksum=crc32c/%s", crc_kernel);
+    if (cfg.rate > 0.0) printf(" rate=%.0f arrival=%s", cfg.rate * cfg.producers, arrival_name((arrival_t)cfg.arrival));
+    if (cfg.on_full != ONFULL_BLOCK) printf(" on_full=%s", onfull_name(&cfg, onfull_buf, sizeof(onfull_buf)));
+    if (lanes > 1) printf(" priorities=%d prio_mix=%s starve_limit=%d", lanes, prio_mix ? prio_mix : "equal", opts.starve_limit);
+    if (cfg.work) printf(" work=%s", work_name(&cfg, work_buf, sizeof(work_buf)));
+    if (opts.consumer_mode == CONSUMER_STEAL) printf(" consumer_mode=steal");
+    printf("\n");
+    if (opts.hugepages || opts.numa_node >= 0 || pin.policy != PIN_NONE) {
+        printf("placement: pages=%s numa_node=%d pin=%s\n",
+               ring.page_mode, opts.numa_node, pin_name((pin_policy_t)pin.policy));
+    }
     printf("timing: %.3f sec | approx %.0f msgs/sec\n", sec, msgs_per_sec);
+    if (lats) {
+        lat_report(stdout, lats, cfg.consumers * lanes);
+        if (lanes > 1) lat_report_lanes(stdout, lats, cfg.consumers, lanes);
+        lat_free_shared(lats, cfg.consumers * lanes);
+    }
+    shm_ring_report_waits(&ring, stdout);
+    int mismatch = sb_report(sb, stdout);
+    sb_destroy(sb);
+    shm_ring_destroy(&ring);
 
-    sem_destroy(&shm->empty);
-    sem_destroy(&shm->full);
-    sem_destroy(&shm->mutex);
-    munmap(shm, sizeof(*shm));
-    shm_unlink(shm_name);
-
-    return child_error ? 9 : 0;
-}
\ No newline at end of file
+    if (child_error) return 9;
+    return mismatch ? SB_EXIT_MISMATCH : 0;
+}
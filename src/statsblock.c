@@ -0,0 +1,223 @@
+#include "statsblock.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#define SB_MAX_GAPS_SHOWN 5
+
+stats_block_t* sb_create(int producers, int consumers, uint32_t messages_per_producer, int verify) {
+    size_t prod_off = sizeof(stats_block_t) + sizeof(sb_slot_t) * (size_t)consumers;
+    size_t head = prod_off + sizeof(sb_prod_t) * (size_t)producers;
+    head = (head + SB_CACHE_LINE - 1) / SB_CACHE_LINE * SB_CACHE_LINE;
+    size_t bits = (size_t)producers * messages_per_producer;
+    size_t bitmap_bytes = verify ? (bits + 63) / 64 * 8 : 0;
+
+    // Bitmap pages are only touched as messages arrive
+    size_t map_bytes = head + bitmap_bytes;
+    void* p = mmap(NULL, map_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (p == MAP_FAILED) {
+        perror("mmap stats block");
+        return NULL;
+    }
+    stats_block_t* sb = (stats_block_t*)p;
+    sb->producers = (uint32_t)producers;
+    sb->consumers = (uint32_t)consumers;
+    sb->messages_per_producer = messages_per_producer;
+    sb->prod = (sb_prod_t*)((char*)p + prod_off);
+    sb->bitmap = verify ? (uint64_t*)((char*)p + head) : NULL;
+    sb->bitmap_bytes = bitmap_bytes;
+    sb->map_bytes = map_bytes;
+    return sb;
+}
+
+void sb_destroy(stats_block_t* sb) {
+    if (sb) munmap(sb, sb->map_bytes);
+}
+
+void sb_publish(sb_slot_t* slot, uint64_t received, uint64_t duplicates, uint64_t out_of_range,
+                uint64_t malformed, uint64_t late) {
+    slot->duplicates = duplicates;
+    slot->out_of_range = out_of_range;
+    slot->malformed = malformed;
+    slot->late = late;
+    __atomic_store_n(&slot->received, received, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->done, 1, __ATOMIC_RELEASE);
+}
+
+void sb_publish_stats(const stats_t* st) {
+    sb_publish(st->slot, st->total_received, st->duplicates, st->out_of_range, st->malformed, st->late);
+}
+
+void sb_print_consumer(FILE* out, int c, const stats_t* st) {
+    fprintf(out, "consumer[%d]: received=%llu dup=%llu out_of_range=%llu malformed=%llu late=%llu",
+            c,
+            (unsigned long long)st->total_received,
+            (unsigned long long)st->duplicates,
+            (unsigned long long)st->out_of_range,
+            (unsigned long long)st->malformed,
+            (unsigned long long)st->late);
+    if (st->stolen) fprintf(out, " stolen=%llu", (unsigned long long)st->stolen);
+    fprintf(out, "\n");
+}
+
+uint64_t sb_dropped(const stats_block_t* sb) {
+    uint64_t sum = 0;
+    for (uint32_t p = 0; p < sb->producers; p++) sum += sb->prod[p].dropped;
+    return sum;
+}
+
+uint64_t sb_received(const stats_block_t* sb) {
+    uint64_t sum = 0;
+    for (uint32_t c = 0; c < sb->consumers; c++) sum += __atomic_load_n(&sb->slots[c].received, __ATOMIC_RELAXED);
+    return sum;
+}
+
+static int bit_is_set(const stats_block_t* sb, uint64_t bit) {
+    return (sb->bitmap[bit >> 6] >> (bit & 63)) & 1;
+}
+
+int sb_report(const stats_block_t* sb, FILE* out) {
+    uint64_t expected = (uint64_t)sb->producers * sb->messages_per_producer;
+    sb_slot_t sum;
+    memset(&sum, 0, sizeof(sum));
+    uint64_t unfinished = 0;
+    for (uint32_t c = 0; c < sb->consumers; c++) {
+        const sb_slot_t* s = &sb->slots[c];
+        sum.received += s->received;
+        sum.duplicates += s->duplicates;
+        sum.out_of_range += s->out_of_range;
+        sum.malformed += s->malformed;
+        sum.late += s->late;
+        if (!__atomic_load_n(&s->done, __ATOMIC_ACQUIRE)) unfinished++;
+    }
+
+    uint64_t dropped = sb_dropped(sb);
+
+    int bad = unfinished || sum.received + dropped != expected || sum.duplicates || sum.out_of_range ||
+              sum.malformed;
+
+    fprintf(out, "verify: expected=%llu received=%llu", (unsigned long long)expected,
+            (unsigned long long)sum.received);
+    if (dropped) fprintf(out, " dropped=%llu", (unsigned long long)dropped);
+    fprintf(out, " dup=%llu out_of_range=%llu malformed=%llu late=%llu",
+            (unsigned long long)sum.duplicates, (unsigned long long)sum.out_of_range,
+            (unsigned long long)sum.malformed, (unsigned long long)sum.late);
+    if (unfinished) fprintf(out, " unfinished_consumers=%llu", (unsigned long long)unfinished);
+
+    uint64_t lost = 0;
+    if (sb->bitmap) {
+        for (uint64_t w = 0; w < (expected + 63) / 64; w++) {
+            uint64_t word = sb->bitmap[w];
+            if (w == expected / 64) word |= ~0ull << (expected & 63); // bits past the end
+            lost += (uint64_t)__builtin_popcountll(~word);
+        }
+        uint64_t gdup = __atomic_load_n(&sb->global_dups, __ATOMIC_RELAXED);
+        fprintf(out, " lost=%llu global_dup=%llu", (unsigned long long)lost, (unsigned long long)gdup);
+        if (lost || gdup) bad = 1;
+    }
+    fprintf(out, " status=%s\n", bad ? "MISMATCH" : "ok");
+
+    // First few missing seq ranges, e.g. "gap: producer=1 seq=500..511"
+    int shown = 0;
+    for (uint32_t p = 0; p < sb->producers && lost && shown < SB_MAX_GAPS_SHOWN; p++) {
+        uint64_t base = (uint64_t)p * sb->messages_per_producer;
+        uint32_t s = 0;
+        while (s < sb->messages_per_producer && shown < SB_MAX_GAPS_SHOWN) {
+            if (bit_is_set(sb, base + s)) { s++; continue; }
+            uint32_t from = s;
+            while (s < sb->messages_per_producer && !bit_is_set(sb, base + s)) s++;
+            fprintf(out, "gap: producer=%u seq=%u..%u\n", p, from, s - 1);
+            shown++;
+        }
+    }
+    return bad;
+}
+
+void sb_report_producers(const stats_block_t* sb, FILE* out) {
+    for (uint32_t p = 0; p < sb->producers; p++) {
+        const sb_prod_t* s = &sb->prod[p];
+        fprintf(out, "producer[%u]: sent=%llu dropped=%llu full=%llu blocked_ms=%.3f\n", p,
+                (unsigned long long)(sb->messages_per_producer - s->dropped), (unsigned long long)s->dropped,
+                (unsigned long long)s->full, (double)s->blocked_ns / 1e6);
+    }
+}
+
+struct sb_sampler {
+    const stats_block_t* sb;
+    int interval_ms;
+    FILE* out;
+    int stop;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_t tid;
+};
+
+static double since(const struct timespec* t0) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - t0->tv_sec) + (double)(now.tv_nsec - t0->tv_nsec) / 1e9;
+}
+
+static void* sampler_main(void* arg) {
+    sb_sampler_t* s = (sb_sampler_t*)arg;
+    struct timespec t0, deadline;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    deadline = t0;
+    uint64_t last = sb_received(s->sb);
+    double last_t = 0.0;
+
+    pthread_mutex_lock(&s->lock);
+    while (!s->stop) {
+        deadline.tv_nsec += (long)s->interval_ms * 1000000L;
+        deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+        deadline.tv_nsec %= 1000000000L;
+        while (!s->stop && pthread_cond_timedwait(&s->cond, &s->lock, &deadline) == 0) {}
+        if (s->stop) break;
+
+        double t = since(&t0);
+        uint64_t now = sb_received(s->sb);
+        double rate = (t > last_t) ? (double)(now - last) / (t - last_t) : 0.0;
+        fprintf(s->out, "sample: t=%.3fs received=%llu rate=%.0f msgs/sec\n", t, (unsigned long long)now, rate);
+        fflush(s->out);
+        last = now;
+        last_t = t;
+    }
+    pthread_mutex_unlock(&s->lock);
+    return NULL;
+}
+
+sb_sampler_t* sb_sampler_start(const stats_block_t* sb, int interval_ms, FILE* out) {
+    sb_sampler_t* s = (sb_sampler_t*)calloc(1, sizeof(*s));
+    if (!s) return NULL;
+    s->sb = sb;
+    s->interval_ms = interval_ms;
+    s->out = out;
+    pthread_condattr_t ca;
+    pthread_condattr_init(&ca);
+    pthread_condattr_setclock(&ca, CLOCK_MONOTONIC);
+    pthread_cond_init(&s->cond, &ca);
+    pthread_condattr_destroy(&ca);
+    pthread_mutex_init(&s->lock, NULL);
+    if (pthread_create(&s->tid, NULL, sampler_main, s) != 0) {
+        perror("pthread_create sampler");
+        pthread_cond_destroy(&s->cond);
+        pthread_mutex_destroy(&s->lock);
+        free(s);
+        return NULL;
+    }
+    return s;
+}
+
+void sb_sampler_stop(sb_sampler_t* s) {
+    if (!s) return;
+    pthread_mutex_lock(&s->lock);
+    s->stop = 1;
+    pthread_cond_signal(&s->cond);
+    pthread_mutex_unlock(&s->lock);
+    pthread_join(s->tid, NULL);
+    pthread_cond_destroy(&s->cond);
+    pthread_mutex_destroy(&s->lock);
+    free(s);
+}
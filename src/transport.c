@@ -0,0 +1,47 @@
+#include "transport.h"
+#include <stdio.h>
+#include <string.h>
+
+static const transport_ops_t* const registry[] = {
+    &transport_pipes,
+    &transport_shm,
+    &transport_mq,
+    &transport_uds,
+};
+
+#define NTRANSPORTS (sizeof(registry) / sizeof(registry[0]))
+
+const transport_ops_t* transport_find(const char* name) {
+    for (size_t i = 0; i < NTRANSPORTS; i++) {
+        if (!strcmp(registry[i]->name, name)) return registry[i];
+    }
+    return NULL;
+}
+
+const char* transport_names(void) {
+    return "pipes,shm,mq,uds";
+}
+
+int transport_has(const char* const* list, const char* name) {
+    for (; *list; list++) {
+        if (!strcmp(*list, name)) return 1;
+    }
+    return 0;
+}
+
+int transport_select(transport_t* t) {
+    const transport_ops_t* ops = t->ops;
+    if (!t->engine) t->engine = ops->engines[0];
+    if (!t->topology) t->topology = ops->topologies[0];
+    t->batch = t->cfg->batch;
+
+    if (!transport_has(ops->engines, t->engine)) {
+        snprintf(t->why, sizeof(t->why), "no engine %s on %s", t->engine, ops->name);
+    } else if (!transport_has(ops->topologies, t->topology)) {
+        snprintf(t->why, sizeof(t->why), "no topology %s on %s", t->topology, ops->name);
+    } else {
+        return 0;
+    }
+    t->note = t->why;
+    return TRANSPORT_UNSUPPORTED;
+}
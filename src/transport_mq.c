@@ -0,0 +1,59 @@
+#include "transport.h"
+#include "mq_shard.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+static const char* const engines[] = { "mqueue", NULL };
+static const char* const topologies[] = { "shared", NULL };
+
+// The ipc_mq queues (mq_shard.c): --queues shards, each at --depth messages
+// or the unprivileged msg_max, producers picking by id.
+static int mq_t_open(transport_t* t) {
+    int rc = transport_select(t);
+    if (rc != 0) return rc;
+
+    mq_shard_t* m = (mq_shard_t*)malloc(sizeof(*m));
+    if (!m) return -1;
+    mq_shard_limits(m);
+    size_t msg_bytes = sizeof(msg_hdr_t) + t->cfg->msg_size;
+    if (t->cfg->batch > 1) t->note = "mq sends one message per call";
+    else if (t->queues > MQ_MAX_QUEUES) t->note = "queues above MQ_MAX_QUEUES";
+    else if ((long)msg_bytes > m->msgsize_max) t->note = "frame exceeds " MQ_MSGSIZE_MAX_PATH;
+    if (t->note) {
+        free(m);
+        return TRANSPORT_UNSUPPORTED;
+    }
+
+    int maxmsg = (t->depth > 0 && t->depth < m->msg_max) ? t->depth : (int)m->msg_max;
+    if (mq_shard_open(m, t->queues, maxmsg, PICK_ID, msg_bytes) != 0) {
+        free(m);
+        return -1;
+    }
+    t->impl = m;
+    return 0;
+}
+
+static int mq_t_producer(transport_t* t, int id) {
+    return mq_shard_producer_run((const mq_shard_t*)t->impl, (uint32_t)id, t->cfg, t->sb);
+}
+
+static int mq_t_consumer(transport_t* t, int id, stats_t* st) {
+    (void)id;
+    return mq_shard_consumer_run((mq_shard_t*)t->impl, t->cfg, st);
+}
+
+static int mq_t_finish(transport_t* t) {
+    return mq_shard_finish((const mq_shard_t*)t->impl, t->cfg);
+}
+
+static void mq_t_close(transport_t* t) {
+    mq_shard_t* m = (mq_shard_t*)t->impl;
+    if (!m) return;
+    mq_shard_close(m);
+    free(m);
+    t->impl = NULL;
+}
+
+const transport_ops_t transport_mq = {
+    "mq", engines, topologies, mq_t_open, mq_t_producer, mq_t_consumer, mq_t_finish, mq_t_close
+};
@@ -0,0 +1,119 @@
+#include "transport.h"
+#include "pipes.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define DEFAULT_URING_DEPTH 8
+
+static const char* const engines[] = { "sync", "uring", NULL };
+static const char* const topologies[] = { "shared", "fanin", NULL };
+
+// The ipc_pipes loops (producer.c, consumer.c) over one shared pipe, or one
+// pipe per producer with --topology fanin.
+typedef struct {
+    config_t cfg;        // t->cfg with the batch capped by pipes_max_batch()
+    topology_t topology;
+    int use_uring;
+    int uring_depth;
+    int npipes;
+    int fds[];           // [2k] read end, [2k+1] write end
+} pipes_t;
+
+static int pipes_open(transport_t* t) {
+    int rc = transport_select(t);
+    if (rc != 0) return rc;
+
+    const config_t* cfg = t->cfg;
+    topology_t topology = strcmp(t->topology, "fanin") ? TOPOLOGY_SHARED : TOPOLOGY_FANIN;
+    int use_uring = !strcmp(t->engine, "uring");
+    int uring_depth = t->depth > 0 ? t->depth : DEFAULT_URING_DEPTH;
+    size_t msg_bytes = sizeof(msg_hdr_t) + cfg->msg_size;
+
+    if (use_uring && topology != TOPOLOGY_SHARED) t->note = "uring needs topology shared";
+    else if (uring_depth > 4096) t->note = "uring depth above 4096";
+    else if (t->queues > 1) t->note = "queues > 1 needs mq";
+    else if (topology == TOPOLOGY_SHARED && msg_bytes > (size_t)PIPE_BUF) t->note = "frame exceeds PIPE_BUF";
+    if (t->note) return TRANSPORT_UNSUPPORTED;
+
+    int npipes = (topology == TOPOLOGY_SHARED) ? 1 : cfg->producers;
+    pipes_t* p = (pipes_t*)malloc(sizeof(*p) + sizeof(int) * 2 * (size_t)npipes);
+    if (!p) return -1;
+    p->cfg = *cfg;
+    uint32_t max_batch = pipes_max_batch(topology, msg_bytes);
+    if (p->cfg.batch > max_batch) p->cfg.batch = max_batch;
+    p->topology = topology;
+    p->use_uring = use_uring;
+    p->uring_depth = uring_depth;
+    p->npipes = 0;
+    t->impl = p;
+    for (int k = 0; k < npipes; k++) {
+        if (pipe(&p->fds[2 * k]) != 0) {
+            perror("pipe");
+            return -1;
+        }
+        p->npipes++;
+    }
+    t->batch = p->cfg.batch;
+    return 0;
+}
+
+// Keep only its own write end
+static int pipes_producer(transport_t* t, int id) {
+    pipes_t* p = (pipes_t*)t->impl;
+    int out = (p->topology == TOPOLOGY_SHARED) ? 0 : id;
+    for (int k = 0; k < p->npipes; k++) {
+        close(p->fds[2 * k]);
+        if (k != out) close(p->fds[2 * k + 1]);
+    }
+    int out_fd = p->fds[2 * out + 1];
+    int rc = p->use_uring ? producer_run_uring(out_fd, (uint32_t)id, &p->cfg, (uint32_t)p->uring_depth)
+                          : producer_run(out_fd, (uint32_t)id, &p->cfg, t->sb);
+    close(out_fd);
+    return rc;
+}
+
+// Keep only the read ends it owns, or EOF never arrives
+static int pipes_consumer(transport_t* t, int id, stats_t* st) {
+    pipes_t* p = (pipes_t*)t->impl;
+    int* owned = (int*)malloc(sizeof(int) * (size_t)p->npipes);
+    if (!owned) return 1;
+    int nowned = 0;
+    for (int k = 0; k < p->npipes; k++) {
+        close(p->fds[2 * k + 1]);
+        if (p->topology == TOPOLOGY_SHARED || k % p->cfg.consumers == id) owned[nowned++] = p->fds[2 * k];
+        else close(p->fds[2 * k]);
+    }
+
+    int rc;
+    if (p->topology == TOPOLOGY_FANIN) rc = consumer_run_fanin(owned, nowned, -1, &p->cfg, st);
+    else if (p->use_uring) rc = consumer_run_uring(owned[0], &p->cfg, (uint32_t)p->uring_depth, st);
+    else rc = consumer_run(owned[0], &p->cfg, st);
+    for (int k = 0; k < nowned; k++) close(owned[k]);
+    free(owned);
+    return rc;
+}
+
+static int pipes_finish(transport_t* t) {
+    pipes_t* p = (pipes_t*)t->impl;
+    for (int k = 0; k < p->npipes; k++) {
+        close(p->fds[2 * k + 1]);
+        p->fds[2 * k + 1] = -1;
+    }
+    return 0;
+}
+
+static void pipes_close(transport_t* t) {
+    pipes_t* p = (pipes_t*)t->impl;
+    if (!p) return;
+    for (int k = 0; k < 2 * p->npipes; k++) {
+        if (p->fds[k] >= 0) close(p->fds[k]);
+    }
+    free(p);
+    t->impl = NULL;
+}
+
+const transport_ops_t transport_pipes = {
+    "pipes", engines, topologies, pipes_open, pipes_producer, pipes_consumer, pipes_finish, pipes_close
+};
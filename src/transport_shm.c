@@ -0,0 +1,57 @@
+#include "transport.h"
+#include "shm_ring.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char* const engines[] = { "sem", "lockfree", "eventfd", "bytes", NULL };
+static const char* const topologies[] = { "shared", "spsc", NULL };
+
+// The ipc_shm_sem ring (shm_ring.c) with its defaults, --depth as the slot
+// count. Checked with the binary's own rules; a refusal becomes the note.
+static int shm_t_open(transport_t* t) {
+    int rc = transport_select(t);
+    if (rc != 0) return rc;
+
+    shm_opts_t o;
+    shm_opts_init(&o);
+    shm_parse_engine(t->engine, &o);
+    o.topology = shm_parse_topology(t->topology);
+    if (t->depth > 0) o.slots = t->depth;
+    if (t->queues > 1) t->note = "queues > 1 needs mq";
+    else t->note = shm_ring_check(&o, t->cfg, t->why, sizeof(t->why));
+    if (t->note) return TRANSPORT_UNSUPPORTED;
+
+    shm_ring_t* r = (shm_ring_t*)malloc(sizeof(*r));
+    if (!r) return -1;
+    if (shm_ring_create(r, &o, t->cfg) != 0) {
+        free(r);
+        return -1;
+    }
+    t->impl = r;
+    return 0;
+}
+
+static int shm_t_producer(transport_t* t, int id) {
+    return shm_producer_run((shm_ring_t*)t->impl, (uint32_t)id, t->cfg, t->sb);
+}
+
+static int shm_t_consumer(transport_t* t, int id, stats_t* st) {
+    return shm_consumer_run((shm_ring_t*)t->impl, id, t->cfg, st);
+}
+
+static int shm_t_finish(transport_t* t) {
+    return shm_ring_finish((shm_ring_t*)t->impl);
+}
+
+static void shm_t_close(transport_t* t) {
+    shm_ring_t* r = (shm_ring_t*)t->impl;
+    if (!r) return;
+    shm_ring_destroy(r);
+    free(r);
+    t->impl = NULL;
+}
+
+const transport_ops_t transport_shm = {
+    "shm", engines, topologies, shm_t_open, shm_t_producer, shm_t_consumer, shm_t_finish, shm_t_close
+};
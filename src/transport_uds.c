@@ -0,0 +1,69 @@
+#include "transport.h"
+#include "uds_pair.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+static const char* const engines[] = { "seqpacket", NULL };
+static const char* const topologies[] = { "shared", NULL };
+
+// The ipc_uds socketpair (uds_pair.c): producers send on sv[0], consumers
+// receive on sv[1], up to --batch frames per sendmmsg/recvmmsg.
+typedef struct {
+    int sv[2];
+} uds_t;
+
+static int uds_open(transport_t* t) {
+    int rc = transport_select(t);
+    if (rc != 0) return rc;
+    if (t->cfg->batch > UDS_MAX_BATCH) t->note = "batch above UDS_MAX_BATCH";
+    else if (t->queues > 1) t->note = "queues > 1 needs mq";
+    if (t->note) return TRANSPORT_UNSUPPORTED;
+
+    uds_t* u = (uds_t*)malloc(sizeof(*u));
+    if (!u) return -1;
+    int sndbuf = uds_pair_open(u->sv, 0);
+    if (sndbuf < 0) {
+        free(u);
+        return -1;
+    }
+    t->impl = u;
+    if (sizeof(msg_hdr_t) + t->cfg->msg_size > (size_t)sndbuf) {
+        t->note = "frame exceeds socket send buffer";
+        return TRANSPORT_UNSUPPORTED;
+    }
+    return 0;
+}
+
+static int uds_producer(transport_t* t, int id) {
+    uds_t* u = (uds_t*)t->impl;
+    close(u->sv[1]);
+    return uds_producer_run(u->sv[0], (uint32_t)id, t->cfg, t->sb);
+}
+
+static int uds_consumer(transport_t* t, int id, stats_t* st) {
+    (void)id;
+    uds_t* u = (uds_t*)t->impl;
+    close(u->sv[0]); // or EOF never arrives
+    return uds_consumer_run(u->sv[1], t->cfg, st);
+}
+
+static int uds_finish(transport_t* t) {
+    uds_t* u = (uds_t*)t->impl;
+    close(u->sv[0]);
+    u->sv[0] = -1;
+    return 0;
+}
+
+static void uds_close(transport_t* t) {
+    uds_t* u = (uds_t*)t->impl;
+    if (!u) return;
+    if (u->sv[0] >= 0) close(u->sv[0]);
+    if (u->sv[1] >= 0) close(u->sv[1]);
+    free(u);
+    t->impl = NULL;
+}
+
+const transport_ops_t transport_uds = {
+    "uds", engines, topologies, uds_open, uds_producer, uds_consumer, uds_finish, uds_close
+};
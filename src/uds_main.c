@@ -0,0 +1,273 @@
+#include "common.h"
+#include "latency.h"
+#include "seqtrack.h"
+#include "statsblock.h"
+#include "crc32c.h"
+#include "pacer.h"
+#include "onfull.h"
+#include "uds_pair.h"
+#include "util.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/wait.h>
+#include <pthread.h>
+
+static void usage(const char* prog) {
+    fprintf(stderr,
+        "Usage: %s [--producers N] [--consumers N] [--messages M] [--msg-size BYTES] [--batch N]\n"
+        "          [--sndbuf BYTES] [--threads] [--latency]\n"
+        "          [--checksum none|crc32c|crc32c-sw] [--verify] [--sample-ms N]\n"
+        "          [--rate MSGS_PER_SEC | --rate-per-producer MSGS_PER_SEC] [--arrival constant|poisson]\n"
+        "          [--on-full block|drop|retry-timeout=US] [--verbose]\n"
+        "Example:\n"
+        "  %s --producers 4 --consumers 2 --messages 20000 --msg-size 64 --batch 32\n",
+        prog, prog
+    );
+}
+
+// --threads: one pthread per producer/consumer on the same socketpair
+typedef struct {
+    pthread_barrier_t* start;
+    const config_t* cfg;
+    int fd;
+    int is_consumer;
+    int id;
+    int rc;
+    stats_t st;
+    pthread_t tid;
+} worker_t;
+
+static void* worker_main(void* arg) {
+    worker_t* w = (worker_t*)arg;
+    pthread_barrier_wait(w->start);
+    if (w->is_consumer) {
+        w->rc = uds_consumer_run(w->fd, w->cfg, &w->st);
+        sb_publish_stats(&w->st);
+    } else w->rc = uds_producer_run(w->fd, (uint32_t)w->id, w->cfg, w->st.sb);
+    return NULL;
+}
+
+int main(int argc, char** argv) {
+    config_t cfg = {
+        .producers = DEFAULT_PRODUCERS,
+        .consumers = DEFAULT_CONSUMERS,
+        .messages_per_producer = DEFAULT_MESSAGES_PER_PRODUCER,
+        .msg_size = DEFAULT_MSG_SIZE,
+        .batch = 1,
+        .verbose = 0
+    };
+    int sndbuf = 0; // 0 = kernel default
+    int threads = 0;
+    int verify = 0;
+    int sample_ms = 0;
+    double rate = 0.0, rate_per_producer = 0.0;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--producers") && i + 1 < argc) cfg.producers = parse_int(argv[++i]);
+        else if (!strcmp(argv[i], "--consumers") && i + 1 < argc) cfg.consumers = parse_int(argv[++i]);
+        else if (!strcmp(argv[i], "--messages") && i + 1 < argc) cfg.messages_per_producer = (uint32_t)parse_int(argv[++i]);
+        else if (!strcmp(argv[i], "--msg-size") && i + 1 < argc) cfg.msg_size = (uint32_t)parse_int(argv[++i]);
+        else if (!strcmp(argv[i], "--batch") && i + 1 < argc) cfg.batch = (uint32_t)parse_int(argv[++i]);
+        else if (!strcmp(argv[i], "--sndbuf") && i + 1 < argc) sndbuf = parse_int(argv[++i]);
+        else if (!strcmp(argv[i], "--threads")) threads = 1;
+        else if (!strcmp(argv[i], "--latency")) cfg.latency = 1;
+        else if (!strcmp(argv[i], "--checksum") && i + 1 < argc) {
+            cfg.checksum = checksum_parse(argv[++i]);
+            if (cfg.checksum < 0) {
+                fprintf(stderr, "Error: --checksum must be 'none', 'crc32c' or 'crc32c-sw'.\n");
+                return 2;
+            }
+        }
+        else if (!strcmp(argv[i], "--rate") && i + 1 < argc) rate = rate_parse(argv[++i]);
+        else if (!strcmp(argv[i], "--rate-per-producer") && i + 1 < argc) rate_per_producer = rate_parse(argv[++i]);
+        else if (!strcmp(argv[i], "--arrival") && i + 1 < argc) {
+            cfg.arrival = arrival_parse(argv[++i]);
+            if (cfg.arrival < 0) {
+                fprintf(stderr, "Error: --arrival must be 'constant' or 'poisson'.\n");
+                return 2;
+            }
+        }
+        else if (!strcmp(argv[i], "--on-full") && i + 1 < argc) {
+            if (onfull_parse(argv[++i], &cfg) < 0) {
+                fprintf(stderr, "Error: --on-full must be 'block', 'drop' or 'retry-timeout=US'.\n");
+                return 2;
+            }
+        }
+        else if (!strcmp(argv[i], "--verify")) verify = 1;
+        else if (!strcmp(argv[i], "--sample-ms") && i + 1 < argc) sample_ms = parse_int(argv[++i]);
+        else if (!strcmp(argv[i], "--verbose")) cfg.verbose = 1;
+        else if (!strcmp(argv[i], "--help") || !strcmp(argv[i], "-h")) { usage(argv[0]); return 0; }
+        else { usage(argv[0]); return 1; }
+    }
+
+    if (cfg.producers <= 0 || cfg.consumers <= 0 || cfg.messages_per_producer == 0 || cfg.msg_size == 0 ||
+        sample_ms < 0 || rate < 0.0 || rate_per_producer < 0.0) {
+        fprintf(stderr, "Error: invalid parameters.\n");
+        return 2;
+    }
+    if (pacer_configure(&cfg, rate, rate_per_producer) < 0) return 2;
+    if (cfg.batch == 0 || cfg.batch > UDS_MAX_BATCH) {
+        fprintf(stderr, "Error: --batch must be between 1 and %d.\n", UDS_MAX_BATCH);
+        return 2;
+    }
+    if (sndbuf < 0) {
+        fprintf(stderr, "Error: --sndbuf must be >= 0.\n");
+        return 2;
+    }
+
+    int sv[2];
+    int eff_sndbuf = uds_pair_open(sv, sndbuf);
+    if (eff_sndbuf < 0) return 3;
+    size_t msg_bytes = sizeof(msg_hdr_t) + (size_t)cfg.msg_size;
+    if (msg_bytes > (size_t)eff_sndbuf) {
+        fprintf(stderr, "Error: message size (%zu) exceeds the socket send buffer (%d). Raise --sndbuf.\n",
+                msg_bytes, eff_sndbuf);
+        return 2;
+    }
+
+    if (cfg.verbose) {
+        fprintf(stderr, "socketpair(AF_UNIX, SOCK_SEQPACKET) msg_bytes=%zu sndbuf=%d batch=%u\n",
+                msg_bytes, eff_sndbuf, cfg.batch);
+    }
+
+    const char* crc_kernel = crc32c_setup((checksum_t)cfg.checksum);
+
+    int status = 0;
+    int child_error = 0;
+
+    lat_hist_t* lats = NULL;
+    if (cfg.latency && !(lats = lat_alloc_shared(cfg.consumers))) {
+        perror("mmap latency histograms");
+        return 3;
+    }
+    stats_block_t* sb = sb_create(cfg.producers, cfg.consumers, cfg.messages_per_producer, verify);
+    if (!sb) return 3;
+    sb_sampler_t* sampler = NULL;
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    if (threads) {
+        // workers[0..C) consumers, workers[C..C+P) producers
+        int total = cfg.consumers + cfg.producers;
+        worker_t* workers = (worker_t*)calloc((size_t)total, sizeof(worker_t));
+        pthread_barrier_t start;
+        if (!workers || pthread_barrier_init(&start, NULL, (unsigned)total + 1) != 0) {
+            perror("threads");
+            return 4;
+        }
+        for (int k = 0; k < total; k++) {
+            worker_t* w = &workers[k];
+            w->start = &start;
+            w->cfg = &cfg;
+            w->is_consumer = k < cfg.consumers;
+            w->id = w->is_consumer ? k : k - cfg.consumers;
+            w->st.lat = (lats && w->is_consumer) ? &lats[k] : NULL;
+            w->st.sb = sb;
+            w->st.slot = w->is_consumer ? &sb->slots[k] : NULL;
+            w->fd = w->is_consumer ? sv[1] : sv[0];
+            if (pthread_create(&w->tid, NULL, worker_main, w) != 0) {
+                perror("pthread_create");
+                return 4;
+            }
+        }
+        pthread_barrier_wait(&start);
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        if (sample_ms) sampler = sb_sampler_start(sb, sample_ms, stdout);
+
+        // Producers done: close the send end so consumers read EOF
+        for (int k = cfg.consumers; k < total; k++) {
+            pthread_join(workers[k].tid, NULL);
+            if (workers[k].rc != 0) child_error = 1;
+        }
+        close(sv[0]);
+        for (int k = 0; k < cfg.consumers; k++) {
+            pthread_join(workers[k].tid, NULL);
+            sb_print_consumer(stdout, k, &workers[k].st);
+            if (workers[k].rc != 0) child_error = 1;
+        }
+        close(sv[1]);
+        pthread_barrier_destroy(&start);
+        free(workers);
+    }
+
+    // Fork consumers (receive end)
+    for (int c = 0; c < cfg.consumers && !threads; c++) {
+        pid_t pid = fork();
+        if (pid < 0) { perror("fork consumer"); return 4; }
+        if (pid == 0) {
+            close(sv[0]); // or EOF never arrives
+            stats_t st = { .lat = lats ? &lats[c] : NULL, .sb = sb, .slot = &sb->slots[c] };
+            int rc = uds_consumer_run(sv[1], &cfg, &st);
+            sb_publish_stats(&st);
+            sb_print_consumer(stdout, c, &st);
+            fflush(stdout); // _exit() skips stdio flushing when stdout is a pipe
+            close(sv[1]);
+            _exit(rc);
+        }
+    }
+
+    // Fork producers (send end)
+    for (int p = 0; p < cfg.producers && !threads; p++) {
+        pid_t pid = fork();
+        if (pid < 0) { perror("fork producer"); return 5; }
+        if (pid == 0) {
+            close(sv[1]);
+            int rc = uds_producer_run(sv[0], (uint32_t)p, &cfg, sb);
+            close(sv[0]);
+            _exit(rc);
+        }
+    }
+
+    if (!threads) {
+        // Parent: close both ends so consumers see EOF when the last producer exits
+        close(sv[0]);
+        close(sv[1]);
+        if (sample_ms) sampler = sb_sampler_start(sb, sample_ms, stdout);
+
+        while (1) {
+            pid_t w = wait(&status);
+            if (w < 0) {
+                if (errno == EINTR) continue;
+                break;
+            }
+            if ((WIFEXITED(status) && WEXITSTATUS(status) != 0) || WIFSIGNALED(status)) child_error = 1;
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    sb_sampler_stop(sampler);
+    double sec = elapsed_sec(t0, t1);
+
+    unsigned long long total_msgs =
+        (unsigned long long)cfg.producers * (unsigned long long)cfg.messages_per_producer - sb_dropped(sb);
+
+    double msgs_per_sec = (sec > 0.0) ? ((double)total_msgs / sec) : 0.0;
+    char onfull_buf[32];
+
+    sb_report_producers(sb, stdout);
+
+    printf("run(uds): producers=%d consumers=%d messages_per_producer=%u msg_size=%u batch=%u",
+           cfg.producers, cfg.consumers, cfg.messages_per_producer, cfg.msg_size, cfg.batch);
+    if (cfg.checksum) printf(" checksum=crc32c/%s", crc_kernel);
+    if (cfg.rate > 0.0) printf(" rate=%.0f arrival=%s", cfg.rate * cfg.producers, arrival_name((arrival_t)cfg.arrival));
+    if (cfg.on_full != ONFULL_BLOCK) printf(" on_full=%s", onfull_name(&cfg, onfull_buf, sizeof(onfull_buf)));
+    if (threads) printf(" mode=threads");
+    printf("\n");
+    printf("timing: %.3f sec | approx %.0f msgs/sec\n", sec, msgs_per_sec);
+    if (lats) {
+        lat_report(stdout, lats, cfg.consumers);
+        lat_free_shared(lats, cfg.consumers);
+    }
+    int mismatch = sb_report(sb, stdout);
+    sb_destroy(sb);
+
+    if (child_error) return 6;
+    return mismatch ? SB_EXIT_MISMATCH : 0;
+}
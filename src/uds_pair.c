@@ -0,0 +1,203 @@
+#define _GNU_SOURCE // sendmmsg, recvmmsg, MSG_WAITFORONE, ppoll
+#include "uds_pair.h"
+#include "latency.h"
+#include "seqtrack.h"
+#include "crc32c.h"
+#include "pacer.h"
+#include "onfull.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <poll.h>
+
+// SEQPACKET keeps each frame a separate record, so there is no PIPE_BUF
+// cap; a frame only has to fit in the socket's send buffer.
+int uds_pair_open(int sv[2], int sndbuf) {
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) < 0) {
+        perror("socketpair");
+        return -1;
+    }
+    if (sndbuf > 0) {
+        setsockopt(sv[0], SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+        setsockopt(sv[1], SOL_SOCKET, SO_RCVBUF, &sndbuf, sizeof(sndbuf));
+    }
+    int eff_sndbuf = 0;
+    socklen_t optlen = sizeof(eff_sndbuf);
+    getsockopt(sv[0], SOL_SOCKET, SO_SNDBUF, &eff_sndbuf, &optlen);
+    return eff_sndbuf;
+}
+
+// Producers share one end of a SOCK_SEQPACKET socketpair. Each datagram is one
+// whole frame, and sendmmsg hands up to cfg->batch of them to the kernel per call.
+// Sends use MSG_DONTWAIT: when the socket is full, the producer waits in
+// ppoll() for room as cfg->on_full says and drops what misses the deadline.
+int uds_producer_run(int fd, uint32_t producer_id, const config_t* cfg, stats_block_t* sb) {
+    size_t msg_bytes = sizeof(msg_hdr_t) + cfg->msg_size;
+    uint32_t batch = cfg->batch;
+
+    unsigned char* frames = (unsigned char*)malloc(msg_bytes * batch);
+    struct mmsghdr* msgs = (struct mmsghdr*)calloc(batch, sizeof(*msgs));
+    struct iovec* iov = (struct iovec*)calloc(batch, sizeof(*iov));
+    uint64_t* stamps = (uint64_t*)malloc(sizeof(uint64_t) * batch);
+    if (!frames || !msgs || !iov || !stamps) {
+        free(frames); free(msgs); free(iov); free(stamps);
+        return 1;
+    }
+    for (uint32_t k = 0; k < batch; k++) {
+        memset(frames + k * msg_bytes + sizeof(msg_hdr_t), 'A' + (producer_id % 26), cfg->msg_size);
+        iov[k].iov_base = frames + k * msg_bytes;
+        iov[k].iov_len = msg_bytes;
+        msgs[k].msg_hdr.msg_iov = &iov[k];
+        msgs[k].msg_hdr.msg_iovlen = 1;
+    }
+
+    msg_hdr_t hdr;
+    hdr.producer_id = producer_id;
+    hdr.payload_len = cfg->msg_size;
+    hdr.crc32 = 0;
+    hdr.send_ns = 0;
+
+    pacer_t pacer;
+    pacer_init(&pacer, cfg, producer_id);
+
+    uint32_t i = 0;
+    while (i < cfg->messages_per_producer) {
+        uint32_t n = cfg->messages_per_producer - i;
+        if (n > batch) n = batch;
+        if (pacer.active) n = pacer_take(&pacer, n, stamps); // --rate: only what is due
+        else if (cfg->latency) hdr.send_ns = lat_now_ns(); // one sendmmsg, one timestamp
+        for (uint32_t k = 0; k < n; k++) {
+            hdr.seq = i + k;
+            if (pacer.active) hdr.send_ns = stamps[k];
+            if (cfg->checksum) hdr.crc32 = crc32c_frame(&hdr, frames + k * msg_bytes + sizeof(msg_hdr_t));
+            memcpy(frames + k * msg_bytes, &hdr, sizeof(hdr));
+        }
+
+        // sendmmsg may stop early (e.g. interrupted once the first went out)
+        uint32_t sent = 0;
+        uint64_t full_ns = 0, deadline = 0;
+        while (sent < n) {
+            int r = sendmmsg(fd, msgs + sent, n - sent, MSG_DONTWAIT);
+            if (r >= 0) {
+                sent += (uint32_t)r;
+                continue;
+            }
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN) {
+                perror("sendmmsg");
+                free(frames); free(msgs); free(iov); free(stamps);
+                return 2;
+            }
+            uint64_t now = lat_now_ns();
+            if (!full_ns) {
+                full_ns = now;
+                deadline = onfull_deadline(cfg, now);
+            }
+            if (deadline && now >= deadline) {
+                sb_note_full(&sb->prod[producer_id], full_ns, now);
+                full_ns = 0;
+                for (; sent < n; sent++) sb_drop(sb, producer_id, i + sent);
+                break;
+            }
+            struct timespec left;
+            if (deadline) onfull_remaining(deadline, now, &left);
+            struct pollfd pfd = { fd, POLLOUT, 0 };
+            if (ppoll(&pfd, 1, deadline ? &left : NULL, NULL) < 0 && errno != EINTR) {
+                perror("ppoll");
+                free(frames); free(msgs); free(iov); free(stamps);
+                return 2;
+            }
+        }
+        if (full_ns) sb_note_full(&sb->prod[producer_id], full_ns, lat_now_ns());
+        i += n;
+    }
+
+    free(frames); free(msgs); free(iov); free(stamps);
+    return 0;
+}
+
+// Consumers share the other end. recvmmsg with MSG_WAITFORONE blocks for the
+// first datagram and then takes whatever else is queued, up to cfg->batch.
+// Once every producer has closed its end, a zero-length record marks EOF.
+int uds_consumer_run(int fd, const config_t* cfg, stats_t* out) {
+    stats_t st = { .lat = out->lat, .sb = out->sb, .slot = out->slot };
+
+    seqtrack_t* seen = seqtrack_new((uint32_t)cfg->producers, cfg->messages_per_producer);
+    if (!seen) return 1;
+
+    size_t msg_bytes = sizeof(msg_hdr_t) + cfg->msg_size;
+    uint32_t batch = cfg->batch;
+    unsigned char* frames = (unsigned char*)malloc(msg_bytes * batch);
+    struct mmsghdr* msgs = (struct mmsghdr*)calloc(batch, sizeof(*msgs));
+    struct iovec* iov = (struct iovec*)calloc(batch, sizeof(*iov));
+    if (!frames || !msgs || !iov) {
+        seqtrack_free(seen); free(frames); free(msgs); free(iov);
+        return 1;
+    }
+    for (uint32_t k = 0; k < batch; k++) {
+        iov[k].iov_base = frames + k * msg_bytes;
+        iov[k].iov_len = msg_bytes;
+        msgs[k].msg_hdr.msg_iov = &iov[k];
+        msgs[k].msg_hdr.msg_iovlen = 1;
+    }
+
+    int rc = 0;
+    while (1) {
+        int n = recvmmsg(fd, msgs, batch, MSG_WAITFORONE, NULL);
+        if (n == 0) break;
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("recvmmsg");
+            rc = 2;
+            break;
+        }
+
+        uint64_t now_ns = st.lat ? lat_now_ns() : 0; // every record here was dequeued by this call
+        int eof = 0;
+        for (int k = 0; k < n; k++) {
+            msg_hdr_t hdr;
+            // a zero-length record is how recvmmsg reports the peer having closed
+            if (msgs[k].msg_len == 0) {
+                eof = 1;
+                break;
+            }
+            if (msgs[k].msg_len != msg_bytes || (msgs[k].msg_hdr.msg_flags & MSG_TRUNC)) {
+                st.malformed++;
+                continue;
+            }
+            memcpy(&hdr, frames + (size_t)k * msg_bytes, sizeof(hdr));
+
+            // A checksum mismatch is a corrupt record: counted as malformed, not received
+            if (hdr.payload_len != cfg->msg_size ||
+                (cfg->checksum && hdr.crc32 != crc32c_frame(&hdr, frames + (size_t)k * msg_bytes + sizeof(hdr)))) {
+                st.malformed++;
+                continue;
+            }
+
+            st.total_received++;
+            if (st.lat) lat_record(st.lat, hdr.send_ns, now_ns);
+
+            if (hdr.producer_id >= (uint32_t)cfg->producers || hdr.seq >= cfg->messages_per_producer) {
+                st.out_of_range++;
+                continue;
+            }
+            if (st.sb) sb_mark(st.sb, hdr.producer_id, hdr.seq);
+
+            seq_result_t seq_res = seqtrack_mark(seen, hdr.producer_id, hdr.seq);
+            if (seq_res == SEQ_DUP) st.duplicates++;
+            else if (seq_res == SEQ_LATE) st.late++;
+        }
+        if (st.slot) sb_note_received(st.slot, st.total_received);
+        if (eof) break;
+    }
+
+    seqtrack_free(seen); free(frames); free(msgs); free(iov);
+    *out = st;
+    return rc;
+}
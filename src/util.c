@@ -1,9 +1,23 @@
+#include "util.h"
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 #include <unistd.h>
 
+int parse_int(const char* s) {
+    char* end = NULL;
+    long v = strtol(s, &end, 10);
+    if (!s[0] || !end || *end != '\0') return -1;
+    if (v < 0 || v > 1000000000L) return -1;
+    return (int)v;
+}
+
+double elapsed_sec(struct timespec a, struct timespec b) {
+    return (double)(b.tv_sec - a.tv_sec) + (double)(b.tv_nsec - a.tv_nsec) / 1e9;
+}
+
 // Robust write: write exactly n bytes unless error
 ssize_t write_all(int fd, const void* buf, size_t n) {
     const char* p = (const char*)buf;
@@ -38,3 +52,11 @@ ssize_t read_all(int fd, void* buf, size_t n) {
     return (ssize_t)n;
 }
 
+// Single read that retries on EINTR; returns whatever the pipe had (0 = EOF)
+ssize_t read_some(int fd, void* buf, size_t n) {
+    for (;;) {
+        ssize_t r = read(fd, buf, n);
+        if (r < 0 && errno == EINTR) continue;
+        return r;
+    }
+}
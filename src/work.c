@@ -0,0 +1,71 @@
+#include "work.h"
+#include "latency.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_WORK_NS 1000000000ul // one second
+
+static int parse_ns(const char* s, char** end, uint32_t* out) {
+    unsigned long v = strtoul(s, end, 10);
+    if (*end == s || v > MAX_WORK_NS) return -1;
+    *out = (uint32_t)v;
+    return 0;
+}
+
+int work_parse(const char* s, config_t* cfg) {
+    char* end = NULL;
+    if (!strncmp(s, "bimodal:", 8)) {
+        if (parse_ns(s + 8, &end, &cfg->work_ns) < 0 || *end != ',') return -1;
+        if (parse_ns(end + 1, &end, &cfg->work_slow_ns) < 0 || *end != ',') return -1;
+        const char* p = end + 1;
+        double v = strtod(p, &end);
+        if (end == p || *end || !(v >= 0.0 && v <= 1.0)) return -1;
+        cfg->work_slow_p = v;
+        cfg->work = WORK_BIMODAL;
+        return 0;
+    }
+    int dist = WORK_FIXED;
+    if (!strncmp(s, "exp:", 4)) {
+        dist = WORK_EXP;
+        s += 4;
+    } else if (!strncmp(s, "fixed:", 6)) {
+        s += 6;
+    }
+    if (parse_ns(s, &end, &cfg->work_ns) < 0 || *end) return -1;
+    cfg->work = cfg->work_ns ? dist : WORK_NONE;
+    return 0;
+}
+
+const char* work_name(const config_t* cfg, char* buf, size_t len) {
+    switch (cfg->work) {
+    case WORK_EXP: snprintf(buf, len, "exp:%u", cfg->work_ns); break;
+    case WORK_BIMODAL: snprintf(buf, len, "bimodal:%u,%u,%g", cfg->work_ns, cfg->work_slow_ns, cfg->work_slow_p); break;
+    case WORK_FIXED: snprintf(buf, len, "fixed:%u", cfg->work_ns); break;
+    default: snprintf(buf, len, "none"); break;
+    }
+    return buf;
+}
+
+static double next_unit(uint64_t* rng) {
+    *rng ^= *rng << 13;
+    *rng ^= *rng >> 7;
+    *rng ^= *rng << 17;
+    return (double)((*rng >> 11) + 1) / 9007199254740993.0; // (0, 1]
+}
+
+uint64_t work_draw(const config_t* cfg, uint64_t* rng) {
+    switch (cfg->work) {
+    case WORK_FIXED: return cfg->work_ns;
+    case WORK_EXP: return (uint64_t)(-log(next_unit(rng)) * cfg->work_ns);
+    case WORK_BIMODAL: return next_unit(rng) <= cfg->work_slow_p ? cfg->work_slow_ns : cfg->work_ns;
+    default: return 0;
+    }
+}
+
+void work_spin(uint64_t ns) {
+    if (!ns) return;
+    uint64_t until = lat_now_ns() + ns;
+    while (lat_now_ns() < until) {}
+}